@@ -0,0 +1,47 @@
+// Aot.cpp : Translates a script into a C++ translation unit, see funcstack_add_aot_library() in CMakeLists.txt
+//
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "src/Base/Program.h"
+#include "src/Utils/Utils.h"
+#include "src/Compiler/Compiler.h"
+#include "src/Aot/CppTranslator.h"
+
+int main(int argc, char* argv[]) {
+	if (argc != 3) {
+		std::cerr << "Usage: FuncStackAot <script> <output.cpp>" << std::endl;
+		return 1;
+	}
+
+	std::ifstream input(argv[1]);
+	if (!input) {
+		std::cerr << "Can't read " << argv[1] << std::endl;
+		return 1;
+	}
+	std::stringstream code;
+	code << input.rdbuf();
+
+	try {
+		compiler::Compiler compiler(code.str());
+		const base::Program program = compiler.run();
+		if (!compiler.isSuccess()) {
+			std::cerr << "Can't compile " << argv[1] << std::endl;
+			return 1;
+		}
+
+		std::ofstream output(argv[2]);
+		output << aot::CppTranslator(program).run();
+		if (!output) {
+			std::cerr << "Can't write " << argv[2] << std::endl;
+			return 1;
+		}
+	} catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
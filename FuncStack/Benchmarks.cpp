@@ -0,0 +1,22 @@
+// Benchmarks.cpp : Runs the execution benchmark suite, see test/Benchmarks/Execution.h
+//                  "FuncStackBenchmarks compiler" runs the compiler scaling benchmarks instead, see test/Benchmarks/CompilerScaling.h
+
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "src/Base/Program.h"
+#include "src/Utils/Utils.h"
+#include "test/Benchmarks/Execution.h"
+#include "test/Benchmarks/CompilerScaling.h"
+
+int main(int argc, char* argv[]) {
+	if ((argc > 1) and (std::string(argv[1]) == "compiler")) {
+		benchmark::compilerScaling::run();
+	} else {
+		benchmark::execution::run();
+	}
+	return 0;
+}
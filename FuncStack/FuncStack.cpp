@@ -10,11 +10,33 @@
 #include "test/VariableTest.h"
 #include "test/ControlFlowTest.h"
 #include "test/FunctionTest.h"
+#include "test/RegistermachineTest.h"
+#include "test/UntaggedStackmachineTest.h"
+#include "test/InlinerTest.h"
+#include "test/JitTest.h"
+#include "test/AotTest.h"
+#include "test/SharedProgramTest.h"
+#include "test/ExecBudgetTest.h"
+#include "test/SchedulerTest.h"
+#include "test/ExecutorTest.h"
+#include "test/ParallelForTest.h"
+#include "test/BatchMachineTest.h"
+#include "test/InstrumentationTest.h"
+#include "test/ProfilerTest.h"
+#include "test/SourceLineTest.h"
+#include "test/TraceTest.h"
+#include "test/RunStatsTest.h"
 #include "test/CompleteTest.h"
+#include "test/ForcedJit.h"
 
 #include "test/catch.hpp"
 
 #include "test/Benchmarks/Tokenizer_Numbers.h"
+#include "test/Benchmarks/Dispatch.h"
+#include "test/Benchmarks/BasicType.h"
+#include "test/Benchmarks/Calls.h"
+#include "test/Benchmarks/Executor.h"
+#include "test/Benchmarks/Batch.h"
 
 /* TODO
 	- String interning
@@ -29,9 +51,21 @@ int main(int argc, char* argv[]) {
 	Catch::Session session;
 	session.configData().showSuccessfulTests = false;
 	session.configData().showDurations = Catch::ShowDurations::Always;
-	const int testReturn = session.run(argc, argv);
+	int testReturn = session.run(argc, argv);
+
+#if SM_JIT
+	// everything again, the machines of the tests compile every function they can from its first call on
+	forcedJit::hotThreshold = 0;
+	testReturn = std::max(testReturn, session.run());
+	forcedJit::hotThreshold.reset();
+#endif
 
 	//benchmark::tokenizer::run();
+	//benchmark::dispatch::run();
+	//benchmark::basicType::run();
+	//benchmark::calls::run();
+	//benchmark::executor::run();
+	//benchmark::batch::run();
 
 	printSize<base::Operation>("Operation");
 	printSize<base::BasicType>("BasicType");
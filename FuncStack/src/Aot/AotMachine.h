@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cassert>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "src/Base/BasicType.h"
+#include "src/Exception.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+namespace aot {
+	/* Runs a program that CppTranslator turned into a shared library, built with funcstack_add_aot_library().
+	*  Offers the same interface as the StackMachine, the globals are the bottom of the stack after exec(). */
+	class AotMachine {
+	public:
+		static constexpr size_t defaultStackDepth = 1 << 16;
+
+		explicit AotMachine(const std::string& library, size_t maxStackDepth = defaultStackDepth)
+			: dataStack(maxStackDepth) {
+#ifdef _WIN32
+			handle = LoadLibraryA(library.c_str());
+			if (handle == nullptr) {
+				throw ex::Exception("Can't load " + library);
+			}
+			execFunction = reinterpret_cast<ExecFunction>(GetProcAddress(handle, "funcstack_aot_exec"));
+#else
+			handle = dlopen(library.c_str(), RTLD_NOW | RTLD_LOCAL);
+			if (handle == nullptr) {
+				throw ex::Exception("Can't load " + library + ": " + dlerror());
+			}
+			execFunction = reinterpret_cast<ExecFunction>(dlsym(handle, "funcstack_aot_exec"));
+#endif
+			if (execFunction == nullptr) {
+				unload();
+				throw ex::Exception(library + " is no translated program");
+			}
+		}
+
+		AotMachine(const AotMachine&) = delete;
+		AotMachine& operator=(const AotMachine&) = delete;
+
+		~AotMachine() {
+			unload();
+		}
+
+		void exec() {
+			const char* error = nullptr;
+			const size_t valuesLeft = execFunction(dataStack.data(), dataStack.size(), &error);
+			if (error != nullptr) {
+				throw ex::Exception(error);
+			}
+			stackSize = valuesLeft;
+		}
+
+		base::BasicType getGlobalVariable(size_t offset) const {
+			assert(offset < stackSize);
+			return dataStack[offset];
+		}
+
+		size_t size() const {
+			return stackSize;
+		}
+
+		std::span<const base::BasicType> getDataStack() const {
+			return std::span<const base::BasicType>(dataStack.data(), stackSize);
+		}
+
+	private:
+		using ExecFunction = size_t(*)(base::BasicType*, size_t, const char**);
+
+#ifdef _WIN32
+		HMODULE handle;
+#else
+		void* handle;
+#endif
+		ExecFunction execFunction;
+		std::vector<base::BasicType> dataStack;
+		size_t stackSize = 0; // values left on the stack by the last exec()
+
+		void unload() {
+#ifdef _WIN32
+			FreeLibrary(handle);
+#else
+			dlclose(handle);
+#endif
+		}
+	};
+}
@@ -0,0 +1,364 @@
+#pragma once
+
+#include <algorithm>
+#include <iomanip>
+#include <limits>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "src/Base/Program.h"
+#include "src/Base/BytecodeAnalysis.h"
+#include "src/Exception.h"
+
+namespace aot {
+	/* Turns a program into a standalone C++ translation unit that only depends on BasicType.h.
+	*  Every function becomes a C++ function, its stack slots a local array with fixed indices and its jumps gotos.
+	*  The unit exports the C interface AotMachine loads:
+	*  size_t funcstack_aot_exec(base::BasicType* stack, size_t capacity, const char** error)
+	*  It runs the program on stack and returns the number of values left on it, like StackMachine::size(). */
+	class CppTranslator {
+	public:
+		explicit CppTranslator(const base::Program& program)
+			: program(program), bytecode(program.bytecode), depths(program.bytecode) {
+			for (size_t i = 0; i < bytecode.size(); i++) {
+				if ((bytecode[i].getOpCode() == base::OpCode::JUMP) or (bytecode[i].getOpCode() == base::OpCode::JUMP_IF_NOT)) {
+					labels.insert(base::jumpTarget(bytecode, i));
+				}
+			}
+		}
+
+		std::string run() {
+			out << "// Generated by FuncStackAot, changes get overwritten\n";
+			out << "#include <cstdint>\n#include <cstring>\n#include <sstream>\n#include <string>\n\n";
+			out << "#include \"src/Base/BasicType.h\"\n\n";
+			out << "#ifdef _WIN32\n#define FUNCSTACK_AOT_EXPORT extern \"C\" __declspec(dllexport)\n";
+			out << "#else\n#define FUNCSTACK_AOT_EXPORT extern \"C\" __attribute__((visibility(\"default\")))\n#endif\n\n";
+			out << "namespace {\n";
+			out << "\tusing base::BasicType;\n\n";
+			out << "\tstruct Runtime {\n\t\tBasicType* stack;\n\t\tsize_t capacity;\n\t};\n\n";
+
+			for (const auto& [entry, function] : depths.allFunctions()) {
+				out << "\t" << signature(function) << ";\n";
+			}
+			out << "\n";
+			for (const auto& [entry, function] : depths.allFunctions()) {
+				translateFunction(function);
+			}
+			translateTopLevel();
+			out << "}\n\n";
+
+			out << "FUNCSTACK_AOT_EXPORT size_t funcstack_aot_exec(base::BasicType* stack, size_t capacity, const char** error) {\n";
+			out << "\tstatic thread_local std::string message;\n";
+			out << "\ttry {\n";
+			out << "\t\tif (capacity < " << depths.topLevelMaxDepth() << ") {\n";
+			out << "\t\t\tthrow ex::Exception(\"Stack overflow\");\n";
+			out << "\t\t}\n";
+			out << "\t\tRuntime runtime{ stack, capacity };\n";
+			out << "\t\treturn topLevel(runtime);\n";
+			out << "\t} catch (const std::exception& e) {\n";
+			out << "\t\tmessage = e.what();\n";
+			out << "\t\t*error = message.c_str();\n";
+			out << "\t\treturn 0;\n";
+			out << "\t}\n";
+			out << "}\n";
+			return out.str();
+		}
+
+	private:
+		const base::Program& program;
+		const base::Bytecode& bytecode;
+		const base::StackDepths depths;
+		std::set<size_t> labels; // targets of gotos, calls enter the C++ function instead
+		std::ostringstream out;
+
+		static std::string slot(size_t index) {
+			return "s[" + std::to_string(index) + "]";
+		}
+
+		static std::string functionName(size_t entry) {
+			return "f" + std::to_string(entry);
+		}
+
+		std::string signature(const base::StackDepths::Function& function) const {
+			std::string result = (function.returnsValue ? "BasicType " : "void ") + functionName(function.entry) + "(Runtime& runtime, size_t base";
+			for (uint32_t i = 0; i < function.params; i++) {
+				result += ", BasicType p" + std::to_string(i);
+			}
+			return result + ")";
+		}
+
+		static std::string cppType(base::TypeIndex type) {
+			switch (type) {
+				case base::TypeIndex::Int: return "base::sm_int";
+				case base::TypeIndex::Uint: return "base::sm_uint";
+				case base::TypeIndex::Float: return "base::sm_float";
+				case base::TypeIndex::Bool: return "base::sm_bool";
+				default: throw ex::Exception("Unknown type for the AOT translation");
+			}
+		}
+
+		static std::string intLiteral(base::sm_int value) {
+			if (value == std::numeric_limits<base::sm_int>::min()) {
+				return "(-9223372036854775807LL - 1)"; // the literal without the sign doesn't fit
+			}
+			return std::to_string(value) + "LL";
+		}
+
+		std::string literal(size_t index) const {
+			const base::BasicType& value = program.literals[index];
+			std::ostringstream stream;
+			switch (value.typeId()) {
+				case base::TypeIndex::Int:
+					stream << "BasicType(base::sm_int(" << intLiteral(value.getInt()) << "))";
+					break;
+				case base::TypeIndex::Uint:
+					stream << "BasicType(base::sm_uint(" << value.getUint() << "ULL))";
+					break;
+				case base::TypeIndex::Float:
+					stream << "BasicType(base::sm_float(" << std::hexfloat << value.getFloat() << "))"; // exact
+					break;
+				case base::TypeIndex::Bool:
+					stream << "BasicType(" << (value.getBool() ? "true" : "false") << ")";
+					break;
+				default:
+					throw ex::Exception("Unknown literal type for the AOT translation");
+			}
+			return stream.str();
+		}
+
+		std::string intLiteralOf(size_t index) const {
+			return "base::sm_int(" + intLiteral(program.literals[index].getUnchecked<base::sm_int>()) + ")";
+		}
+
+		std::vector<size_t> body(size_t owner) const {
+			std::vector<size_t> operations;
+			for (size_t i = 0; i < bytecode.size(); i++) {
+				if (depths.depth(i).has_value() and (depths.owner(i) == owner)) {
+					operations.push_back(i);
+				}
+			}
+			return operations;
+		}
+
+		void translateFunction(const base::StackDepths::Function& function) {
+			out << "\t" << signature(function) << " {\n";
+			out << "\t\tBasicType s[" << std::max<size_t>(function.maxDepth, 1) << "];\n";
+			for (uint32_t i = 0; i < function.params; i++) {
+				out << "\t\t" << slot(i) << " = p" << i << ";\n";
+			}
+			const std::vector<size_t> operations = body(function.entry);
+			const bool hasSelfTailCall = std::any_of(operations.begin(), operations.end(), [&](size_t i) {
+				return (bytecode[i].getOpCode() == base::OpCode::TAIL_CALL) and (base::jumpTarget(bytecode, i) == function.entry);
+			});
+			if (hasSelfTailCall) {
+				out << "\tentry:\n";
+			}
+			out << "\t\tif (base + " << function.maxDepth << " > runtime.capacity) {\n";
+			out << "\t\t\tthrow ex::Exception(\"Stack overflow\");\n";
+			out << "\t\t}\n";
+
+			for (size_t i : operations) {
+				translateOperation(i, function);
+			}
+			out << "\t}\n\n";
+		}
+
+		// The frame of the code outside of functions is the bottom of the stack, its slots are the globals
+		void translateTopLevel() {
+			const base::StackDepths::Function topLevel{ base::StackDepths::topLevel, 0, false, depths.topLevelMaxDepth() };
+			out << "\tsize_t topLevel(Runtime& runtime) {\n";
+			out << "\t\tBasicType* const s = runtime.stack;\n";
+			out << "\t\t[[maybe_unused]] const size_t base = 0;\n";
+			for (size_t i : body(base::StackDepths::topLevel)) {
+				translateOperation(i, topLevel);
+			}
+			out << "\t}\n";
+		}
+
+		void line(const std::string& statement) {
+			out << "\t\t" << statement << "\n";
+		}
+
+		// b = b <op> a on the payloads, a is the top of the stack
+		void typed(size_t depth, base::TypeIndex type, const std::string& op) {
+			const std::string get = ".getUnchecked<" + cppType(type) + ">()";
+			line(slot(depth - 2) + " = BasicType(" + slot(depth - 2) + get + " " + op + " " + slot(depth - 1) + get + ");");
+		}
+
+		void typedIncrement(size_t depth, base::TypeIndex type, const std::string& op) {
+			line(slot(depth - 1) + " = BasicType(" + slot(depth - 1) + ".getUnchecked<" + cppType(type) + ">() " + op + " " + cppType(type) + "(1));");
+		}
+
+		void typedDivision(size_t depth, base::TypeIndex type) {
+			line("if (" + slot(depth - 1) + ".getUnchecked<" + cppType(type) + ">() == 0) {");
+			line("\tthrow ex::Exception(\"Division through zero\");");
+			line("}");
+			typed(depth, type, "/");
+		}
+
+		void generic(size_t depth, const std::string& op) {
+			line(slot(depth - 2) + " = " + slot(depth - 2) + " " + op + " " + slot(depth - 1) + ";");
+		}
+
+		void localLiteral(const base::Operation& op, size_t depth, const std::string& cppOp) {
+			line(slot(depth) + " = BasicType(" + slot(op.side_unsignedData()) + ".getUnchecked<base::sm_int>() " + cppOp + " " + intLiteralOf(op.unsignedData()) + ");");
+		}
+
+		void localLocal(const base::Operation& op, size_t depth, const std::string& cppOp) {
+			line(slot(depth) + " = BasicType(" + slot(op.side_unsignedData()) + ".getUnchecked<base::sm_int>() " + cppOp + " " + slot(op.unsignedData()) + ".getUnchecked<base::sm_int>());");
+		}
+
+		void storeLocal(const base::Operation& op, size_t depth, const std::string& cppOp) {
+			line(slot(op.unsignedData()) + " = BasicType(" + slot(depth - 2) + ".getUnchecked<base::sm_int>() " + cppOp + " " + slot(depth - 1) + ".getUnchecked<base::sm_int>());");
+		}
+
+		void inPlace(const base::Operation& op, const std::string& cppOp) {
+			line(slot(op.unsignedData()) + " = BasicType(" + slot(op.unsignedData()) + ".getUnchecked<base::sm_int>() " + cppOp + " base::sm_int(1));");
+		}
+
+		std::string arguments(size_t frame, size_t params) const {
+			std::string result;
+			for (size_t i = 0; i < params; i++) {
+				result += ", " + slot(frame + i);
+			}
+			return result;
+		}
+
+		void translateOperation(size_t index, const base::StackDepths::Function& function) {
+			const base::Operation& op = bytecode[index];
+			const size_t depth = depths.depth(index).value();
+			if (labels.count(index) > 0) {
+				out << "\tL" << index << ":;\n";
+			}
+
+			switch (op.getOpCode()) {
+				case base::OpCode::POP:
+					break; // the depth of every operation is known
+				case base::OpCode::LOAD_LITERAL:
+					line(slot(depth) + " = " + literal(op.unsignedData()) + ";");
+					break;
+				case base::OpCode::CREATE_VARIABLE:
+					line(slot(depth) + " = BasicType::fromId(static_cast<base::TypeIndex>(" + std::to_string(op.unsignedData()) + "));");
+					break;
+				case base::OpCode::LOAD_LOCAL:
+					line(slot(depth) + " = " + slot(op.unsignedData()) + ";");
+					break;
+				case base::OpCode::STORE_LOCAL:
+					line(slot(op.unsignedData()) + " = " + slot(depth - 1) + ";");
+					break;
+				case base::OpCode::LOAD_GLOBAL:
+					line(slot(depth) + " = runtime.stack[" + std::to_string(op.unsignedData()) + "];");
+					break;
+				case base::OpCode::STORE_GLOBAL:
+					line("runtime.stack[" + std::to_string(op.unsignedData()) + "] = " + slot(depth - 1) + ";");
+					break;
+				case base::OpCode::JUMP:
+					line("goto L" + std::to_string(base::jumpTarget(bytecode, index)) + ";");
+					break;
+				case base::OpCode::JUMP_IF_NOT:
+					line("if (!" + slot(depth - 1) + ".getBool()) {");
+					line("\tgoto L" + std::to_string(base::jumpTarget(bytecode, index)) + ";");
+					line("}");
+					break;
+				case base::OpCode::CALL_FUNCTION:
+				{
+					const size_t params = op.side_unsignedData();
+					const size_t callee = base::jumpTarget(bytecode, index);
+					const std::string call = functionName(callee) + "(runtime, base + " + std::to_string(depth - params) + arguments(depth - params, params) + ");";
+					line(depths.function(callee).returnsValue ? slot(depth - params) + " = " + call : call);
+					break;
+				}
+				case base::OpCode::TAIL_CALL:
+				{
+					const size_t params = op.side_unsignedData();
+					const size_t callee = base::jumpTarget(bytecode, index);
+					if (callee != function.entry) {
+						line("return " + functionName(callee) + "(runtime, base" + arguments(depth - params, params) + ");");
+						break;
+					}
+					// the arguments become the new parameters, copied upwards like in the interpreter, then back to the entry
+					for (size_t i = 0; i < params; i++) {
+						line(slot(i) + " = " + slot(depth - params + i) + ";");
+					}
+					line("goto entry;");
+					break;
+				}
+				case base::OpCode::RETURN:
+					line(function.returnsValue ? "return " + slot(depth - 1) + ";" : "return;");
+					break;
+				case base::OpCode::END_FUNCTION:
+					line(function.returnsValue ? "return BasicType();" : "return;");
+					break;
+				case base::OpCode::END_PROGRAM:
+					line("return " + std::to_string(depth) + ";");
+					break;
+				case base::OpCode::EQ: generic(depth, "=="); break;
+				case base::OpCode::UNEQ: generic(depth, "!="); break;
+				case base::OpCode::LESS: generic(depth, "<"); break;
+				case base::OpCode::BIGGER: generic(depth, ">"); break;
+				case base::OpCode::ADD: generic(depth, "+"); break;
+				case base::OpCode::SUB: generic(depth, "-"); break;
+				case base::OpCode::MULT: generic(depth, "*"); break;
+				case base::OpCode::DIV: generic(depth, "/"); break;
+				case base::OpCode::INCR:
+					line(slot(depth - 1) + " = " + slot(depth - 1) + " + BasicType(1);");
+					break;
+				case base::OpCode::DECR:
+					line(slot(depth - 1) + " = " + slot(depth - 1) + " - BasicType(1);");
+					break;
+				case base::OpCode::ADD_INT: typed(depth, base::TypeIndex::Int, "+"); break;
+				case base::OpCode::ADD_UINT: typed(depth, base::TypeIndex::Uint, "+"); break;
+				case base::OpCode::ADD_FLOAT: typed(depth, base::TypeIndex::Float, "+"); break;
+				case base::OpCode::SUB_INT: typed(depth, base::TypeIndex::Int, "-"); break;
+				case base::OpCode::SUB_UINT: typed(depth, base::TypeIndex::Uint, "-"); break;
+				case base::OpCode::SUB_FLOAT: typed(depth, base::TypeIndex::Float, "-"); break;
+				case base::OpCode::MULT_INT: typed(depth, base::TypeIndex::Int, "*"); break;
+				case base::OpCode::MULT_UINT: typed(depth, base::TypeIndex::Uint, "*"); break;
+				case base::OpCode::MULT_FLOAT: typed(depth, base::TypeIndex::Float, "*"); break;
+				case base::OpCode::DIV_INT: typedDivision(depth, base::TypeIndex::Int); break;
+				case base::OpCode::DIV_UINT: typedDivision(depth, base::TypeIndex::Uint); break;
+				case base::OpCode::DIV_FLOAT: typedDivision(depth, base::TypeIndex::Float); break;
+				case base::OpCode::INCR_INT: typedIncrement(depth, base::TypeIndex::Int, "+"); break;
+				case base::OpCode::INCR_UINT: typedIncrement(depth, base::TypeIndex::Uint, "+"); break;
+				case base::OpCode::INCR_FLOAT: typedIncrement(depth, base::TypeIndex::Float, "+"); break;
+				case base::OpCode::DECR_INT: typedIncrement(depth, base::TypeIndex::Int, "-"); break;
+				case base::OpCode::DECR_UINT: typedIncrement(depth, base::TypeIndex::Uint, "-"); break;
+				case base::OpCode::DECR_FLOAT: typedIncrement(depth, base::TypeIndex::Float, "-"); break;
+				case base::OpCode::EQ_INT: typed(depth, base::TypeIndex::Int, "=="); break;
+				case base::OpCode::EQ_UINT: typed(depth, base::TypeIndex::Uint, "=="); break;
+				case base::OpCode::EQ_FLOAT: typed(depth, base::TypeIndex::Float, "=="); break;
+				case base::OpCode::EQ_BOOL: typed(depth, base::TypeIndex::Bool, "=="); break;
+				case base::OpCode::UNEQ_INT: typed(depth, base::TypeIndex::Int, "!="); break;
+				case base::OpCode::UNEQ_UINT: typed(depth, base::TypeIndex::Uint, "!="); break;
+				case base::OpCode::UNEQ_FLOAT: typed(depth, base::TypeIndex::Float, "!="); break;
+				case base::OpCode::UNEQ_BOOL: typed(depth, base::TypeIndex::Bool, "!="); break;
+				case base::OpCode::LESS_INT: typed(depth, base::TypeIndex::Int, "<"); break;
+				case base::OpCode::LESS_UINT: typed(depth, base::TypeIndex::Uint, "<"); break;
+				case base::OpCode::LESS_FLOAT: typed(depth, base::TypeIndex::Float, "<"); break;
+				case base::OpCode::BIGGER_INT: typed(depth, base::TypeIndex::Int, ">"); break;
+				case base::OpCode::BIGGER_UINT: typed(depth, base::TypeIndex::Uint, ">"); break;
+				case base::OpCode::BIGGER_FLOAT: typed(depth, base::TypeIndex::Float, ">"); break;
+				case base::OpCode::ADD_LOCAL_LITERAL_INT: localLiteral(op, depth, "+"); break;
+				case base::OpCode::SUB_LOCAL_LITERAL_INT: localLiteral(op, depth, "-"); break;
+				case base::OpCode::MULT_LOCAL_LITERAL_INT: localLiteral(op, depth, "*"); break;
+				case base::OpCode::EQ_LOCAL_LITERAL_INT: localLiteral(op, depth, "=="); break;
+				case base::OpCode::UNEQ_LOCAL_LITERAL_INT: localLiteral(op, depth, "!="); break;
+				case base::OpCode::LESS_LOCAL_LITERAL_INT: localLiteral(op, depth, "<"); break;
+				case base::OpCode::BIGGER_LOCAL_LITERAL_INT: localLiteral(op, depth, ">"); break;
+				case base::OpCode::EQ_LOCAL_LOCAL_INT: localLocal(op, depth, "=="); break;
+				case base::OpCode::UNEQ_LOCAL_LOCAL_INT: localLocal(op, depth, "!="); break;
+				case base::OpCode::LESS_LOCAL_LOCAL_INT: localLocal(op, depth, "<"); break;
+				case base::OpCode::BIGGER_LOCAL_LOCAL_INT: localLocal(op, depth, ">"); break;
+				case base::OpCode::ADD_INT_STORE_LOCAL: storeLocal(op, depth, "+"); break;
+				case base::OpCode::SUB_INT_STORE_LOCAL: storeLocal(op, depth, "-"); break;
+				case base::OpCode::MULT_INT_STORE_LOCAL: storeLocal(op, depth, "*"); break;
+				case base::OpCode::INCR_LOCAL_INT: inPlace(op, "+"); break;
+				case base::OpCode::DECR_LOCAL_INT: inPlace(op, "-"); break;
+				default:
+					throw ex::Exception("Operation not supported by the AOT translation: "s + opCodeName(op.getOpCode()));
+			}
+		}
+	};
+}
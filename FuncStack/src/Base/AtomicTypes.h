@@ -37,6 +37,17 @@ namespace base {
 		return TypeIndex::Err;
 	}
 
+	// The keyword of the type in the source, the inverse of stringToId
+	std::string typeName(TypeIndex index) {
+		switch (index) {
+			case TypeIndex::Int: return "int";
+			case TypeIndex::Uint: return "uint";
+			case TypeIndex::Float: return "float";
+			case TypeIndex::Bool: return "bool";
+			default: return "?";
+		}
+	}
+
 	size_t sizeOfType(TypeIndex index) {
 		switch (index) {
 			case TypeIndex::Int: return sizeof(sm_int);
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <type_traits>
 #include <variant>
 #include <string_view>
@@ -8,20 +9,24 @@
 #include "src/Exception.h"
 #include "AtomicTypes.h"	
 
+/* Two representations of a value, switched with SM_VARIANT_BASICTYPE:
+*  - default: 8 byte payload and a separate type tag, accessing a typed value is a plain load
+*  - SM_VARIANT_BASICTYPE: std::variant, mostly there to benchmark against */
+
 namespace base {
 	class BasicType final {
 	public:
-		explicit BasicType(long long value) : inner((sm_int)value) {}
-		explicit BasicType(long value) : inner((sm_int)value) {}
-		explicit BasicType(int value) : inner((sm_int)value) {}
-		explicit BasicType(unsigned long long value) : inner((sm_uint)value) {}
-		explicit BasicType(unsigned long value) : inner((sm_uint)value) {}
-		explicit BasicType(unsigned int value) : inner((sm_uint)value) {}
-		explicit BasicType(long double value) : inner((sm_float)value) {}
-		explicit BasicType(double value) : inner((sm_float)value) {}
-		explicit BasicType(float value) : inner((sm_float)value) {}
-		explicit BasicType(bool value) : inner((sm_bool)value) {}
-		explicit BasicType() {}
+		explicit BasicType(long long value) : BasicType((sm_int)value, Tag<sm_int>()) {}
+		explicit BasicType(long value) : BasicType((sm_int)value, Tag<sm_int>()) {}
+		explicit BasicType(int value) : BasicType((sm_int)value, Tag<sm_int>()) {}
+		explicit BasicType(unsigned long long value) : BasicType((sm_uint)value, Tag<sm_uint>()) {}
+		explicit BasicType(unsigned long value) : BasicType((sm_uint)value, Tag<sm_uint>()) {}
+		explicit BasicType(unsigned int value) : BasicType((sm_uint)value, Tag<sm_uint>()) {}
+		explicit BasicType(long double value) : BasicType((sm_float)value, Tag<sm_float>()) {}
+		explicit BasicType(double value) : BasicType((sm_float)value, Tag<sm_float>()) {}
+		explicit BasicType(float value) : BasicType((sm_float)value, Tag<sm_float>()) {}
+		explicit BasicType(bool value) : BasicType((sm_bool)value, Tag<sm_bool>()) {}
+		explicit BasicType() : BasicType(sm_int{}, Tag<sm_int>()) {}
 
 		static BasicType fromId(TypeIndex opCode) {
 			switch (opCode) {
@@ -34,60 +39,77 @@ namespace base {
 		}
 
 		constexpr bool isInt() const {
-			return std::holds_alternative<sm_int>(inner);
+			return typeId() == TypeIndex::Int;
 		}
 
 		constexpr bool isUint() const {
-			return std::holds_alternative<sm_uint>(inner);
+			return typeId() == TypeIndex::Uint;
 		}
 
 		constexpr bool isFloat() const {
-			return std::holds_alternative<sm_float>(inner);
+			return typeId() == TypeIndex::Float;
 		}
 
 		constexpr bool isBool() const {
-			return std::holds_alternative<sm_bool>(inner);
+			return typeId() == TypeIndex::Bool;
 		}
 
 		constexpr sm_int getInt() const {
-			return std::get<sm_int>(inner);
+			return get<sm_int>();
 		}
 
 		constexpr sm_int& getInt() {
-			return std::get<sm_int>(inner);
+			return get<sm_int>();
 		}
 
 		constexpr sm_uint getUint() const {
-			return std::get<sm_uint>(inner);
+			return get<sm_uint>();
 		}
 
 		constexpr sm_uint& getUint() {
-			return std::get<sm_uint>(inner);
+			return get<sm_uint>();
 		}
 
 		constexpr sm_float getFloat() const {
-			return std::get<sm_float>(inner);
+			return get<sm_float>();
 		}
 
 		constexpr sm_float& getFloat() {
-			return std::get<sm_float>(inner);
+			return get<sm_float>();
 		}
 
 		constexpr sm_bool getBool() const {
-			return std::get<sm_bool>(inner);
+			return get<sm_bool>();
 		}
 
 		constexpr sm_bool& getBool() {
-			return std::get<sm_bool>(inner);
+			return get<sm_bool>();
+		}
+
+		// Access without type check, the caller has to know the type (e.g. from a typed operation)
+		template<typename T>
+		constexpr T getUnchecked() const {
+#ifdef SM_VARIANT_BASICTYPE
+			return *std::get_if<T>(&inner);
+#else
+			if constexpr (std::is_same_v<T, sm_int>) return intValue;
+			else if constexpr (std::is_same_v<T, sm_uint>) return uintValue;
+			else if constexpr (std::is_same_v<T, sm_float>) return floatValue;
+			else return boolValue;
+#endif
 		}
 
 		constexpr TypeIndex typeId() const {
+#ifdef SM_VARIANT_BASICTYPE
 			return static_cast<TypeIndex>(inner.index());
+#else
+			return static_cast<TypeIndex>(tag);
+#endif
 		}
 
 		std::string toString() const {
 			std::ostringstream o;
-			std::visit([&](const auto& a) { o << a; }, inner);
+			visit([&](const auto& a) { o << a; }, *this);
 			return o.str();
 		}
 
@@ -95,38 +117,38 @@ namespace base {
 
 		friend std::ostream& operator<<(std::ostream& o, const BasicType& type) {
 			o << std::boolalpha;
-			std::visit([&](auto&& a) {
+			visit([&](auto&& a) {
 				o << "[type: " << idToString(type.typeId()) << ", value: " << a << "]";
-			}, type.inner);
+			}, type);
 			return o;
 		}
 
 		friend BasicType operator+(const BasicType& a, const BasicType& b) {
-			return std::visit([](const auto& a, const auto& b) {
+			return visit([](const auto& a, const auto& b) {
 				ex::assume(!std::is_same<bool, decltype(a)>::value, "Unexpected usage of operator+ with bool (first parameter)");
 				ex::assume(!std::is_same<bool, decltype(b)>::value, "Unexpected usage of operator+ with bool (second parameter)");
 				return BasicType(a + b);
-			}, a.inner, b.inner);
+			}, a, b);
 		}
 
 		friend BasicType operator-(const BasicType& a, const BasicType& b) {
-			return std::visit([](const auto& a, const auto& b) {
+			return visit([](const auto& a, const auto& b) {
 				ex::assume(!std::is_same<bool, decltype(a)>::value, "Unexpected usage of operator- with bool (first parameter)");
 				ex::assume(!std::is_same<bool, decltype(b)>::value, "Unexpected usage of operator- with bool (second parameter)");
 				return BasicType(a - b);
-			}, a.inner, b.inner);
+			}, a, b);
 		}
 
 		friend BasicType operator*(const BasicType& a, const BasicType& b) {
-			return std::visit([](const auto& a, const auto& b) {
+			return visit([](const auto& a, const auto& b) {
 				ex::assume(!std::is_same<bool, decltype(a)>::value, "Unexpected usage of operator* with bool (first parameter)");
 				ex::assume(!std::is_same<bool, decltype(b)>::value, "Unexpected usage of operator* with bool (second parameter)");
 				return BasicType(a * b);
-			}, a.inner, b.inner);
+			}, a, b);
 		}
 
 		friend BasicType operator/(const BasicType& a, const BasicType& b) {
-			return std::visit([](const auto& a, const auto& b) {
+			return visit([](const auto& a, const auto& b) {
 				ex::assume(!std::is_same<bool, decltype(a)>::value, "Unexpected usage of operator/ with bool (first parameter)");
 				ex::assume(!std::is_same<bool, decltype(b)>::value, "Unexpected usage of operator/ with bool (second parameter)");
 
@@ -137,7 +159,7 @@ namespace base {
 				}
 
 				return BasicType(a / b);
-			}, a.inner, b.inner);
+			}, a, b);
 		}
 
 		friend BasicType operator!(const BasicType& a) {
@@ -145,15 +167,15 @@ namespace base {
 		}
 
 		friend BasicType operator<(const BasicType& a, const BasicType& b) noexcept {
-			return std::visit([](const auto& a, const auto& b) {
+			return visit([](const auto& a, const auto& b) {
 				return BasicType(a < b);
-			}, a.inner, b.inner);
+			}, a, b);
 		}
 
 		friend BasicType operator>(const BasicType& a, const BasicType& b) noexcept {
-			return std::visit([](const auto& a, const auto& b) {
+			return visit([](const auto& a, const auto& b) {
 				return BasicType(a > b);
-			}, a.inner, b.inner);
+			}, a, b);
 		}
 
 		friend BasicType operator==(const BasicType& a, const BasicType& b) noexcept {
@@ -161,9 +183,9 @@ namespace base {
 				return BasicType(false);
 			}
 
-			return std::visit([](const auto& a, const auto& b) {
+			return visit([](const auto& a, const auto& b) {
 				return BasicType(a == b);
-			}, a.inner, b.inner);
+			}, a, b);
 		}
 
 		friend BasicType operator!=(const BasicType& a, const BasicType& b) noexcept {
@@ -171,6 +193,98 @@ namespace base {
 		}
 
 	private:
+		template<typename T>
+		struct Tag {};
+
+#ifdef SM_VARIANT_BASICTYPE
 		std::variant<sm_int, sm_uint, sm_float, sm_bool> inner;
+
+		template<typename T>
+		constexpr BasicType(T value, Tag<T>) : inner(value) {}
+
+		template<typename T>
+		constexpr T& get() {
+			return std::get<T>(inner);
+		}
+
+		template<typename T>
+		constexpr T get() const {
+			return std::get<T>(inner);
+		}
+
+		template<typename Func>
+		static std::invoke_result_t<Func, const sm_int&> visit(Func&& func, const BasicType& a) {
+			return std::visit(func, a.inner);
+		}
+
+		template<typename Func>
+		static std::invoke_result_t<Func, const sm_int&, const sm_int&> visit(Func&& func, const BasicType& a, const BasicType& b) {
+			return std::visit(func, a.inner, b.inner);
+		}
+#else
+		union {
+			sm_int intValue;
+			sm_uint uintValue;
+			sm_float floatValue;
+			sm_bool boolValue;
+		};
+		uint8_t tag; // TypeIndex
+
+		template<typename T>
+		constexpr BasicType(T value, Tag<T>) : tag(static_cast<uint8_t>(typeIndexOf<T>())) {
+			payloadAs<T>() = value;
+		}
+
+		template<typename T>
+		static constexpr TypeIndex typeIndexOf() {
+			if constexpr (std::is_same_v<T, sm_int>) return TypeIndex::Int;
+			else if constexpr (std::is_same_v<T, sm_uint>) return TypeIndex::Uint;
+			else if constexpr (std::is_same_v<T, sm_float>) return TypeIndex::Float;
+			else return TypeIndex::Bool;
+		}
+
+		template<typename T>
+		constexpr T& payloadAs() {
+			if constexpr (std::is_same_v<T, sm_int>) return intValue;
+			else if constexpr (std::is_same_v<T, sm_uint>) return uintValue;
+			else if constexpr (std::is_same_v<T, sm_float>) return floatValue;
+			else return boolValue;
+		}
+
+		template<typename T>
+		constexpr T& get() {
+			if (typeId() != typeIndexOf<T>()) {
+				throw ex::Exception("Wrong type access");
+			}
+			return payloadAs<T>();
+		}
+
+		template<typename T>
+		constexpr T get() const {
+			if (typeId() != typeIndexOf<T>()) {
+				throw ex::Exception("Wrong type access");
+			}
+			return getUnchecked<T>();
+		}
+
+		template<typename Func>
+		static std::invoke_result_t<Func, const sm_int&> visit(Func&& func, const BasicType& a) {
+			switch (a.typeId()) {
+				case TypeIndex::Int: return func(a.intValue);
+				case TypeIndex::Uint: return func(a.uintValue);
+				case TypeIndex::Float: return func(a.floatValue);
+				default: return func(a.boolValue); // the tag is always valid
+			}
+		}
+
+		template<typename Func>
+		static std::invoke_result_t<Func, const sm_int&, const sm_int&> visit(Func&& func, const BasicType& a, const BasicType& b) {
+			return visit([&](const auto& valueA) {
+				return visit([&](const auto& valueB) {
+					return func(valueA, valueB);
+				}, b);
+			}, a);
+		}
+#endif
 	};
 }
\ No newline at end of file
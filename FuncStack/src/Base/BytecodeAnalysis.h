@@ -0,0 +1,247 @@
+#pragma once
+
+#include <limits>
+#include <optional>
+#include <map>
+#include <set>
+#include <vector>
+
+#include "Operation.h"
+#include "src/Exception.h"
+
+namespace base {
+	inline bool isJump(OpCode opCode) {
+		switch (opCode) {
+			case OpCode::JUMP:
+			case OpCode::JUMP_IF_NOT:
+			case OpCode::CALL_FUNCTION:
+			case OpCode::TAIL_CALL:
+			case OpCode::SPAWN:
+			case OpCode::PFOR:
+				return true;
+			default: return false;
+		}
+	}
+
+	inline bool isCall(OpCode opCode) {
+		return (opCode == OpCode::CALL_FUNCTION) or (opCode == OpCode::TAIL_CALL);
+	}
+
+	// Operations that jump to the entry of a function, SPAWN and PFOR run it somewhere else than a call would
+	inline bool entersFunction(OpCode opCode) {
+		return isCall(opCode) or (opCode == OpCode::SPAWN) or (opCode == OpCode::PFOR);
+	}
+
+	// Index of the operation that gets executed after the jump (the machine increments pc after every operation)
+	inline size_t jumpTarget(const Bytecode& bytecode, size_t jumpIndex) {
+		return jumpIndex + bytecode[jumpIndex].signedData() + 1;
+	}
+
+	// Number of values an operation pushes (positive) or pops (negative). Calls without their return value.
+	inline int stackEffect(const Operation& op) {
+		switch (op.getOpCode()) {
+			case OpCode::LOAD_LITERAL:
+			case OpCode::LOAD_LOCAL:
+			case OpCode::LOAD_GLOBAL:
+			case OpCode::CREATE_VARIABLE:
+			case OpCode::ADD_LOCAL_LITERAL_INT:
+			case OpCode::SUB_LOCAL_LITERAL_INT:
+			case OpCode::MULT_LOCAL_LITERAL_INT:
+			case OpCode::EQ_LOCAL_LITERAL_INT:
+			case OpCode::UNEQ_LOCAL_LITERAL_INT:
+			case OpCode::LESS_LOCAL_LITERAL_INT:
+			case OpCode::BIGGER_LOCAL_LITERAL_INT:
+			case OpCode::EQ_LOCAL_LOCAL_INT:
+			case OpCode::UNEQ_LOCAL_LOCAL_INT:
+			case OpCode::LESS_LOCAL_LOCAL_INT:
+			case OpCode::BIGGER_LOCAL_LOCAL_INT:
+				return 1;
+			case OpCode::JUMP:
+			case OpCode::INCR:
+			case OpCode::DECR:
+			case OpCode::INCR_INT:
+			case OpCode::INCR_UINT:
+			case OpCode::INCR_FLOAT:
+			case OpCode::DECR_INT:
+			case OpCode::DECR_UINT:
+			case OpCode::DECR_FLOAT:
+			case OpCode::INCR_LOCAL_INT:
+			case OpCode::DECR_LOCAL_INT:
+			case OpCode::END_FUNCTION:
+			case OpCode::END_PROGRAM:
+			case OpCode::YIELD:
+				return 0;
+			case OpCode::STORE_LOCAL:
+			case OpCode::STORE_GLOBAL:
+			case OpCode::JUMP_IF_NOT:
+			case OpCode::RETURN:
+				return -1;
+			case OpCode::ADD_INT_STORE_LOCAL:
+			case OpCode::SUB_INT_STORE_LOCAL:
+			case OpCode::MULT_INT_STORE_LOCAL:
+				return -2;
+			case OpCode::POP:
+				return -static_cast<int>(op.unsignedData());
+			case OpCode::CALL_FUNCTION:
+			case OpCode::TAIL_CALL:
+			case OpCode::SPAWN: // the arguments move to the new fiber
+			case OpCode::PFOR: // begin and end of the range, the chunks return nothing
+				return -static_cast<int>(op.side_unsignedData());
+			default:
+				break;
+		}
+
+		if ((op.getOpCode() >= OpCode::EQ) and (op.getOpCode() <= OpCode::DIV)) {
+			return -1; // generic binary operations
+		}
+		if ((op.getOpCode() >= OpCode::ADD_INT) and (op.getOpCode() <= OpCode::BIGGER_FLOAT)) {
+			return -1; // typed binary operations, INCR and DECR are handled above
+		}
+		throw ex::Exception("Unknown stack effect: "s + opCodeName(op.getOpCode()).str);
+	}
+
+	/* Static stack depth of every reachable operation, relative to the frame of the function it belongs to.
+	*  The code outside of functions starts at index 0 with an empty stack, every called function at its entry
+	*  with its parameters on the stack. Functions only called from outside the program are given as
+	*  entries, entry - number of parameters. */
+	class StackDepths {
+	public:
+		struct Function {
+			size_t entry;
+			uint32_t params;
+			bool returnsValue;
+			size_t maxDepth;
+		};
+
+		explicit StackDepths(const Bytecode& bytecode, const std::map<size_t, uint32_t>& entries = {})
+			: bytecode(bytecode), depths(bytecode.size()), owners(bytecode.size()) {
+			for (const auto& [entry, params] : entries) {
+				functions.try_emplace(entry, Function{ entry, params, returnsValue(entry), 0 });
+			}
+			for (size_t i = 0; i < bytecode.size(); i++) {
+				if (isJump(bytecode[i].getOpCode())) {
+					landings.insert(jumpTarget(bytecode, i));
+				}
+				if (entersFunction(bytecode[i].getOpCode())) {
+					const size_t entry = jumpTarget(bytecode, i);
+					functions.try_emplace(entry, Function{ entry, bytecode[i].side_unsignedData(), returnsValue(entry), 0 });
+				}
+			}
+
+			analyze(0, 0, topLevel);
+			for (auto& [entry, function] : functions) {
+				function.maxDepth = analyze(entry, function.params, entry);
+			}
+		}
+
+		std::optional<size_t> depth(size_t index) const {
+			return depths[index];
+		}
+
+		// Entry of the function an operation belongs to, topLevel for the code outside of functions
+		size_t owner(size_t index) const {
+			return owners[index];
+		}
+
+		bool isLanding(size_t index) const {
+			return landings.count(index) > 0;
+		}
+
+		const Function& function(size_t entry) const {
+			return functions.at(entry);
+		}
+
+		const std::map<size_t, Function>& allFunctions() const {
+			return functions;
+		}
+
+		size_t topLevelMaxDepth() const {
+			return topLevelDepth;
+		}
+
+		static constexpr size_t topLevel = std::numeric_limits<size_t>::max();
+
+	private:
+		const Bytecode& bytecode;
+		std::vector<std::optional<size_t>> depths;
+		std::vector<size_t> owners;
+		std::set<size_t> landings;
+		std::map<size_t, Function> functions;
+		size_t topLevelDepth = 0;
+
+		std::vector<size_t> successors(size_t index) const {
+			switch (bytecode[index].getOpCode()) {
+				case OpCode::JUMP: return { jumpTarget(bytecode, index) };
+				case OpCode::JUMP_IF_NOT: return { index + 1, jumpTarget(bytecode, index) };
+				case OpCode::RETURN:
+				case OpCode::TAIL_CALL: // continues in the called function, returns from there
+				case OpCode::END_FUNCTION:
+				case OpCode::END_PROGRAM: return {};
+				default: return { index + 1 };
+			}
+		}
+
+		bool returnsValue(size_t entry) const {
+			std::vector<bool> visited(bytecode.size());
+			std::vector<size_t> open = { entry };
+			while (!open.empty()) {
+				const size_t index = open.back();
+				open.pop_back();
+				if (visited[index]) {
+					continue;
+				}
+				visited[index] = true;
+
+				if (bytecode[index].getOpCode() == OpCode::RETURN) {
+					return bytecode[index].unsignedData() > 0;
+				}
+				if (bytecode[index].getOpCode() == OpCode::TAIL_CALL) {
+					return true; // only emitted for 'return f(...)'
+				}
+				for (size_t next : successors(index)) {
+					open.push_back(next);
+				}
+			}
+			return false;
+		}
+
+		size_t analyze(size_t entry, size_t initialDepth, size_t owner) {
+			size_t maxDepth = initialDepth;
+			std::vector<std::pair<size_t, size_t>> open = { { entry, initialDepth } };
+			while (!open.empty()) {
+				const auto [index, depth] = open.back();
+				open.pop_back();
+
+				if (depths[index].has_value()) {
+					if (depths[index].value() != depth) {
+						throw ex::Exception("Inconsistent stack depth at " + std::to_string(index));
+					}
+					continue;
+				}
+				depths[index] = depth;
+				owners[index] = owner;
+
+				const Operation& op = bytecode[index];
+				int effect = stackEffect(op);
+				if (op.getOpCode() == OpCode::CALL_FUNCTION) {
+					effect += functions.at(jumpTarget(bytecode, index)).returnsValue ? 1 : 0;
+				}
+
+				const int newDepth = static_cast<int>(depth) + effect;
+				if (newDepth < 0) {
+					throw ex::Exception("Stack underflow at " + std::to_string(index));
+				}
+				maxDepth = std::max(maxDepth, static_cast<size_t>(newDepth));
+
+				for (size_t next : successors(index)) {
+					open.emplace_back(next, static_cast<size_t>(newDepth));
+				}
+			}
+
+			if (owner == topLevel) {
+				topLevelDepth = maxDepth;
+			}
+			return maxDepth;
+		}
+	};
+}
@@ -2,6 +2,7 @@
 
 #include "src/Exception.h"
 #include "src/Utils/StringWindow.h"
+#include "AtomicTypes.h"
 
 namespace base {
 	enum class OpCode : uint8_t {
@@ -16,7 +17,7 @@ namespace base {
 		BRACKET_CURLY_OPEN, BRACKET_CURLY_CLOSE,
 		BRACKET_SQUARE_OPEN, BRACKET_SQUARE_CLOSE,
 		TYPE,
-		NAME, FUNC, RETURN,
+		NAME, FUNC, RETURN, SPAWN, YIELD, PFOR, REDUCE,
 		BEGIN_SCOPE, END_SCOPE,
 
 		// Lexer + Interpreter
@@ -29,11 +30,30 @@ namespace base {
 		ASSIGN,
 
 		// Interpreter
-		CALL_FUNCTION, END_FUNCTION,
+		CALL_FUNCTION, TAIL_CALL, END_FUNCTION,
 		END_PROGRAM,
 		LOAD_LOCAL, LOAD_GLOBAL, STORE_LOCAL, STORE_GLOBAL,
 		JUMP, JUMP_IF_NOT,
 		CREATE_VARIABLE, POP,
+
+		// Interpreter, typed (order has to follow TypeIndex)
+		ADD_INT, ADD_UINT, ADD_FLOAT,
+		SUB_INT, SUB_UINT, SUB_FLOAT,
+		MULT_INT, MULT_UINT, MULT_FLOAT,
+		DIV_INT, DIV_UINT, DIV_FLOAT,
+		INCR_INT, INCR_UINT, INCR_FLOAT,
+		DECR_INT, DECR_UINT, DECR_FLOAT,
+		EQ_INT, EQ_UINT, EQ_FLOAT, EQ_BOOL,
+		UNEQ_INT, UNEQ_UINT, UNEQ_FLOAT, UNEQ_BOOL,
+		LESS_INT, LESS_UINT, LESS_FLOAT,
+		BIGGER_INT, BIGGER_UINT, BIGGER_FLOAT,
+
+		// Interpreter, superinstructions
+		ADD_LOCAL_LITERAL_INT, SUB_LOCAL_LITERAL_INT, MULT_LOCAL_LITERAL_INT,
+		EQ_LOCAL_LITERAL_INT, UNEQ_LOCAL_LITERAL_INT, LESS_LOCAL_LITERAL_INT, BIGGER_LOCAL_LITERAL_INT,
+		EQ_LOCAL_LOCAL_INT, UNEQ_LOCAL_LOCAL_INT, LESS_LOCAL_LOCAL_INT, BIGGER_LOCAL_LOCAL_INT,
+		ADD_INT_STORE_LOCAL, SUB_INT_STORE_LOCAL, MULT_INT_STORE_LOCAL,
+		INCR_LOCAL_INT, DECR_LOCAL_INT,
 		END_ENUM_OPCODE
 	};
 
@@ -62,6 +82,10 @@ namespace base {
 			SM_REGISTER_NAME(OpCode::NAME, "<name>");
 			SM_REGISTER_NAME(OpCode::FUNC, "func");
 			SM_REGISTER_NAME(OpCode::RETURN, "return");
+			SM_REGISTER_NAME(OpCode::SPAWN, "spawn");
+			SM_REGISTER_NAME(OpCode::YIELD, "yield");
+			SM_REGISTER_NAME(OpCode::PFOR, "pfor");
+			SM_REGISTER_NAME(OpCode::REDUCE, "reduce");
 			SM_REGISTER_NAME(OpCode::BEGIN_SCOPE, "<begin_scope>");
 			SM_REGISTER_NAME(OpCode::END_SCOPE, "<end_scope>");
 
@@ -81,6 +105,7 @@ namespace base {
 
 			// Interpreter
 			SM_REGISTER_NAME(OpCode::CALL_FUNCTION, "<call_function>");
+			SM_REGISTER_NAME(OpCode::TAIL_CALL, "<tail_call>");
 			SM_REGISTER_NAME(OpCode::END_FUNCTION, "<end_function>");
 			SM_REGISTER_NAME(OpCode::END_PROGRAM, "<end_program>");
 			SM_REGISTER_NAME(OpCode::LOAD_LOCAL, "<load_local>");
@@ -91,6 +116,58 @@ namespace base {
 			SM_REGISTER_NAME(OpCode::JUMP_IF_NOT, "<jump_if_not>");
 			SM_REGISTER_NAME(OpCode::CREATE_VARIABLE, "<create_variable>");
 			SM_REGISTER_NAME(OpCode::POP, "<pop>");
+
+			// Interpreter, typed
+			SM_REGISTER_NAME(OpCode::ADD_INT, "<add_int>");
+			SM_REGISTER_NAME(OpCode::ADD_UINT, "<add_uint>");
+			SM_REGISTER_NAME(OpCode::ADD_FLOAT, "<add_float>");
+			SM_REGISTER_NAME(OpCode::SUB_INT, "<sub_int>");
+			SM_REGISTER_NAME(OpCode::SUB_UINT, "<sub_uint>");
+			SM_REGISTER_NAME(OpCode::SUB_FLOAT, "<sub_float>");
+			SM_REGISTER_NAME(OpCode::MULT_INT, "<mult_int>");
+			SM_REGISTER_NAME(OpCode::MULT_UINT, "<mult_uint>");
+			SM_REGISTER_NAME(OpCode::MULT_FLOAT, "<mult_float>");
+			SM_REGISTER_NAME(OpCode::DIV_INT, "<div_int>");
+			SM_REGISTER_NAME(OpCode::DIV_UINT, "<div_uint>");
+			SM_REGISTER_NAME(OpCode::DIV_FLOAT, "<div_float>");
+			SM_REGISTER_NAME(OpCode::INCR_INT, "<incr_int>");
+			SM_REGISTER_NAME(OpCode::INCR_UINT, "<incr_uint>");
+			SM_REGISTER_NAME(OpCode::INCR_FLOAT, "<incr_float>");
+			SM_REGISTER_NAME(OpCode::DECR_INT, "<decr_int>");
+			SM_REGISTER_NAME(OpCode::DECR_UINT, "<decr_uint>");
+			SM_REGISTER_NAME(OpCode::DECR_FLOAT, "<decr_float>");
+			SM_REGISTER_NAME(OpCode::EQ_INT, "<eq_int>");
+			SM_REGISTER_NAME(OpCode::EQ_UINT, "<eq_uint>");
+			SM_REGISTER_NAME(OpCode::EQ_FLOAT, "<eq_float>");
+			SM_REGISTER_NAME(OpCode::EQ_BOOL, "<eq_bool>");
+			SM_REGISTER_NAME(OpCode::UNEQ_INT, "<uneq_int>");
+			SM_REGISTER_NAME(OpCode::UNEQ_UINT, "<uneq_uint>");
+			SM_REGISTER_NAME(OpCode::UNEQ_FLOAT, "<uneq_float>");
+			SM_REGISTER_NAME(OpCode::UNEQ_BOOL, "<uneq_bool>");
+			SM_REGISTER_NAME(OpCode::LESS_INT, "<less_int>");
+			SM_REGISTER_NAME(OpCode::LESS_UINT, "<less_uint>");
+			SM_REGISTER_NAME(OpCode::LESS_FLOAT, "<less_float>");
+			SM_REGISTER_NAME(OpCode::BIGGER_INT, "<bigger_int>");
+			SM_REGISTER_NAME(OpCode::BIGGER_UINT, "<bigger_uint>");
+			SM_REGISTER_NAME(OpCode::BIGGER_FLOAT, "<bigger_float>");
+
+			// Interpreter, superinstructions
+			SM_REGISTER_NAME(OpCode::ADD_LOCAL_LITERAL_INT, "<add_local_literal_int>");
+			SM_REGISTER_NAME(OpCode::SUB_LOCAL_LITERAL_INT, "<sub_local_literal_int>");
+			SM_REGISTER_NAME(OpCode::MULT_LOCAL_LITERAL_INT, "<mult_local_literal_int>");
+			SM_REGISTER_NAME(OpCode::EQ_LOCAL_LITERAL_INT, "<eq_local_literal_int>");
+			SM_REGISTER_NAME(OpCode::UNEQ_LOCAL_LITERAL_INT, "<uneq_local_literal_int>");
+			SM_REGISTER_NAME(OpCode::LESS_LOCAL_LITERAL_INT, "<less_local_literal_int>");
+			SM_REGISTER_NAME(OpCode::BIGGER_LOCAL_LITERAL_INT, "<bigger_local_literal_int>");
+			SM_REGISTER_NAME(OpCode::EQ_LOCAL_LOCAL_INT, "<eq_local_local_int>");
+			SM_REGISTER_NAME(OpCode::UNEQ_LOCAL_LOCAL_INT, "<uneq_local_local_int>");
+			SM_REGISTER_NAME(OpCode::LESS_LOCAL_LOCAL_INT, "<less_local_local_int>");
+			SM_REGISTER_NAME(OpCode::BIGGER_LOCAL_LOCAL_INT, "<bigger_local_local_int>");
+			SM_REGISTER_NAME(OpCode::ADD_INT_STORE_LOCAL, "<add_int_store_local>");
+			SM_REGISTER_NAME(OpCode::SUB_INT_STORE_LOCAL, "<sub_int_store_local>");
+			SM_REGISTER_NAME(OpCode::MULT_INT_STORE_LOCAL, "<mult_int_store_local>");
+			SM_REGISTER_NAME(OpCode::INCR_LOCAL_INT, "<incr_local_int>");
+			SM_REGISTER_NAME(OpCode::DECR_LOCAL_INT, "<decr_local_int>");
 			SM_REGISTER_NAME(OpCode::END_ENUM_OPCODE, "<end_enum_scope>");
 		}
 		throw std::runtime_error("missing opCode name" + std::to_string(static_cast<int>(opCode)));
@@ -116,6 +193,10 @@ namespace base {
 		if (keyword == "break") return OpCode::BREAK;
 		if (keyword == "func") return OpCode::FUNC;
 		if (keyword == "return") return OpCode::RETURN;
+		if (keyword == "spawn") return OpCode::SPAWN;
+		if (keyword == "yield") return OpCode::YIELD;
+		if (keyword == "pfor") return OpCode::PFOR;
+		if (keyword == "reduce") return OpCode::REDUCE;
 		return OpCode::ERR;
 	}
 
@@ -193,6 +274,30 @@ namespace base {
 		throw ex::Exception("Unknown opCode " + std::to_string(static_cast<size_t>(opCode)));
 	}
 
+	// Returns the specialized version of a generic operation or ERR if there is none for the type
+	inline OpCode typedOpCode(OpCode opCode, TypeIndex type) {
+		const auto offset = [=](OpCode first, TypeIndex last) {
+			if ((type < TypeIndex::Int) or (type > last)) {
+				return OpCode::ERR;
+			}
+			return static_cast<OpCode>(static_cast<int>(first) + static_cast<int>(type));
+		};
+
+		switch (opCode) {
+			case OpCode::ADD: return offset(OpCode::ADD_INT, TypeIndex::Float);
+			case OpCode::SUB: return offset(OpCode::SUB_INT, TypeIndex::Float);
+			case OpCode::MULT: return offset(OpCode::MULT_INT, TypeIndex::Float);
+			case OpCode::DIV: return offset(OpCode::DIV_INT, TypeIndex::Float);
+			case OpCode::INCR: return offset(OpCode::INCR_INT, TypeIndex::Float);
+			case OpCode::DECR: return offset(OpCode::DECR_INT, TypeIndex::Float);
+			case OpCode::EQ: return offset(OpCode::EQ_INT, TypeIndex::Bool);
+			case OpCode::UNEQ: return offset(OpCode::UNEQ_INT, TypeIndex::Bool);
+			case OpCode::LESS: return offset(OpCode::LESS_INT, TypeIndex::Float);
+			case OpCode::BIGGER: return offset(OpCode::BIGGER_INT, TypeIndex::Float);
+			default: return OpCode::ERR;
+		}
+	}
+
 	inline std::pair<OpCode, OpCode> getBracketGroup(OpCode openBracket) {
 		switch (openBracket) {
 			case OpCode::BRACKET_ROUND_OPEN:
@@ -1,16 +1,64 @@
 #pragma once
 
+#include <algorithm>
+#include <memory>
+#include <optional>
+#include <string>
 #include <vector>
 
 #include "LiteralStore.h"
 
 namespace base {
+	struct FunctionSignature {
+		std::string name;
+		size_t entry; // index of the first operation of the body
+		std::vector<TypeIndex> params;
+		std::optional<TypeIndex> returnType;
+		std::vector<uint32_t> reductions; // globals the chunks of a pfor add up, only for the chunk function of a pfor
+	};
+
+	// The operations from firstOperation up to the next entry were compiled from the statement at line:column
+	struct SourceLine {
+		uint32_t firstOperation;
+		uint32_t line; // 1 based, 0 for generated code like the call of main
+		uint32_t column; // 1 based
+	};
+
 	struct Program {
 		Bytecode bytecode;
 		base::LiteralStore literals;
+		std::vector<TypeIndex> globalTypes; // for machines that don't store the type next to the value
+		std::vector<FunctionSignature> functions;
+		size_t mainCall = 0; // first operation of the call of main, the code before it declares the globals
+		std::vector<SourceLine> lines; // sorted by firstOperation, one entry per statement, empty for bytecode without source
+
+		// Functions with an overloaded name are told apart by their parameters
+		const FunctionSignature* function(const std::string& name, const std::vector<TypeIndex>& params) const {
+			const auto pos = std::find_if(functions.begin(), functions.end(), [&](const FunctionSignature& f) { return (f.name == name) and (f.params == params); });
+			return (pos != functions.end()) ? &*pos : nullptr;
+		}
+
+		const FunctionSignature* function(size_t entry) const {
+			const auto pos = std::find_if(functions.begin(), functions.end(), [&](const FunctionSignature& f) { return f.entry == entry; });
+			return (pos != functions.end()) ? &*pos : nullptr;
+		}
+
+		// The statement an operation was compiled from, nullptr for bytecode without source
+		const SourceLine* sourceLine(size_t index) const {
+			const auto next = std::upper_bound(lines.begin(), lines.end(), index, [](size_t i, const SourceLine& line) { return i < line.firstOperation; });
+			return (next != lines.begin()) ? &*(next - 1) : nullptr;
+		}
 
 		void spliceBytecode(std::vector<Operation> toSplice) {
 			bytecode.insert(bytecode.end(), toSplice.begin(), toSplice.end());
 		}
 	};
+
+	/* A program that can't change anymore. Machines only read from it, so any number of them
+	*  can share one image and execute it at the same time, each on its own stack. */
+	using SharedProgram = std::shared_ptr<const Program>;
+
+	inline SharedProgram freeze(Program program) {
+		return std::make_shared<const Program>(std::move(program));
+	}
 }
\ No newline at end of file
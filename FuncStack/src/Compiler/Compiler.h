@@ -1,8 +1,11 @@
 #pragma once
 
 #include <algorithm>
+#include <chrono>
+#include <limits>
 #include <sstream>
 #include <stack>
+#include <utility>
 #include <list>
 #include <vector>
 
@@ -10,6 +13,8 @@
 #include "Token.h"
 #include "Function.h"
 #include "Tokenizer.h"
+#include "Inliner.h"
+#include "PhaseTimes.h"
 
 #include "src/Utils/Source.h"
 #include "src/Base/Program.h"
@@ -37,6 +42,39 @@ namespace compiler {
 		base::Bytecode& bytecode = program.bytecode;
 
 		bool success = true;
+		const size_t inlineThreshold;
+
+		size_t loopDepth = 0; // loops around the statement that gets compiled
+		std::optional<size_t> parallelLoop; // loopDepth of the loop of the pfor that gets compiled, see parse_pfor
+		std::optional<size_t> statementPosition; // source position of the innermost statement that gets compiled
+		PhaseTimes* phaseTimes = nullptr; // only during run(PhaseTimes&)
+
+		// The first character of the statement that starts with the token
+		size_t statementBegin(const Token& token) const {
+			const std::string& code = source.str();
+			size_t begin = token.pos; // a token ends at its pos
+			while ((begin > 0) and partOfVariableName(code[begin - 1])) {
+				begin--;
+			}
+			return (begin == token.pos) ? token.pos - 1 : begin; // a single character like '{'
+		}
+
+		// The operations from here on belong to the statement at pos, none for generated code
+		void markSourceLine(std::optional<size_t> pos) {
+			base::SourceLine line{ static_cast<uint32_t>(bytecode.size()), 0, 0 };
+			if (pos.has_value()) {
+				const auto [lineNumber, column] = source.lineAndColumn(pos.value());
+				line.line = static_cast<uint32_t>(lineNumber);
+				line.column = static_cast<uint32_t>(column);
+			}
+			std::vector<base::SourceLine>& lines = program.lines;
+			if (!lines.empty() and (lines.back().firstOperation == line.firstOperation)) {
+				lines.pop_back(); // the statement before didn't emit anything
+			}
+			if (lines.empty() or (lines.back().line != line.line) or (lines.back().column != line.column)) {
+				lines.push_back(line);
+			}
+		}
 
 		size_t index() const {
 			return bytecode.size() - 1;
@@ -51,14 +89,14 @@ namespace compiler {
 
 		void rewireJump(size_t from, size_t to) {
 			base::Operation& jump = bytecode[from];
-			assume(anyOf(jump.getOpCode(), base::OpCode::JUMP, base::OpCode::JUMP_IF_NOT, base::OpCode::CALL_FUNCTION), "expected to rewire jump", currentToken);
+			assume(anyOf(jump.getOpCode(), base::OpCode::JUMP, base::OpCode::JUMP_IF_NOT, base::OpCode::CALL_FUNCTION, base::OpCode::TAIL_CALL), "expected to rewire jump", currentToken);
 			int32_t jumpDistance = to - from;
 			if (jumpDistance < 0) jumpDistance--;
 			jump.signedData() = jumpDistance;
 		}
 
 		void insertJump(base::OpCode jump, size_t from, size_t to) {
-			assume(anyOf(jump, base::OpCode::JUMP, base::OpCode::JUMP_IF_NOT, base::OpCode::CALL_FUNCTION), "expected to rewire jump", currentToken);
+			assume(anyOf(jump, base::OpCode::JUMP, base::OpCode::JUMP_IF_NOT, base::OpCode::CALL_FUNCTION, base::OpCode::PFOR), "expected to rewire jump", currentToken);
 			int32_t jumpDistance = to - from;
 			if (jumpDistance < 0) jumpDistance--;
 			bytecode.push_back(base::Operation(jump, jumpDistance));
@@ -70,9 +108,14 @@ namespace compiler {
 			}
 		}
 
-		void synchronize(const ex::ParserException& ex) {
+		// An error found after the statement got parsed completely, there is nothing to skip
+		void report(const ex::ParserException& ex) {
 			std::cout << ex.what() << "\n" << source.markedLineAt(ex.getPos()) << std::endl;
 			success = false;
+		}
+
+		void synchronize(const ex::ParserException& ex) {
+			report(ex);
 			tokenizer.synchronize();
 			currentToken = tokenizer.next();
 		}
@@ -95,7 +138,12 @@ namespace compiler {
 
 				if (currentToken.opCode == bracketBegin) counter++;
 				else if (currentToken.opCode == bracketEnd) counter--;
-				else tokens.push_back(currentToken);
+
+				// only the brackets of the group itself, inner ones belong to calls and sub expressions
+				const bool isGroupBracket = (counter == 0) or ((counter == 1) and (currentToken.opCode == bracketBegin));
+				if (!isGroupBracket) {
+					tokens.push_back(currentToken);
+				}
 				currentToken = tokenizer.next();
 			} while (counter > 0);
 			return tokens;
@@ -121,12 +169,17 @@ namespace compiler {
 		}
 
 		[[nodiscard]] TokenList shuntingYard(Iterator begin, Iterator end) {
+			const PhaseTimer timer((phaseTimes != nullptr) ? &phaseTimes->shuntingYard : nullptr);
 			Iterator current = begin;
 			std::stack<Token, std::vector<Token>> operatorStack;
 			TokenList sortedTokens;
 
 			for (; current != end; current++) {
 				if (current->opCode == base::OpCode::COMMA) {
+					// the previous argument is complete, its operators must not be applied to the next one
+					while (!operatorStack.empty() and !base::isOpeningBracket(operatorStack.top().opCode)) {
+						sortedTokens.push_back(top_and_pop(operatorStack));
+					}
 					continue;
 				}
 
@@ -163,7 +216,7 @@ namespace compiler {
 
 					operatorStack.pop();
 
-					if (operatorStack.top().opCode == base::OpCode::NAME) {
+					if (!operatorStack.empty() and (operatorStack.top().opCode == base::OpCode::NAME)) {
 						sortedTokens.push_back(top_and_pop(operatorStack));
 					}
 
@@ -183,33 +236,156 @@ namespace compiler {
 			return sortedTokens;
 		}
 
+		// Picks the typed version of an operation if the type is proven, the generic one otherwise
+		base::OpCode specialize(base::OpCode opCode, base::TypeIndex type) const {
+			const base::OpCode typed = base::typedOpCode(opCode, type);
+			return (typed != base::OpCode::ERR) ? typed : opCode;
+		}
+
+		static base::OpCode localLiteralOpCode(base::OpCode opCode) {
+			switch (opCode) {
+				case base::OpCode::ADD_INT: return base::OpCode::ADD_LOCAL_LITERAL_INT;
+				case base::OpCode::SUB_INT: return base::OpCode::SUB_LOCAL_LITERAL_INT;
+				case base::OpCode::MULT_INT: return base::OpCode::MULT_LOCAL_LITERAL_INT;
+				case base::OpCode::EQ_INT: return base::OpCode::EQ_LOCAL_LITERAL_INT;
+				case base::OpCode::UNEQ_INT: return base::OpCode::UNEQ_LOCAL_LITERAL_INT;
+				case base::OpCode::LESS_INT: return base::OpCode::LESS_LOCAL_LITERAL_INT;
+				case base::OpCode::BIGGER_INT: return base::OpCode::BIGGER_LOCAL_LITERAL_INT;
+				default: return base::OpCode::ERR;
+			}
+		}
+
+		static base::OpCode localLocalOpCode(base::OpCode opCode) {
+			switch (opCode) {
+				case base::OpCode::EQ_INT: return base::OpCode::EQ_LOCAL_LOCAL_INT;
+				case base::OpCode::UNEQ_INT: return base::OpCode::UNEQ_LOCAL_LOCAL_INT;
+				case base::OpCode::LESS_INT: return base::OpCode::LESS_LOCAL_LOCAL_INT;
+				case base::OpCode::BIGGER_INT: return base::OpCode::BIGGER_LOCAL_LOCAL_INT;
+				default: return base::OpCode::ERR;
+			}
+		}
+
+		static base::OpCode storeLocalOpCode(base::OpCode opCode) {
+			switch (opCode) {
+				case base::OpCode::ADD_INT: return base::OpCode::ADD_INT_STORE_LOCAL;
+				case base::OpCode::SUB_INT: return base::OpCode::SUB_INT_STORE_LOCAL;
+				case base::OpCode::MULT_INT: return base::OpCode::MULT_INT_STORE_LOCAL;
+				default: return base::OpCode::ERR;
+			}
+		}
+
+		/* Replaces the last emitted operations with a superinstruction if possible.
+		*  Only operations after expressionBegin are touched, there is no jump target inside an expression. */
+		void fuseSuperinstructions(size_t expressionBegin) {
+			const size_t count = bytecode.size() - expressionBegin;
+			const auto fromBack = [&](size_t i) -> base::Operation& {
+				return bytecode[bytecode.size() - 1 - i];
+			};
+			const auto replaceTail = [&](size_t length, base::Operation fused) {
+				bytecode.resize(bytecode.size() - length);
+				bytecode.push_back(fused);
+			};
+
+			if (count >= 3) {
+				const base::Operation first = fromBack(2);
+				const base::Operation second = fromBack(1);
+				const base::Operation third = fromBack(0);
+				const bool firstIsSmallLocal = (first.getOpCode() == base::OpCode::LOAD_LOCAL) and (first.unsignedData() <= std::numeric_limits<uint16_t>::max());
+
+				// LOAD_LOCAL a, LOAD_LITERAL b, ADD_INT -> ADD_LOCAL_LITERAL_INT a b
+				const base::OpCode localLiteral = localLiteralOpCode(third.getOpCode());
+				if (firstIsSmallLocal and (second.getOpCode() == base::OpCode::LOAD_LITERAL) and (localLiteral != base::OpCode::ERR)) {
+					base::Operation fused(localLiteral, second.unsignedData());
+					fused.side_unsignedData() = first.unsignedData();
+					replaceTail(3, fused);
+					return;
+				}
+
+				// LOAD_LOCAL a, LOAD_LOCAL b, LESS_INT -> LESS_LOCAL_LOCAL_INT a b
+				const base::OpCode localLocal = localLocalOpCode(third.getOpCode());
+				if (firstIsSmallLocal and (second.getOpCode() == base::OpCode::LOAD_LOCAL) and (localLocal != base::OpCode::ERR)) {
+					base::Operation fused(localLocal, second.unsignedData());
+					fused.side_unsignedData() = first.unsignedData();
+					replaceTail(3, fused);
+					return;
+				}
+
+				// LOAD_LOCAL a, INCR_INT, STORE_LOCAL a -> INCR_LOCAL_INT a
+				if ((first.getOpCode() == base::OpCode::LOAD_LOCAL) and (third.getOpCode() == base::OpCode::STORE_LOCAL) and (first.unsignedData() == third.unsignedData())) {
+					if (second.getOpCode() == base::OpCode::INCR_INT) {
+						replaceTail(3, base::Operation(base::OpCode::INCR_LOCAL_INT, first.unsignedData()));
+						return;
+					}
+					if (second.getOpCode() == base::OpCode::DECR_INT) {
+						replaceTail(3, base::Operation(base::OpCode::DECR_LOCAL_INT, first.unsignedData()));
+						return;
+					}
+				}
+			}
+
+			if (count >= 2) {
+				// ADD_INT, STORE_LOCAL a -> ADD_INT_STORE_LOCAL a
+				const base::OpCode storeLocal = storeLocalOpCode(fromBack(1).getOpCode());
+				if ((fromBack(0).getOpCode() == base::OpCode::STORE_LOCAL) and (storeLocal != base::OpCode::ERR)) {
+					replaceTail(2, base::Operation(storeLocal, fromBack(0).unsignedData()));
+					return;
+				}
+			}
+		}
+
 		void insertSortedTokens(const TokenList& sortedTokens) {
+			const size_t expressionBegin = bytecode.size();
+			std::stack<base::TypeIndex, std::vector<base::TypeIndex>> types; // TypeIndex::Err if unknown
+			const auto popType = [&]() {
+				return types.empty() ? base::TypeIndex::Err : top_and_pop(types);
+			};
+
 			for (auto it = sortedTokens.begin(); it != sortedTokens.end(); it++) {
 				const base::OpCode opCode = it->opCode;
 				switch (opCode) {
 					case base::OpCode::INCR: // ->
 					case base::OpCode::DECR:
 					{
-						bytecode.push_back(base::Operation(opCode));
+						const base::TypeIndex type = popType();
+						bytecode.push_back(base::Operation(specialize(opCode, type)));
+						types.push(type);
 
 						const auto prev = it - 1;
 						if (prev->opCode == base::OpCode::NAME) {
 							bytecode.push_back(scope.createStoreOperation(*prev));
+							fuseSuperinstructions(expressionBegin);
 						}
 					}
 					break;
 					case base::OpCode::ADD: // ->
 					case base::OpCode::SUB: // ->
 					case base::OpCode::MULT: // ->
-					case base::OpCode::DIV: // ->
+					case base::OpCode::DIV:
+					{
+						const base::TypeIndex type1 = popType();
+						const base::TypeIndex type2 = popType();
+						const base::TypeIndex type = (type1 == type2) ? type1 : base::TypeIndex::Err;
+						bytecode.push_back(base::Operation(specialize(opCode, type)));
+						fuseSuperinstructions(expressionBegin);
+						types.push(type);
+					}
+					break;
 					case base::OpCode::EQ: // ->
 					case base::OpCode::UNEQ: // ->
 					case base::OpCode::BIGGER: // ->
 					case base::OpCode::LESS:
-						bytecode.push_back(base::Operation(opCode));
-						break;
+					{
+						const base::TypeIndex type1 = popType();
+						const base::TypeIndex type2 = popType();
+						const base::TypeIndex type = (type1 == type2) ? type1 : base::TypeIndex::Err;
+						bytecode.push_back(base::Operation(specialize(opCode, type)));
+						fuseSuperinstructions(expressionBegin);
+						types.push(base::TypeIndex::Bool);
+					}
+					break;
 					case base::OpCode::LOAD_LITERAL:
 						bytecode.push_back(base::Operation(base::OpCode::LOAD_LITERAL, it->getNumber()));
+						types.push(tokenizer.literals.get(it->getNumber()).typeId());
 						break;
 					case base::OpCode::NAME:
 					{
@@ -217,8 +393,14 @@ namespace compiler {
 						if (functions.has(name)) {
 							insertJump(base::OpCode::CALL_FUNCTION, index(), functions.offset(name).value());
 							bytecode.back().side_unsignedData() = functions.paramCount(name);
+
+							for (size_t i = 0; i < functions.paramCount(name); i++) {
+								popType();
+							}
+							types.push(functions.returnType(name).value_or(base::TypeIndex::Err));
 						} else {
 							bytecode.push_back(scope.createLoadOperation(*it));
+							types.push(static_cast<base::TypeIndex>(scope.typeOf(*it)));
 						}
 					}
 					break;
@@ -342,23 +524,31 @@ namespace compiler {
 			const size_t jumpIndex = index();
 
 			scope.pushLoop();
+			loopDepth++;
 			compileStatement();
 
+			const size_t iterationIndex = index();
 			if (iteration.has_value()) {
 				insertSortedTokens(shuntingYard(iteration->first, iteration->second)); // <- iteration
 			}
+			loopDepth--;
 			const std::vector<ScopeDict::Breaker> breakers = scope.popLoop();
 
 			insertJump(base::OpCode::JUMP, index(), headIndex);
 			const size_t indexAfterLoop = index();
 			rewireJump(jumpIndex, indexAfterLoop);
 
+			const size_t loopVariables = scope.sizeLocalVariables(); // the variables of the head live until the POP of popScope()
 			popScope();
 
 			for (const ScopeDict::Breaker& breaker : breakers) {
 				switch (breaker.token.opCode) {
 					case base::OpCode::CONTINUE:
-						rewireJump(breaker.index, headIndex + 1); /* "pc++" */
+						if (iteration.has_value()) {
+							rewireJump(breaker.index, iterationIndex); // forward, lands behind iterationIndex
+						} else {
+							rewireJump(breaker.index, headIndex + 1); /* "pc++" */
+						}
 						break;
 					case base::OpCode::BREAK:
 						rewireJump(breaker.index, indexAfterLoop);
@@ -371,7 +561,7 @@ namespace compiler {
 				assert(endScopeOp.getOpCode() == base::OpCode::POP);
 				const int32_t levelsToBreak = breaker.level - scope.level();
 				assume(levelsToBreak > 0, "Too many levels to break", currentToken);
-				endScopeOp.signedData() = breaker.variables - scope.sizeLocalVariables();
+				endScopeOp.signedData() = breaker.variables - loopVariables;
 			}
 		}
 
@@ -410,6 +600,219 @@ namespace compiler {
 			insertLoop(std::make_pair(beginInitialization, endInitialization), std::make_pair(beginCondition, endCondition), std::make_pair(beginIteration, endIteration));
 		}
 
+		/* 'pfor (int i = a; i < b; i++) reduce (x, y) { ... }': the body becomes a chunk function that runs the
+		*  iterations from its first to its second parameter, a PFOR calls it with a and b. A machine with
+		*  StackMachine::enableParallelFor() splits the range and runs the chunks on other threads, every other
+		*  one just calls it. The chunk doesn't see the locals around the pfor, see findDependency() for the rest. */
+		void parse_pfor() {
+			assert(currentToken.opCode == base::OpCode::PFOR);
+			const Token pfor = currentToken;
+			const std::optional<size_t> outerParallelLoop = parallelLoop;
+			if (outerParallelLoop.has_value()) {
+				report(ex::ParserException("No pfor inside of a pfor", pfor.pos)); // parsed anyway to find the end of the statement
+			}
+
+			currentToken = tokenizer.next("Missing round brackets after 'pfor'", base::OpCode::BRACKET_ROUND_OPEN);
+			const std::vector<Token> loopHead = unwindGroup();
+			const std::string form = "pfor needs the form (int i = begin; i < end; i++)";
+
+			const Iterator endInitialization = std::find_if(loopHead.begin(), loopHead.end(), isOpCode<base::OpCode::END_STATEMENT>);
+			assume(std::distance(loopHead.begin(), endInitialization) > 3, form, pfor);
+			const Token& type = loopHead[0];
+			const Token& variable = loopHead[1];
+			assume((type.opCode == base::OpCode::TYPE) and (type.getNumber() == static_cast<size_t>(base::TypeIndex::Int)), form, type);
+			assume((variable.opCode == base::OpCode::NAME) and (loopHead[2].opCode == base::OpCode::ASSIGN), form, variable);
+			assume(!scope.hasVariable(variable.getString()), "Variable already defined", variable);
+
+			const Iterator beginEnd = endInitialization + 3;
+			const Iterator endEnd = std::find_if(endInitialization + 1, loopHead.end(), isOpCode<base::OpCode::END_STATEMENT>);
+			assume((endEnd != loopHead.end()) and (std::distance(endInitialization, endEnd) > 3), form, pfor);
+			const bool isCondition = (endInitialization[1].opCode == base::OpCode::NAME) and (endInitialization[1].getString() == variable.getString())
+				and (endInitialization[2].opCode == base::OpCode::LESS);
+			const bool isIteration = (std::distance(endEnd, loopHead.end()) == 3) and (endEnd[1].opCode == base::OpCode::NAME)
+				and (endEnd[1].getString() == variable.getString()) and (endEnd[2].opCode == base::OpCode::INCR);
+			assume(isCondition and isIteration, form, pfor);
+
+			for (const auto& [begin, end] : { std::make_pair(loopHead.begin() + 3, endInitialization), std::make_pair(beginEnd, endEnd) }) {
+				const std::vector<size_t> types = expectedType(shuntingYard(begin, end));
+				assume((types.size() == 1) and (types.front() == static_cast<size_t>(base::TypeIndex::Int)), "The range of a pfor needs int as type", *begin);
+			}
+
+			std::vector<uint32_t> reductions;
+			if (currentToken.opCode == base::OpCode::REDUCE) {
+				currentToken = tokenizer.next("Missing round brackets after 'reduce'", base::OpCode::BRACKET_ROUND_OPEN);
+				const std::vector<Token> names = unwindGroup();
+				for (size_t i = 0; i < names.size(); i++) {
+					const Token& name = names[i];
+					if (i % 2 == 1) {
+						assume((name.opCode == base::OpCode::COMMA) and (i + 1 < names.size()), "Expected a list of globals after reduce", name);
+						continue;
+					}
+					assume(name.opCode == base::OpCode::NAME, "Expected a list of globals after reduce", name);
+					const base::Operation load = scope.createLoadOperation(name);
+					assume(load.getOpCode() == base::OpCode::LOAD_GLOBAL, "Only globals can be reduced", name);
+					const base::TypeIndex reducedType = static_cast<base::TypeIndex>(scope.typeOf(name));
+					assume(anyOf(reducedType, base::TypeIndex::Int, base::TypeIndex::Uint, base::TypeIndex::Float), "Only numbers can be reduced", name);
+					assume(std::find(reductions.begin(), reductions.end(), load.unsignedData()) == reductions.end(), "Reduction listed twice", name);
+					reductions.push_back(load.unsignedData());
+				}
+			}
+
+			bytecode.push_back(base::Operation(base::OpCode::JUMP, 0));
+			const size_t jumpIndex = index();
+			const size_t entry = index() + 1;
+			program.functions.push_back(base::FunctionSignature{ "<pfor>", entry, { base::TypeIndex::Int, base::TypeIndex::Int }, {}, reductions });
+
+			// the chunk function: for (int i = <from>; i < <to>; i++) { ... }
+			const std::vector<Token> chunkLoop = {
+				type, variable, loopHead[2], Token(base::OpCode::NAME, "<from>", pfor.pos),
+				variable, endInitialization[2], Token(base::OpCode::NAME, "<to>", pfor.pos),
+				variable, endEnd[2]
+			};
+			VariableContainer outerVariables = scope.hideLocalVariables();
+			scope.pushScope();
+			scope.pushVariable("<from>", static_cast<size_t>(base::TypeIndex::Int));
+			scope.pushVariable("<to>", static_cast<size_t>(base::TypeIndex::Int));
+			parallelLoop = loopDepth + 1;
+			insertLoop(std::make_pair(chunkLoop.begin(), chunkLoop.begin() + 4), std::make_pair(chunkLoop.begin() + 4, chunkLoop.begin() + 7), std::make_pair(chunkLoop.begin() + 7, chunkLoop.end()));
+			parallelLoop = outerParallelLoop;
+			popScope();
+			scope.restoreLocalVariables(std::move(outerVariables));
+			bytecode.push_back(base::Operation(base::OpCode::END_FUNCTION));
+			rewireJump(jumpIndex, index());
+
+			// the whole statement is parsed already, an error doesn't skip anything
+			const std::optional<std::string> dependency = findDependency(entry, reductions);
+			if (dependency.has_value()) {
+				report(ex::ParserException(dependency.value(), pfor.pos));
+			}
+
+			insertSortedTokens(shuntingYard(loopHead.begin() + 3, endInitialization));
+			insertSortedTokens(shuntingYard(beginEnd, endEnd));
+			insertJump(base::OpCode::PFOR, index(), jumpIndex); // like a call, relative to the operation in front of the entry
+			bytecode.back().side_unsignedData() = 2;
+		}
+
+		/* The iterations of a pfor run in any order and on several threads at once. Its chunk function, from entry
+		*  to the last operation, may only write its reductions, each as 'x = x + ...' or 'x++' without reading x
+		*  anywhere else. The functions it calls may neither write globals nor read the reductions. */
+		std::optional<std::string> findDependency(size_t entry, const std::vector<uint32_t>& reductions) const {
+			const auto isReduction = [&](uint32_t global) {
+				return std::find(reductions.begin(), reductions.end(), global) != reductions.end();
+			};
+
+			std::vector<size_t> updateLoads; // the LOAD_GLOBAL x of every 'x = x + ...'
+			std::vector<size_t> open; // called functions
+			for (size_t i = entry; i <= index(); i++) {
+				const base::Operation& op = bytecode[i];
+				if (base::entersFunction(op.getOpCode())) {
+					open.push_back(base::jumpTarget(bytecode, i));
+				}
+				if (op.getOpCode() != base::OpCode::STORE_GLOBAL) {
+					continue;
+				}
+				if (!isReduction(op.unsignedData())) {
+					return "A pfor can't write globals that aren't reduced";
+				}
+				const std::optional<size_t> load = reductionUpdate(entry, i);
+				if (!load.has_value()) {
+					return "A reduction can only be updated as x = x + ...";
+				}
+				updateLoads.push_back(load.value());
+			}
+			for (size_t i = entry; i <= index(); i++) {
+				const bool readsReduction = (bytecode[i].getOpCode() == base::OpCode::LOAD_GLOBAL) and isReduction(bytecode[i].unsignedData());
+				if (readsReduction and (std::find(updateLoads.begin(), updateLoads.end(), i) == updateLoads.end())) {
+					return "A reduction can't be read inside of its pfor";
+				}
+			}
+
+			std::vector<bool> visited(bytecode.size());
+			while (!open.empty()) {
+				const size_t i = open.back();
+				open.pop_back();
+				if (i > index()) {
+					return "A pfor can't call the function it is in";
+				}
+				if (visited[i]) {
+					continue;
+				}
+				visited[i] = true;
+
+				const base::Operation& op = bytecode[i];
+				if (op.getOpCode() == base::OpCode::STORE_GLOBAL) {
+					return "Functions called in a pfor can't write globals";
+				}
+				if ((op.getOpCode() == base::OpCode::LOAD_GLOBAL) and isReduction(op.unsignedData())) {
+					return "Functions called in a pfor can't read its reductions";
+				}
+				switch (op.getOpCode()) {
+					case base::OpCode::JUMP:
+					case base::OpCode::TAIL_CALL:
+						open.push_back(base::jumpTarget(bytecode, i));
+						break;
+					case base::OpCode::JUMP_IF_NOT:
+					case base::OpCode::CALL_FUNCTION:
+					case base::OpCode::SPAWN:
+					case base::OpCode::PFOR:
+						open.push_back(base::jumpTarget(bytecode, i));
+						open.push_back(i + 1);
+						break;
+					case base::OpCode::RETURN:
+					case base::OpCode::END_FUNCTION:
+					case base::OpCode::END_PROGRAM:
+						break;
+					default:
+						open.push_back(i + 1);
+						break;
+				}
+			}
+			return {};
+		}
+
+		// The LOAD_GLOBAL x that starts 'x = x + a + b' or 'x++', both end with the STORE_GLOBAL x at store
+		std::optional<size_t> reductionUpdate(size_t begin, size_t store) const {
+			size_t last = store - 1;
+			while (last > begin) {
+				const base::OpCode opCode = bytecode[last].getOpCode();
+				if (anyOf(opCode, base::OpCode::ADD, base::OpCode::ADD_INT, base::OpCode::ADD_UINT, base::OpCode::ADD_FLOAT)) {
+					const std::optional<size_t> right = expressionBegin(begin, last - 1);
+					if (!right.has_value() or (right.value() == begin)) {
+						return {};
+					}
+					last = right.value() - 1; // the left operand ends in front of the right one
+				} else if (anyOf(opCode, base::OpCode::INCR, base::OpCode::INCR_INT, base::OpCode::INCR_UINT, base::OpCode::INCR_FLOAT)) {
+					last--;
+				} else {
+					break;
+				}
+			}
+
+			const base::Operation& load = bytecode[last];
+			if ((load.getOpCode() == base::OpCode::LOAD_GLOBAL) and (load.unsignedData() == bytecode[store].unsignedData())) {
+				return last;
+			}
+			return {};
+		}
+
+		// First operation of the expression whose value the operation at last leaves on the stack
+		std::optional<size_t> expressionBegin(size_t begin, size_t last) const {
+			int values = 0;
+			for (size_t i = last; i >= begin; i--) {
+				values += base::stackEffect(bytecode[i]);
+				if (bytecode[i].getOpCode() == base::OpCode::CALL_FUNCTION) {
+					values++; // a call inside of an expression returns a value
+				}
+				if (values == 1) {
+					return i;
+				}
+				if (i == begin) {
+					break;
+				}
+			}
+			return {};
+		}
+
 		Function::Variable extractParameter() {
 			assert(currentToken.opCode == base::OpCode::TYPE);
 			const Token paramType = currentToken;
@@ -462,6 +865,12 @@ namespace compiler {
 			bool isNewFunction = functions.push(functionName.getString(), returnType, parameters, index());
 			assume(isNewFunction, "Function already known", currentToken);
 
+			base::FunctionSignature signature{ functionName.getString(), index() + 1, {}, returnType, {} };
+			for (const Function::Variable& var : parameters) {
+				signature.params.push_back(var.type);
+			}
+			program.functions.push_back(std::move(signature));
+
 			scope.pushScope();
 			for (const Function::Variable& var : parameters) {
 				const bool unknownVariable = scope.pushVariable(var.name, static_cast<size_t>(var.type));
@@ -477,15 +886,60 @@ namespace compiler {
 
 		void parse_return() {
 			assert(currentToken.opCode == base::OpCode::RETURN);
+			assume(!parallelLoop.has_value(), "No return inside of a pfor", currentToken);
 			currentToken = tokenizer.next();
 			const uint32_t returnSize = currentToken.opCode == base::OpCode::END_STATEMENT ? 0 : 1; // returns more than one possibly in future
 
 			const std::vector<Token> returnExpression = unwindExpressionStatement();
 			embeddExpression(returnExpression.begin(), returnExpression.end());
 
+			if ((returnSize == 1) and (bytecode.back().getOpCode() == base::OpCode::CALL_FUNCTION)) {
+				// 'return f(...)': the called function reuses the frame and returns directly to our caller
+				base::Operation tailCall(base::OpCode::TAIL_CALL, bytecode.back().signedData());
+				tailCall.side_unsignedData() = bytecode.back().side_unsignedData();
+				bytecode.back() = tailCall;
+				return;
+			}
 			bytecode.push_back(base::Operation(base::OpCode::RETURN, returnSize));
 		}
 
+		// 'spawn f(...)': f runs in a fiber of its own, the caller continues right away
+		void parse_spawn() {
+			assert(currentToken.opCode == base::OpCode::SPAWN);
+			assume(!parallelLoop.has_value(), "No spawn inside of a pfor", currentToken);
+			currentToken = tokenizer.next();
+
+			// checked before the ';' so that synchronize() stops there
+			assume(currentToken.opCode == base::OpCode::NAME, "Expected function call after spawn", currentToken);
+			std::vector<Token> call = { currentToken };
+			currentToken = tokenizer.next();
+			assume(currentToken.opCode == base::OpCode::BRACKET_ROUND_OPEN, "Expected function call after spawn", currentToken);
+			const Token bracket = currentToken;
+			const std::vector<Token> arguments = unwindGroup();
+			assume(currentToken.opCode == base::OpCode::END_STATEMENT, "Expected ; after spawn", currentToken);
+			currentToken = tokenizer.next();
+
+			call.push_back(bracket);
+			call.insert(call.end(), arguments.begin(), arguments.end());
+			call.push_back(Token(base::OpCode::BRACKET_ROUND_CLOSE, bracket.pos));
+			embeddExpression(call.begin(), call.end());
+			assume(bytecode.back().getOpCode() == base::OpCode::CALL_FUNCTION, "Expected function call after spawn", bracket);
+
+			base::Operation spawnCall(base::OpCode::SPAWN, bytecode.back().signedData());
+			spawnCall.side_unsignedData() = bytecode.back().side_unsignedData();
+			bytecode.back() = spawnCall;
+		}
+
+		// 'yield': hands the machine to the next fiber, a no-op outside of a Scheduler
+		void parse_yield() {
+			assert(currentToken.opCode == base::OpCode::YIELD);
+			assume(!parallelLoop.has_value(), "No yield inside of a pfor", currentToken);
+			currentToken = tokenizer.next();
+			assume(currentToken.opCode == base::OpCode::END_STATEMENT, "Expected ; after yield", currentToken);
+			currentToken = tokenizer.next();
+			bytecode.push_back(base::Operation(base::OpCode::YIELD));
+		}
+
 		void registerBreaker() {
 			size_t levelsToJump = 1;
 			assert((currentToken.opCode == base::OpCode::CONTINUE) or (currentToken.opCode == base::OpCode::BREAK));
@@ -500,6 +954,14 @@ namespace compiler {
 				currentToken = tokenizer.next(base::OpCode::END_STATEMENT);
 			}
 
+			if (parallelLoop.has_value()) {
+				// the chunks of a pfor can only skip an iteration, the loop that is left is loopDepth + 1 - levelsToJump
+				const size_t lowestLoop = (breaker.opCode == base::OpCode::CONTINUE) ? parallelLoop.value() : parallelLoop.value() + 1;
+				if (loopDepth + 1 < lowestLoop + levelsToJump) {
+					report(ex::ParserException("Can't leave a pfor with " + opCodeName(breaker.opCode), breaker.pos));
+				}
+			}
+
 			bytecode.push_back(base::Operation(base::OpCode::POP, 0));
 			bytecode.push_back(base::Operation(base::OpCode::JUMP, 0));
 			scope.pushBreaker(index(), levelsToJump, breaker);
@@ -528,26 +990,35 @@ namespace compiler {
 			}
 
 			Iterator next = begin + 1;
-			if (next->opCode == base::OpCode::ASSIGN) {
+			if ((next != end) and (next->opCode == base::OpCode::ASSIGN)) {
 				const Token variableName = *begin;
 				begin++;
 				assume(begin->opCode == base::OpCode::ASSIGN, "Expected assignment after variable name", *begin);
 				begin++;
+				const size_t expressionBegin = bytecode.size();
 				insertSortedTokens(shuntingYard(begin, end));
 				bytecode.push_back(scope.createStoreOperation(variableName));
+				fuseSuperinstructions(expressionBegin);
 			} else {
 				insertSortedTokens(shuntingYard(begin, end));
 			}
 		}
 
 		void compileStatement() {
+			// code the enclosing statement emits after this one, like the jump back of a loop, belongs to the enclosing one
+			const std::optional<size_t> enclosing = std::exchange(statementPosition, statementBegin(currentToken));
+			markSourceLine(statementPosition);
 			try {
 				switch (currentToken.opCode) {
 					case base::OpCode::TYPE:
 					case base::OpCode::NAME:
 					{
 						const std::vector<Token> returnExpression = unwindExpressionStatement();
-						embeddExpression(returnExpression.begin(), returnExpression.end());
+						try {
+							embeddExpression(returnExpression.begin(), returnExpression.end());
+						} catch (const ex::ParserException& ex) {
+							report(ex); // the ';' is consumed already, synchronize() would skip the next statement
+						}
 						break;
 					}
 					case base::OpCode::IF:
@@ -559,12 +1030,21 @@ namespace compiler {
 					case base::OpCode::FOR:
 						parse_for();
 						break;
+					case base::OpCode::PFOR:
+						parse_pfor();
+						break;
 					case base::OpCode::FUNC:
 						parse_function();
 						break;
 					case base::OpCode::RETURN:
 						parse_return();
 						break;
+					case base::OpCode::SPAWN:
+						parse_spawn();
+						break;
+					case base::OpCode::YIELD:
+						parse_yield();
+						break;
 					case base::OpCode::CONTINUE: // fallthrough
 					case base::OpCode::BREAK:
 						registerBreaker();
@@ -584,6 +1064,8 @@ namespace compiler {
 			} catch (const ex::ParserException& ex) {
 				synchronize(ex);
 			}
+			statementPosition = enclosing;
+			markSourceLine(enclosing);
 		}
 
 	public:
@@ -591,8 +1073,9 @@ namespace compiler {
 			return success;
 		}
 
-		Compiler(Source source)
-			: source(std::move(source)), tokenizer(this->source.str()), currentToken(tokenizer.next()) {
+		// inlineThreshold: maximum size of a function that gets copied into its call sites, 0 disables inlining
+		Compiler(Source source, size_t inlineThreshold = Inliner::defaultThreshold)
+			: source(std::move(source)), tokenizer(this->source.str()), currentToken(tokenizer.next()), inlineThreshold(inlineThreshold) {
 		}
 
 		base::Program run() {
@@ -616,6 +1099,8 @@ namespace compiler {
 					const std::optional<size_t> mainPosition = functions.offset("main", {}, {});
 					assume(mainPosition.has_value(), "No main function in code", currentToken);
 
+					program.mainCall = bytecode.size();
+					markSourceLine(std::nullopt);
 					insertJump(base::OpCode::CALL_FUNCTION, index(), mainPosition.value());
 					bytecode.back().side_unsignedData() = 0;
 
@@ -626,7 +1111,31 @@ namespace compiler {
 			}
 
 			program.literals = std::move(tokenizer.literals);
+			program.globalTypes = scope.globalTypes();
+			while (!program.lines.empty() and (program.lines.back().firstOperation >= bytecode.size())) {
+				program.lines.pop_back();
+			}
+			if (success) {
+				const PhaseTimer timer((phaseTimes != nullptr) ? &phaseTimes->inlining : nullptr);
+				program = Inliner(inlineThreshold).run(std::move(program));
+			}
 			return std::move(program);
 		}
+
+		// The same, the time of every phase gets added to times. Codegen is what's left of the whole run
+		base::Program run(PhaseTimes& times) {
+			const PhaseTimes before = times;
+			phaseTimes = &times;
+			tokenizer.time = &times.tokenize;
+			const auto start = std::chrono::steady_clock::now();
+			base::Program result = run();
+			const auto end = std::chrono::steady_clock::now();
+			tokenizer.time = nullptr;
+			phaseTimes = nullptr;
+
+			const PhaseTimes spent{ times.tokenize - before.tokenize, times.shuntingYard - before.shuntingYard, {}, times.inlining - before.inlining };
+			times.codegen += std::chrono::duration_cast<std::chrono::nanoseconds>(end - start) - spent.total();
+			return result;
+		}
 	};
 } // namespace parser
\ No newline at end of file
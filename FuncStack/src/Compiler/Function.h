@@ -69,6 +69,14 @@ namespace compiler {
 			return {};
 		}
 
+		// Searched by name like offset(name), calls don't know the parameter types yet and a script has few functions. Callers check has(name) first
+		std::optional<base::TypeIndex> returnType(const std::string& functionName) const {
+			const auto pos = std::find_if(functions.begin(), functions.end(), [&](const Function& f) {
+				return f.name == functionName;
+			});
+			return pos->returnType;
+		}
+
 		bool has(const std::string& functionName) const { // TODO TEMPORARY !!!
 			return std::find_if(functions.begin(), functions.end(), [&](const Function& f) {
 				return f.name == functionName;
@@ -0,0 +1,348 @@
+#pragma once
+
+#include <limits>
+#include <map>
+#include <set>
+#include <vector>
+
+#include "src/Base/Program.h"
+#include "src/Base/BytecodeAnalysis.h"
+#include "src/Utils/Utils.h"
+
+namespace compiler {
+	/* Copies the bodies of small functions into their call sites. The arguments of a call already lie where the
+	*  parameters of the function would be, so the copied body only has to shift its local slots by the stack
+	*  depth of the caller. RETURN leaves the value in the first slot of the inlined frame and pops the rest.
+	*  Arguments that are plain loads are forwarded into the body instead (see canForwardArguments).
+	*  Recursive functions and functions that contain a TAIL_CALL are never inlined. */
+	class Inliner {
+	public:
+		static constexpr size_t defaultThreshold = 12; // operations of a function body, 0 disables inlining
+
+		explicit Inliner(size_t threshold = defaultThreshold)
+			: threshold(threshold) {
+		}
+
+		base::Program run(base::Program program) const {
+			// the copied bodies still contain the calls of the original ones, the next round inlines them
+			for (size_t round = 0; (round < maxRounds) and (threshold > 0); round++) {
+				if (!inlineCalls(program)) {
+					break;
+				}
+			}
+			return program;
+		}
+
+	private:
+		static constexpr size_t maxRounds = 8; // bounds the code growth of deep call chains
+
+		const size_t threshold;
+
+		// Returns if any call got inlined
+		bool inlineCalls(base::Program& program) const {
+			base::Bytecode& bytecode = program.bytecode;
+			// functions only called from outside of the program (e.g. by StackMachine::call()) get their calls inlined too
+			std::map<size_t, uint32_t> entries;
+			for (const base::FunctionSignature& function : program.functions) {
+				entries.emplace(function.entry, static_cast<uint32_t>(function.params.size()));
+			}
+			const base::StackDepths depths(bytecode, entries);
+			const std::map<size_t, std::vector<size_t>> bodies = inlineableBodies(bytecode, depths);
+			if (bodies.empty()) {
+				return false;
+			}
+
+			base::Bytecode result;
+			std::vector<size_t> newIndex(bytecode.size() + 1);
+			std::vector<std::pair<size_t, size_t>> fixups; /* jump in result - target in bytecode */
+
+			for (size_t i = 0; i < bytecode.size(); i++) {
+				newIndex[i] = result.size();
+				const base::Operation& op = bytecode[i];
+
+				if (base::isCall(op.getOpCode()) and depths.depth(i).has_value()) {
+					const size_t entry = base::jumpTarget(bytecode, i);
+					const size_t frameBase = depths.depth(i).value() - op.side_unsignedData();
+					const auto body = bodies.find(entry);
+					// fused operations address locals with 16 bit
+					if ((body != bodies.end()) and (frameBase + depths.function(entry).maxDepth < std::numeric_limits<uint16_t>::max())) {
+						std::vector<base::Operation> arguments;
+						if (canForwardArguments(bytecode, depths, i, body->second)) {
+							arguments.assign(bytecode.begin() + (i - op.side_unsignedData()), bytecode.begin() + i);
+							result.resize(result.size() - arguments.size());
+						}
+						inlineBody(bytecode, depths, body->second, frameBase, arguments, result, fixups);
+						if (op.getOpCode() == base::OpCode::TAIL_CALL) {
+							result.push_back(base::Operation(base::OpCode::RETURN, uint32_t(1)));
+						}
+						continue;
+					}
+				}
+
+				if (base::isJump(op.getOpCode())) {
+					fixups.emplace_back(result.size(), base::jumpTarget(bytecode, i));
+				}
+				result.push_back(op);
+			}
+			newIndex[bytecode.size()] = result.size();
+
+			for (const auto& [jump, target] : fixups) {
+				setJumpTarget(result, jump, newIndex[target]);
+			}
+			for (base::FunctionSignature& function : program.functions) {
+				function.entry = newIndex[function.entry];
+			}
+			program.mainCall = newIndex[program.mainCall]; // the body of main if it got inlined
+			// an inlined body belongs to the statement of its call
+			std::vector<base::SourceLine> lines;
+			for (base::SourceLine line : program.lines) {
+				line.firstOperation = static_cast<uint32_t>(newIndex[line.firstOperation]);
+				if (!lines.empty() and (lines.back().firstOperation == line.firstOperation)) {
+					lines.pop_back();
+				}
+				lines.push_back(line);
+			}
+			program.lines = std::move(lines);
+
+			bytecode = std::move(result);
+			return true;
+		}
+
+		static void setJumpTarget(base::Bytecode& bytecode, size_t jump, size_t target) {
+			bytecode[jump].signedData() = static_cast<int32_t>(target) - static_cast<int32_t>(jump) - 1;
+		}
+
+		// Reachable operations of every function that can be inlined, by entry
+		std::map<size_t, std::vector<size_t>> inlineableBodies(const base::Bytecode& bytecode, const base::StackDepths& depths) const {
+			std::map<size_t, std::vector<size_t>> bodies;
+			std::map<size_t, std::set<size_t>> callees;
+			std::set<size_t> excluded;
+
+			for (size_t i = 0; i < bytecode.size(); i++) {
+				if (!depths.depth(i).has_value() or (depths.owner(i) == base::StackDepths::topLevel)) {
+					continue;
+				}
+				const size_t owner = depths.owner(i);
+				bodies[owner].push_back(i);
+
+				const base::OpCode opCode = bytecode[i].getOpCode();
+				if (opCode == base::OpCode::TAIL_CALL) {
+					excluded.insert(owner); // would replace the frame of the caller
+				} else if (opCode == base::OpCode::CALL_FUNCTION) {
+					callees[owner].insert(base::jumpTarget(bytecode, i));
+				}
+			}
+
+			for (auto it = bodies.begin(); it != bodies.end();) {
+				const bool tooBig = it->second.size() > threshold;
+				if (tooBig or excluded.count(it->first) or isRecursive(it->first, callees)) {
+					it = bodies.erase(it);
+				} else {
+					it++;
+				}
+			}
+			return bodies;
+		}
+
+		static bool isRecursive(size_t entry, const std::map<size_t, std::set<size_t>>& callees) {
+			std::set<size_t> visited;
+			std::vector<size_t> open = { entry };
+			while (!open.empty()) {
+				const size_t function = open.back();
+				open.pop_back();
+
+				const auto calls = callees.find(function);
+				if (calls == callees.end()) {
+					continue;
+				}
+				for (size_t callee : calls->second) {
+					if (callee == entry) {
+						return true;
+					}
+					if (visited.insert(callee).second) {
+						open.push_back(callee);
+					}
+				}
+			}
+			return false;
+		}
+
+		static bool isLoad(base::OpCode opCode) {
+			return anyOf(opCode, base::OpCode::LOAD_LOCAL, base::OpCode::LOAD_GLOBAL, base::OpCode::LOAD_LITERAL);
+		}
+
+		static bool writesLocal(const base::Operation& op, size_t slot) {
+			switch (op.getOpCode()) {
+				case base::OpCode::STORE_LOCAL:
+				case base::OpCode::ADD_INT_STORE_LOCAL:
+				case base::OpCode::SUB_INT_STORE_LOCAL:
+				case base::OpCode::MULT_INT_STORE_LOCAL:
+				case base::OpCode::INCR_LOCAL_INT:
+				case base::OpCode::DECR_LOCAL_INT:
+					return op.unsignedData() == slot;
+				default:
+					return false;
+			}
+		}
+
+		/* Arguments that are a single load each don't have to be copied into the frame, the body can load them
+		*  itself. Only if the body never writes a parameter and nothing can change a loaded global in between. */
+		static bool canForwardArguments(const base::Bytecode& bytecode, const base::StackDepths& depths, size_t call, const std::vector<size_t>& body) {
+			const size_t params = bytecode[call].side_unsignedData();
+			if (call < params) {
+				return false;
+			}
+			for (size_t i = call - params; i < call; i++) {
+				if (!isLoad(bytecode[i].getOpCode()) or depths.isLanding(i + 1)) {
+					return false;
+				}
+			}
+
+			const auto argument = [&](size_t slot) -> const base::Operation& { return bytecode[call - params + slot]; };
+			bool loadsGlobal = false;
+			for (size_t slot = 0; slot < params; slot++) {
+				loadsGlobal |= argument(slot).getOpCode() == base::OpCode::LOAD_GLOBAL;
+			}
+
+			for (size_t i : body) {
+				const base::Operation& op = bytecode[i];
+				if (loadsGlobal and anyOf(op.getOpCode(), base::OpCode::STORE_GLOBAL, base::OpCode::CALL_FUNCTION, base::OpCode::PFOR, base::OpCode::YIELD)) {
+					return false;
+				}
+				for (size_t slot = 0; slot < params; slot++) {
+					if (writesLocal(op, slot)) {
+						return false;
+					}
+					// fused operations can only take the argument if it is a local as well
+					const bool fusedRead = ((localFields(op.getOpCode()) > 0) and (op.side_unsignedData() == slot))
+						or ((localFields(op.getOpCode()) > 1) and (op.unsignedData() == slot));
+					if (fusedRead and (argument(slot).getOpCode() != base::OpCode::LOAD_LOCAL)) {
+						return false;
+					}
+				}
+			}
+			return true;
+		}
+
+		// Local slots in the fused operations that read two values: side_unsignedData, then unsignedData
+		static int localFields(base::OpCode opCode) {
+			switch (opCode) {
+				case base::OpCode::ADD_LOCAL_LITERAL_INT:
+				case base::OpCode::SUB_LOCAL_LITERAL_INT:
+				case base::OpCode::MULT_LOCAL_LITERAL_INT:
+				case base::OpCode::EQ_LOCAL_LITERAL_INT:
+				case base::OpCode::UNEQ_LOCAL_LITERAL_INT:
+				case base::OpCode::LESS_LOCAL_LITERAL_INT:
+				case base::OpCode::BIGGER_LOCAL_LITERAL_INT:
+					return 1;
+				case base::OpCode::EQ_LOCAL_LOCAL_INT:
+				case base::OpCode::UNEQ_LOCAL_LOCAL_INT:
+				case base::OpCode::LESS_LOCAL_LOCAL_INT:
+				case base::OpCode::BIGGER_LOCAL_LOCAL_INT:
+					return 2;
+				default:
+					return 0;
+			}
+		}
+
+		/* Copies the body into the frame that starts at frameBase, every exit continues behind the copy.
+		*  Forwarded arguments replace the loads of their parameters and take no slot. */
+		static void inlineBody(const base::Bytecode& bytecode, const base::StackDepths& depths, const std::vector<size_t>& body, size_t frameBase,
+			const std::vector<base::Operation>& arguments, base::Bytecode& result, std::vector<std::pair<size_t, size_t>>& fixups) {
+			const auto slot = [&](uint32_t local) -> uint32_t {
+				return (local < arguments.size()) ? arguments[local].unsignedData() : static_cast<uint32_t>(frameBase + local - arguments.size());
+			};
+			std::map<size_t, size_t> localIndex; /* bytecode - result */
+			std::vector<std::pair<size_t, size_t>> localJumps; /* jump in result - target in bytecode */
+			std::vector<size_t> exits;
+
+			for (size_t i : body) {
+				localIndex[i] = result.size();
+				base::Operation op = bytecode[i];
+				// slots of the inlined frame, forwarded parameters don't have one
+				const auto inFrame = [&](size_t depth) { return (depth > arguments.size()) ? depth - arguments.size() : 0; };
+				const size_t depth = inFrame(depths.depth(i).value());
+
+				switch (op.getOpCode()) {
+					case base::OpCode::POP: // the body pops its parameters at the end of the function scope
+					{
+						const size_t popped = depth - inFrame(depths.depth(i).value() - op.unsignedData());
+						if (popped > 0) {
+							result.push_back(base::Operation(base::OpCode::POP, static_cast<uint32_t>(popped)));
+						}
+					}
+					continue;
+					case base::OpCode::RETURN:
+					case base::OpCode::END_FUNCTION:
+					{
+						const bool returnsValue = (op.getOpCode() == base::OpCode::RETURN) and (op.unsignedData() > 0);
+						if (returnsValue and (depth > 1)) {
+							result.push_back(base::Operation(base::OpCode::STORE_LOCAL, static_cast<uint32_t>(frameBase)));
+							if (depth > 2) {
+								result.push_back(base::Operation(base::OpCode::POP, static_cast<uint32_t>(depth - 2)));
+							}
+						} else if (!returnsValue and (depth > 0)) {
+							result.push_back(base::Operation(base::OpCode::POP, static_cast<uint32_t>(depth)));
+						}
+
+						if (i != body.back()) {
+							exits.push_back(result.size());
+							result.push_back(base::Operation(base::OpCode::JUMP, int32_t(0)));
+						}
+					}
+					continue;
+					case base::OpCode::JUMP:
+					case base::OpCode::JUMP_IF_NOT:
+						localJumps.emplace_back(result.size(), base::jumpTarget(bytecode, i));
+						break;
+					case base::OpCode::CALL_FUNCTION:
+					case base::OpCode::SPAWN:
+					case base::OpCode::PFOR:
+						fixups.emplace_back(result.size(), base::jumpTarget(bytecode, i));
+						break;
+					case base::OpCode::LOAD_LOCAL:
+						if (op.unsignedData() < arguments.size()) {
+							op = arguments[op.unsignedData()];
+						} else {
+							op.unsignedData() = slot(op.unsignedData());
+						}
+						break;
+					case base::OpCode::STORE_LOCAL:
+					case base::OpCode::ADD_INT_STORE_LOCAL:
+					case base::OpCode::SUB_INT_STORE_LOCAL:
+					case base::OpCode::MULT_INT_STORE_LOCAL:
+					case base::OpCode::INCR_LOCAL_INT:
+					case base::OpCode::DECR_LOCAL_INT:
+						op.unsignedData() = slot(op.unsignedData());
+						break;
+					case base::OpCode::ADD_LOCAL_LITERAL_INT:
+					case base::OpCode::SUB_LOCAL_LITERAL_INT:
+					case base::OpCode::MULT_LOCAL_LITERAL_INT:
+					case base::OpCode::EQ_LOCAL_LITERAL_INT:
+					case base::OpCode::UNEQ_LOCAL_LITERAL_INT:
+					case base::OpCode::LESS_LOCAL_LITERAL_INT:
+					case base::OpCode::BIGGER_LOCAL_LITERAL_INT:
+						op.side_unsignedData() = static_cast<uint16_t>(slot(op.side_unsignedData()));
+						break;
+					case base::OpCode::EQ_LOCAL_LOCAL_INT:
+					case base::OpCode::UNEQ_LOCAL_LOCAL_INT:
+					case base::OpCode::LESS_LOCAL_LOCAL_INT:
+					case base::OpCode::BIGGER_LOCAL_LOCAL_INT:
+						op.side_unsignedData() = static_cast<uint16_t>(slot(op.side_unsignedData()));
+						op.unsignedData() = slot(op.unsignedData());
+						break;
+					default:
+						break;
+				}
+				result.push_back(op);
+			}
+
+			for (const auto& [jump, target] : localJumps) {
+				setJumpTarget(result, jump, localIndex.at(target));
+			}
+			for (size_t exit : exits) {
+				setJumpTarget(result, exit, result.size());
+			}
+		}
+	};
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <chrono>
+
+namespace compiler {
+	// Time Compiler::run(PhaseTimes&) spent in every phase, the phases interleave and get summed up
+	struct PhaseTimes {
+		std::chrono::nanoseconds tokenize{ 0 }; // the Tokenizer, literals included
+		std::chrono::nanoseconds shuntingYard{ 0 }; // ordering the tokens of expressions
+		std::chrono::nanoseconds codegen{ 0 }; // everything else of the parser: scopes, functions, emitting
+		std::chrono::nanoseconds inlining{ 0 };
+
+		std::chrono::nanoseconds total() const {
+			return tokenize + shuntingYard + codegen + inlining;
+		}
+	};
+
+	// Adds the time until the end of the scope to the phase, without a phase it doesn't look at the clock
+	class PhaseTimer {
+	public:
+		explicit PhaseTimer(std::chrono::nanoseconds* phase)
+			: phase(phase) {
+			if (phase != nullptr) {
+				start = std::chrono::steady_clock::now();
+			}
+		}
+
+		PhaseTimer(const PhaseTimer&) = delete;
+		PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+		~PhaseTimer() {
+			if (phase != nullptr) {
+				*phase += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+			}
+		}
+
+	private:
+		std::chrono::nanoseconds* phase;
+		std::chrono::steady_clock::time_point start;
+	};
+}
@@ -2,6 +2,7 @@
 
 #include <vector>
 #include <optional>
+#include <utility>
 #include "Token.h"
 
 namespace compiler {
@@ -155,6 +156,23 @@ namespace compiler {
 			return variables.size();
 		}
 
+		// A function compiled inside of another one starts without the locals of the outer one, see Compiler::parse_pfor
+		VariableContainer hideLocalVariables() {
+			return std::exchange(variables, {});
+		}
+
+		void restoreLocalVariables(VariableContainer hidden) {
+			variables = std::move(hidden);
+		}
+
+		std::vector<base::TypeIndex> globalTypes() const {
+			std::vector<base::TypeIndex> types;
+			for (const Variable& variable : globalVariables) {
+				types.push_back(static_cast<base::TypeIndex>(variable.type));
+			}
+			return types;
+		}
+
 		// === Other ====
 
 		base::Operation createStoreOperation(const Token& token) const {
@@ -8,6 +8,7 @@
 #include <sstream>
 
 #include "Token.h"
+#include "PhaseTimes.h"
 #include "src/Base/LiteralStore.h"
 #include "src/Utils/Source.h"
 
@@ -232,6 +233,10 @@ namespace compiler {
 				case base::OpCode::BREAK:
 				case base::OpCode::FUNC:
 				case base::OpCode::RETURN:
+				case base::OpCode::SPAWN:
+				case base::OpCode::YIELD:
+				case base::OpCode::PFOR:
+				case base::OpCode::REDUCE:
 					result = extractKeyword(extractLexem(partOfVariableName));
 					break;
 				case base::OpCode::TYPE:
@@ -253,6 +258,7 @@ namespace compiler {
 
 		Token nextToken() {
 			if (!peaked.has_value()) {
+				const PhaseTimer timer(time);
 				return extract();
 			}
 
@@ -263,6 +269,7 @@ namespace compiler {
 
 		Token nextToken(base::OpCode hint) {
 			if (!peaked.has_value()) {
+				const PhaseTimer timer(time);
 				return extract(hint);
 			}
 
@@ -279,6 +286,7 @@ namespace compiler {
 
 	public:
 		base::LiteralStore literals;
+		std::chrono::nanoseconds* time = nullptr; // extracting tokens adds up here, see PhaseTimes
 
 		Tokenizer(const std::string& source) :
 			view(source) {
@@ -292,6 +300,7 @@ namespace compiler {
 
 		const Token& peak() {
 			if (!peaked.has_value()) {
+				const PhaseTimer timer(time);
 				peaked = extract();
 			}
 			return peaked.value();
@@ -28,4 +28,10 @@ namespace ex {
 			throw ex::Exception(message);
 		}
 	}
+
+	inline void assume(bool condition, const char* message) { // doesnt create a string if everything is fine
+		if (!condition) {
+			throw ex::Exception(message);
+		}
+	}
 }
\ No newline at end of file
@@ -0,0 +1,350 @@
+#pragma once
+
+#include <vector>
+
+#include "src/Base/Program.h"
+#include "src/Base/BytecodeAnalysis.h"
+
+namespace registermachine {
+	/* Operands are 32 bit, the upper two bits select where the value lives:
+	*  registers are relative to the current frame, globals are absolute, constants index the literal pool */
+	enum class OperandKind : uint32_t {
+		Register = 0, Global = 1, Constant = 2
+	};
+
+	constexpr uint32_t operandKindShift = 30;
+	constexpr uint32_t operandIndexMask = (1u << operandKindShift) - 1;
+
+	constexpr uint32_t makeOperand(OperandKind kind, size_t index) {
+		return (static_cast<uint32_t>(kind) << operandKindShift) | static_cast<uint32_t>(index);
+	}
+
+	constexpr OperandKind operandKind(uint32_t operand) {
+		return static_cast<OperandKind>(operand >> operandKindShift);
+	}
+
+	constexpr uint32_t operandIndex(uint32_t operand) {
+		return operand & operandIndexMask;
+	}
+
+	/* Three address instruction, the operation reuses the opcodes of the stackmachine:
+	*  ASSIGN dst a               | dst = a
+	*  CREATE_VARIABLE dst type   | dst = default value of type
+	*  ADD, ADD_INT, ... dst a b  | dst = a + b
+	*  INCR, INCR_INT, ... dst a  | dst = a + 1
+	*  JUMP target                | absolute target
+	*  JUMP_IF_NOT a target       |
+	*  CALL_FUNCTION base target frameSize | arguments are in the registers starting at base, the return value is written to base
+	*  TAIL_CALL target frameSize | arguments are already moved into the first registers of the current frame
+	*  RETURN a / END_FUNCTION / END_PROGRAM */
+	struct Instruction {
+		base::OpCode opCode;
+		uint32_t dst = 0;
+		uint32_t a = 0;
+		uint32_t b = 0;
+	};
+
+	struct RegisterProgram {
+		std::vector<Instruction> code;
+		std::vector<base::BasicType> constants;
+		size_t frameSize = 0; // registers used by the code outside of functions
+		size_t globals = 0; // registers that are alive after END_PROGRAM
+	};
+
+	/* Translates the bytecode of the compiler into register code. Every stack slot becomes the register with
+	*  the same frame relative index, so variables already live in their registers. Loads aren't translated
+	*  into moves but are remembered as pending operands and used directly by the operation that consumes them. */
+	class RegisterCompiler {
+	public:
+		explicit RegisterCompiler(const base::Program& program)
+			: program(program), bytecode(program.bytecode), depths(program.bytecode) {
+		}
+
+		RegisterProgram run() {
+			result.constants.reserve(program.literals.size());
+			for (size_t i = 0; i < program.literals.size(); i++) {
+				result.constants.push_back(program.literals[i]);
+			}
+			result.frameSize = depths.topLevelMaxDepth() + 1;
+
+			std::vector<size_t> labels(bytecode.size() + 1, 0);
+			bool reachable = false;
+			for (size_t i = 0; i < bytecode.size(); i++) {
+				if (!depths.depth(i).has_value()) {
+					reachable = false;
+					continue;
+				}
+
+				if (!reachable or (depths.owner(i) != owner)) { // start of a function or code after a jump
+					owner = depths.owner(i);
+					stack.clear();
+					for (size_t slot = 0; slot < depths.depth(i).value(); slot++) {
+						stack.push_back(reg(slot));
+					}
+				}
+
+				if (depths.isLanding(i)) {
+					flush(stack.size());
+					retargetable = false;
+				}
+
+				labels[i] = result.code.size();
+				reachable = translate(i);
+			}
+
+			for (const auto& [instruction, target] : jumpFixups) {
+				uint32_t& field = (result.code[instruction].opCode == base::OpCode::JUMP_IF_NOT) ? result.code[instruction].b : result.code[instruction].a;
+				field = static_cast<uint32_t>(labels[target]);
+			}
+
+			return std::move(result);
+		}
+
+	private:
+		const base::Program& program;
+		const base::Bytecode& bytecode;
+		const base::StackDepths depths;
+
+		RegisterProgram result;
+		std::vector<std::pair<size_t, size_t>> jumpFixups; /* instruction - bytecode target */
+
+		std::vector<uint32_t> stack; // operand that holds the value of every stack slot
+		size_t owner = base::StackDepths::topLevel;
+		bool retargetable = false; // last instruction wrote the top of the stack and can write somewhere else instead
+		size_t retargetSlot = 0;
+
+		static uint32_t reg(size_t index) {
+			return makeOperand(OperandKind::Register, index);
+		}
+
+		// Current value of a frame slot, the slot may still be pending (inlined functions read their arguments like this)
+		uint32_t local(size_t slot) const {
+			return (slot < stack.size()) ? stack[slot] : reg(slot);
+		}
+
+		uint32_t global(size_t index) const {
+			// outside of functions the frame starts at 0, globals are normal registers there
+			return makeOperand((owner == base::StackDepths::topLevel) ? OperandKind::Register : OperandKind::Global, index);
+		}
+
+		void emit(Instruction instruction) {
+			result.code.push_back(instruction);
+			retargetable = false;
+		}
+
+		// Operation writes into the slot at the top of the stack
+		void emitResult(base::OpCode opCode, uint32_t a, uint32_t b = 0) {
+			const uint32_t dst = reg(stack.size());
+			emit({ opCode, dst, a, b });
+			stack.push_back(dst);
+			retargetable = true;
+			retargetSlot = stack.size() - 1;
+		}
+
+		// Moves pending operands into the registers of their slots
+		void flush(size_t slots) {
+			for (size_t slot = 0; slot < slots; slot++) {
+				if (stack[slot] != reg(slot)) {
+					emit({ base::OpCode::ASSIGN, reg(slot), stack[slot] });
+					stack[slot] = reg(slot);
+				}
+			}
+		}
+
+		// Before a variable gets overwritten all pending reads of it have to be done
+		void flushReadsOf(uint32_t variable, size_t slots) {
+			for (size_t slot = 0; slot < slots; slot++) {
+				if ((stack[slot] == variable) and (reg(slot) != variable)) {
+					emit({ base::OpCode::ASSIGN, reg(slot), stack[slot] });
+					stack[slot] = reg(slot);
+				}
+			}
+		}
+
+		uint32_t pop() {
+			const uint32_t operand = stack.back();
+			stack.pop_back();
+			return operand;
+		}
+
+		void store(uint32_t variable) {
+			flushReadsOf(variable, stack.size() - 1);
+
+			const bool canRetarget = retargetable and (retargetSlot == stack.size() - 1) and (stack.back() == reg(retargetSlot));
+			const uint32_t value = pop();
+			if (canRetarget) {
+				result.code.back().dst = variable;
+				retargetable = false;
+			} else if (value != variable) {
+				emit({ base::OpCode::ASSIGN, variable, value });
+			}
+
+			if ((operandKind(variable) == OperandKind::Register) and (operandIndex(variable) < stack.size())) {
+				stack[operandIndex(variable)] = variable;
+			}
+		}
+
+		void binary(base::OpCode opCode) {
+			const uint32_t b = pop();
+			const uint32_t a = pop();
+			emitResult(opCode, a, b);
+		}
+
+		void jump(base::OpCode opCode, uint32_t a, size_t index) {
+			jumpFixups.emplace_back(result.code.size(), base::jumpTarget(bytecode, index));
+			emit({ opCode, 0, a, 0 });
+		}
+
+		static base::OpCode unfused(base::OpCode opCode) {
+			switch (opCode) {
+				case base::OpCode::ADD_LOCAL_LITERAL_INT:
+				case base::OpCode::ADD_INT_STORE_LOCAL: return base::OpCode::ADD_INT;
+				case base::OpCode::SUB_LOCAL_LITERAL_INT:
+				case base::OpCode::SUB_INT_STORE_LOCAL: return base::OpCode::SUB_INT;
+				case base::OpCode::MULT_LOCAL_LITERAL_INT:
+				case base::OpCode::MULT_INT_STORE_LOCAL: return base::OpCode::MULT_INT;
+				case base::OpCode::EQ_LOCAL_LITERAL_INT:
+				case base::OpCode::EQ_LOCAL_LOCAL_INT: return base::OpCode::EQ_INT;
+				case base::OpCode::UNEQ_LOCAL_LITERAL_INT:
+				case base::OpCode::UNEQ_LOCAL_LOCAL_INT: return base::OpCode::UNEQ_INT;
+				case base::OpCode::LESS_LOCAL_LITERAL_INT:
+				case base::OpCode::LESS_LOCAL_LOCAL_INT: return base::OpCode::LESS_INT;
+				case base::OpCode::BIGGER_LOCAL_LITERAL_INT:
+				case base::OpCode::BIGGER_LOCAL_LOCAL_INT: return base::OpCode::BIGGER_INT;
+				case base::OpCode::INCR_LOCAL_INT: return base::OpCode::INCR_INT;
+				case base::OpCode::DECR_LOCAL_INT: return base::OpCode::DECR_INT;
+				default: return opCode;
+			}
+		}
+
+		// Returns if the next operation is reachable from this one
+		bool translate(size_t index) {
+			const base::Operation& op = bytecode[index];
+			const base::OpCode opCode = op.getOpCode();
+
+			switch (opCode) {
+				case base::OpCode::LOAD_LITERAL:
+					stack.push_back(makeOperand(OperandKind::Constant, op.unsignedData()));
+					return true;
+				case base::OpCode::LOAD_LOCAL:
+					stack.push_back(local(op.unsignedData()));
+					return true;
+				case base::OpCode::LOAD_GLOBAL:
+					stack.push_back(global(op.unsignedData()));
+					return true;
+				case base::OpCode::STORE_LOCAL:
+					store(reg(op.unsignedData()));
+					return true;
+				case base::OpCode::STORE_GLOBAL:
+					store(global(op.unsignedData()));
+					return true;
+				case base::OpCode::CREATE_VARIABLE:
+					emitResult(opCode, op.unsignedData());
+					return true;
+				case base::OpCode::POP:
+					stack.resize(stack.size() - op.unsignedData());
+					retargetable = false;
+					return true;
+				case base::OpCode::JUMP:
+					flush(stack.size());
+					jump(opCode, 0, index);
+					return false;
+				case base::OpCode::JUMP_IF_NOT:
+				{
+					const uint32_t condition = pop();
+					flush(stack.size());
+					jump(opCode, condition, index);
+					return true;
+				}
+				case base::OpCode::CALL_FUNCTION:
+				{
+					const base::StackDepths::Function& function = depths.function(base::jumpTarget(bytecode, index));
+					flush(stack.size());
+					const size_t frameBase = stack.size() - function.params;
+					jumpFixups.emplace_back(result.code.size(), function.entry);
+					emit({ opCode, reg(frameBase), 0, static_cast<uint32_t>(function.maxDepth + 1) });
+
+					stack.resize(frameBase);
+					if (function.returnsValue) {
+						stack.push_back(reg(frameBase));
+					}
+					return true;
+				}
+				case base::OpCode::TAIL_CALL:
+				{
+					const base::StackDepths::Function& function = depths.function(base::jumpTarget(bytecode, index));
+					const size_t argumentBase = stack.size() - function.params;
+					for (size_t i = 0; i < function.params; i++) {
+						for (size_t j = i + 1; j < function.params; j++) {
+							if (stack[argumentBase + j] == reg(i)) { // argument j reads a register that argument i overwrites
+								flush(stack.size());
+							}
+						}
+					}
+					for (size_t i = 0; i < function.params; i++) {
+						if (stack[argumentBase + i] != reg(i)) {
+							emit({ base::OpCode::ASSIGN, reg(i), stack[argumentBase + i] });
+						}
+					}
+					jumpFixups.emplace_back(result.code.size(), function.entry);
+					emit({ opCode, 0, 0, static_cast<uint32_t>(function.maxDepth + 1) });
+					return false;
+				}
+				case base::OpCode::RETURN:
+					emit({ opCode, 0, pop() });
+					return false;
+				case base::OpCode::END_FUNCTION:
+					emit({ opCode });
+					return false;
+				case base::OpCode::END_PROGRAM:
+					result.globals = stack.size();
+					emit({ opCode });
+					return false;
+				case base::OpCode::ADD_LOCAL_LITERAL_INT:
+				case base::OpCode::SUB_LOCAL_LITERAL_INT:
+				case base::OpCode::MULT_LOCAL_LITERAL_INT:
+				case base::OpCode::EQ_LOCAL_LITERAL_INT:
+				case base::OpCode::UNEQ_LOCAL_LITERAL_INT:
+				case base::OpCode::LESS_LOCAL_LITERAL_INT:
+				case base::OpCode::BIGGER_LOCAL_LITERAL_INT:
+					emitResult(unfused(opCode), local(op.side_unsignedData()), makeOperand(OperandKind::Constant, op.unsignedData()));
+					return true;
+				case base::OpCode::EQ_LOCAL_LOCAL_INT:
+				case base::OpCode::UNEQ_LOCAL_LOCAL_INT:
+				case base::OpCode::LESS_LOCAL_LOCAL_INT:
+				case base::OpCode::BIGGER_LOCAL_LOCAL_INT:
+					emitResult(unfused(opCode), local(op.side_unsignedData()), local(op.unsignedData()));
+					return true;
+				case base::OpCode::ADD_INT_STORE_LOCAL:
+				case base::OpCode::SUB_INT_STORE_LOCAL:
+				case base::OpCode::MULT_INT_STORE_LOCAL:
+					binary(unfused(opCode));
+					store(reg(op.unsignedData()));
+					return true;
+				case base::OpCode::INCR_LOCAL_INT:
+				case base::OpCode::DECR_LOCAL_INT:
+					flushReadsOf(reg(op.unsignedData()), stack.size());
+					emit({ unfused(opCode), reg(op.unsignedData()), local(op.unsignedData()) });
+					stack[op.unsignedData()] = reg(op.unsignedData());
+					return true;
+				case base::OpCode::SPAWN:
+				case base::OpCode::YIELD:
+				case base::OpCode::PFOR:
+					throw ex::Exception("Operation not supported by the register machine: "s + base::opCodeName(opCode).str);
+				default:
+					break;
+			}
+
+			switch (base::stackEffect(op)) {
+				case 0: // INCR, DECR
+					emitResult(opCode, pop());
+					return true;
+				case -1: // binary operations
+					binary(opCode);
+					return true;
+				default:
+					throw ex::Exception("Unknown operation for register code: "s + base::opCodeName(opCode).str);
+			}
+		}
+	};
+}
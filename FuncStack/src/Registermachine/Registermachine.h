@@ -0,0 +1,289 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <iomanip>
+#include <span>
+#include <sstream>
+#include <vector>
+
+#include "RegisterCompiler.h"
+#include "src/Exception.h"
+
+namespace registermachine {
+	class RegisterMachine {
+	public:
+		static constexpr size_t defaultCapacity = 1 << 14;
+
+		explicit RegisterMachine(RegisterProgram toExecute, size_t capacity = defaultCapacity)
+			: program(std::move(toExecute)), registers(std::max(capacity, program.frameSize)) {
+			bases[static_cast<size_t>(OperandKind::Register)] = registers.data();
+			bases[static_cast<size_t>(OperandKind::Global)] = registers.data();
+			bases[static_cast<size_t>(OperandKind::Constant)] = program.constants.data();
+		}
+
+		void exec() {
+			const Instruction* const code = program.code.data();
+			const Instruction* ip = code;
+
+			while (true) {
+				const Instruction& in = *ip;
+				switch (in.opCode) {
+					// ==== META ====
+					case base::OpCode::ASSIGN:
+						write(in.dst) = read(in.a);
+						break;
+					case base::OpCode::CREATE_VARIABLE:
+						write(in.dst) = base::BasicType::fromId(static_cast<base::TypeIndex>(in.a));
+						break;
+					case base::OpCode::JUMP:
+						ip = code + in.a;
+						continue;
+					case base::OpCode::JUMP_IF_NOT:
+						if (read(in.a).getBool() == false) {
+							ip = code + in.b;
+							continue;
+						}
+						break;
+					case base::OpCode::CALL_FUNCTION:
+					{
+						const size_t newFrame = frame + operandIndex(in.dst);
+						if (newFrame + in.b > registers.size()) {
+							throw ex::Exception("Stack overflow");
+						}
+						frames.push_back({ ip, frame });
+						setFrame(newFrame);
+						ip = code + in.a;
+					}
+					continue;
+					case base::OpCode::TAIL_CALL:
+						if (frame + in.b > registers.size()) {
+							throw ex::Exception("Stack overflow");
+						}
+						ip = code + in.a;
+						continue;
+					case base::OpCode::RETURN:
+						registers[frame] = read(in.a);
+						ip = endFunction();
+						break;
+					case base::OpCode::END_FUNCTION:
+						ip = endFunction();
+						break;
+					case base::OpCode::END_PROGRAM:
+						assert(frames.empty());
+						return;
+						// ==== COMPARE ====
+					case base::OpCode::EQ:
+						executeOP(in, std::equal_to());
+						break;
+					case base::OpCode::UNEQ:
+						executeOP(in, std::not_equal_to());
+						break;
+					case base::OpCode::LESS:
+						executeOP(in, std::less());
+						break;
+					case base::OpCode::BIGGER:
+						executeOP(in, std::greater());
+						break;
+						// ==== MATH ====
+					case base::OpCode::INCR:
+						write(in.dst) = read(in.a) + base::BasicType(1);
+						break;
+					case base::OpCode::DECR:
+						write(in.dst) = read(in.a) - base::BasicType(1);
+						break;
+					case base::OpCode::ADD:
+						executeOP(in, std::plus());
+						break;
+					case base::OpCode::SUB:
+						executeOP(in, std::minus());
+						break;
+					case base::OpCode::MULT:
+						executeOP(in, std::multiplies());
+						break;
+					case base::OpCode::DIV:
+						executeOP(in, std::divides());
+						break;
+						// ==== TYPED ====
+					case base::OpCode::ADD_INT: executeTypedOP<base::sm_int>(in, std::plus()); break;
+					case base::OpCode::ADD_UINT: executeTypedOP<base::sm_uint>(in, std::plus()); break;
+					case base::OpCode::ADD_FLOAT: executeTypedOP<base::sm_float>(in, std::plus()); break;
+					case base::OpCode::SUB_INT: executeTypedOP<base::sm_int>(in, std::minus()); break;
+					case base::OpCode::SUB_UINT: executeTypedOP<base::sm_uint>(in, std::minus()); break;
+					case base::OpCode::SUB_FLOAT: executeTypedOP<base::sm_float>(in, std::minus()); break;
+					case base::OpCode::MULT_INT: executeTypedOP<base::sm_int>(in, std::multiplies()); break;
+					case base::OpCode::MULT_UINT: executeTypedOP<base::sm_uint>(in, std::multiplies()); break;
+					case base::OpCode::MULT_FLOAT: executeTypedOP<base::sm_float>(in, std::multiplies()); break;
+					case base::OpCode::DIV_INT: executeTypedDivision<base::sm_int>(in); break;
+					case base::OpCode::DIV_UINT: executeTypedDivision<base::sm_uint>(in); break;
+					case base::OpCode::DIV_FLOAT: executeTypedDivision<base::sm_float>(in); break;
+					case base::OpCode::INCR_INT: executeTypedOP<base::sm_int>(in, std::plus(), 1); break;
+					case base::OpCode::INCR_UINT: executeTypedOP<base::sm_uint>(in, std::plus(), 1); break;
+					case base::OpCode::INCR_FLOAT: executeTypedOP<base::sm_float>(in, std::plus(), 1); break;
+					case base::OpCode::DECR_INT: executeTypedOP<base::sm_int>(in, std::minus(), 1); break;
+					case base::OpCode::DECR_UINT: executeTypedOP<base::sm_uint>(in, std::minus(), 1); break;
+					case base::OpCode::DECR_FLOAT: executeTypedOP<base::sm_float>(in, std::minus(), 1); break;
+					case base::OpCode::EQ_INT: executeTypedOP<base::sm_int>(in, std::equal_to()); break;
+					case base::OpCode::EQ_UINT: executeTypedOP<base::sm_uint>(in, std::equal_to()); break;
+					case base::OpCode::EQ_FLOAT: executeTypedOP<base::sm_float>(in, std::equal_to()); break;
+					case base::OpCode::EQ_BOOL: executeTypedOP<base::sm_bool>(in, std::equal_to()); break;
+					case base::OpCode::UNEQ_INT: executeTypedOP<base::sm_int>(in, std::not_equal_to()); break;
+					case base::OpCode::UNEQ_UINT: executeTypedOP<base::sm_uint>(in, std::not_equal_to()); break;
+					case base::OpCode::UNEQ_FLOAT: executeTypedOP<base::sm_float>(in, std::not_equal_to()); break;
+					case base::OpCode::UNEQ_BOOL: executeTypedOP<base::sm_bool>(in, std::not_equal_to()); break;
+					case base::OpCode::LESS_INT: executeTypedOP<base::sm_int>(in, std::less()); break;
+					case base::OpCode::LESS_UINT: executeTypedOP<base::sm_uint>(in, std::less()); break;
+					case base::OpCode::LESS_FLOAT: executeTypedOP<base::sm_float>(in, std::less()); break;
+					case base::OpCode::BIGGER_INT: executeTypedOP<base::sm_int>(in, std::greater()); break;
+					case base::OpCode::BIGGER_UINT: executeTypedOP<base::sm_uint>(in, std::greater()); break;
+					case base::OpCode::BIGGER_FLOAT: executeTypedOP<base::sm_float>(in, std::greater()); break;
+					default:
+						throw ex::Exception("Unrecognized instruction: "s + base::opCodeName(in.opCode).str);
+				}
+				ip++;
+			}
+		}
+
+		base::BasicType getGlobalVariable(size_t offset) const {
+			assert(offset < program.globals);
+			return registers[offset];
+		}
+
+		// Registers that correspond to the data stack of the stackmachine after the program ended
+		std::span<const base::BasicType> getDataStack() const {
+			return std::span<const base::BasicType>(registers.data(), program.globals);
+		}
+
+		const RegisterProgram& getProgram() const {
+			return program;
+		}
+
+		std::string toString() const {
+			std::ostringstream stream;
+
+			stream << "Constants:\n";
+			for (size_t i = 0; i < program.constants.size(); i++) {
+				stream << std::setw(3) << std::right << i << " | " << std::setw(20) << std::left;
+				stream << program.constants[i].toString() << " ";
+				stream << " (" << idToString(program.constants[i].typeId()) << ")\n";
+			}
+
+			stream << "\nGlobals:\n";
+			for (size_t i = 0; i < program.globals; i++) {
+				stream << std::setw(3) << std::right << i << " | " << std::setw(20) << std::left;
+				stream << registers[i].toString() << " ";
+				stream << " (" << idToString(registers[i].typeId()) << ")\n";
+			}
+
+			stream << "\nCode:\n";
+			for (size_t i = 0; i < program.code.size(); i++) {
+				const Instruction& in = program.code[i];
+
+				stream << std::setw(3) << std::right << i << " | " << std::setw(20) << std::left << opCodeName(in.opCode) << " ";
+				switch (in.opCode) {
+					case base::OpCode::CREATE_VARIABLE:
+						stream << operandName(in.dst) << ", " << idToString(static_cast<base::TypeIndex>(in.a));
+						break;
+					case base::OpCode::JUMP:
+						stream << "-> " << in.a;
+						break;
+					case base::OpCode::JUMP_IF_NOT:
+						stream << operandName(in.a) << " -> " << in.b;
+						break;
+					case base::OpCode::CALL_FUNCTION:
+						stream << "frame " << operandName(in.dst) << ", " << in.b << " registers -> " << in.a;
+						break;
+					case base::OpCode::TAIL_CALL:
+						stream << in.b << " registers -> " << in.a;
+						break;
+					case base::OpCode::RETURN:
+						stream << operandName(in.a);
+						break;
+					case base::OpCode::END_FUNCTION: // fallthrough
+					case base::OpCode::END_PROGRAM:
+						break;
+					case base::OpCode::ASSIGN:
+						stream << operandName(in.dst) << ", " << operandName(in.a);
+						break;
+					default:
+						stream << operandName(in.dst) << ", " << operandName(in.a);
+						if (base::stackEffect(base::Operation(in.opCode)) == -1) { // binary operation
+							stream << ", " << operandName(in.b);
+						}
+				}
+
+				stream << "\n";
+			}
+
+			return stream.str();
+		}
+
+	private:
+		struct Frame {
+			const Instruction* returnIp;
+			size_t base;
+		};
+
+		RegisterProgram program;
+		std::vector<base::BasicType> registers;
+		std::vector<Frame> frames;
+		size_t frame = 0;
+
+		std::array<base::BasicType*, 3> bases; // indexed by OperandKind
+
+		void setFrame(size_t newFrame) {
+			frame = newFrame;
+			bases[static_cast<size_t>(OperandKind::Register)] = registers.data() + frame;
+		}
+
+		const base::BasicType& read(uint32_t operand) const {
+			return bases[operand >> operandKindShift][operandIndex(operand)];
+		}
+
+		base::BasicType& write(uint32_t operand) {
+			return bases[operand >> operandKindShift][operandIndex(operand)];
+		}
+
+		const Instruction* endFunction() {
+			const Frame top = frames.back();
+			frames.pop_back();
+			setFrame(top.base);
+			return top.returnIp;
+		}
+
+		std::string operandName(uint32_t operand) const {
+			const uint32_t index = operandIndex(operand);
+			switch (operandKind(operand)) {
+				case OperandKind::Register: return "r" + std::to_string(index);
+				case OperandKind::Global: return "g" + std::to_string(index);
+				case OperandKind::Constant: return "k" + std::to_string(index) + " (" + program.constants[index].toString() + ")";
+			}
+			return "?";
+		}
+
+		template<typename ExecutionFunction>
+		void executeOP(const Instruction& in, ExecutionFunction func) {
+			write(in.dst) = func(read(in.a), read(in.b));
+		}
+
+		template<typename T, typename ExecutionFunction>
+		void executeTypedOP(const Instruction& in, ExecutionFunction func) {
+			write(in.dst) = base::BasicType(func(read(in.a).getUnchecked<T>(), read(in.b).getUnchecked<T>()));
+		}
+
+		template<typename T, typename ExecutionFunction>
+		void executeTypedOP(const Instruction& in, ExecutionFunction func, T operand) {
+			write(in.dst) = base::BasicType(func(read(in.a).getUnchecked<T>(), operand));
+		}
+
+		template<typename T>
+		void executeTypedDivision(const Instruction& in) {
+			const T divisor = read(in.b).getUnchecked<T>();
+			if (divisor == 0) {
+				throw ex::Exception("Division through zero");
+			}
+			write(in.dst) = base::BasicType(read(in.a).getUnchecked<T>() / divisor);
+		}
+	};
+}
@@ -0,0 +1,522 @@
+#pragma once
+
+#include <algorithm>
+#include <map>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "Stackmachine.h"
+#include "UntaggedStackmachine.h"
+
+namespace stackmachine {
+	// One value of the same type per row, stored untagged like the slots of the UntaggedStackMachine
+	class Column {
+	public:
+		Column() = default;
+
+		Column(base::TypeIndex type, size_t rows) : type(type), slots(rows) {}
+
+		template<typename T>
+		explicit Column(const std::vector<T>& values) : type(typeOf<T>()) {
+			slots.reserve(values.size());
+			for (const T value : values) {
+				slots.push_back(toSlot(value));
+			}
+		}
+
+		base::TypeIndex typeId() const {
+			return type;
+		}
+
+		size_t size() const {
+			return slots.size();
+		}
+
+		base::BasicType operator[](size_t row) const {
+			return fromSlot(slots[row], type);
+		}
+
+		template<typename T>
+		std::vector<T> values() const {
+			if (typeOf<T>() != type) {
+				throw ex::Exception("Column is of type " + base::idToString(type));
+			}
+			std::vector<T> result(slots.size());
+			std::transform(slots.begin(), slots.end(), result.begin(), fromSlot<T>);
+			return result;
+		}
+
+		std::span<Slot> data() {
+			return slots;
+		}
+
+		std::span<const Slot> data() const {
+			return slots;
+		}
+
+	private:
+		base::TypeIndex type = base::TypeIndex::Int;
+		std::vector<Slot> slots;
+
+		template<typename T>
+		static constexpr base::TypeIndex typeOf() {
+			if constexpr (std::is_same_v<T, base::sm_int>) return base::TypeIndex::Int;
+			else if constexpr (std::is_same_v<T, base::sm_uint>) return base::TypeIndex::Uint;
+			else if constexpr (std::is_same_v<T, base::sm_float>) return base::TypeIndex::Float;
+			else {
+				static_assert(std::is_same_v<T, base::sm_bool>, "Not a type of the language");
+				return base::TypeIndex::Bool;
+			}
+		}
+	};
+
+	/* Runs one function for many rows at once: every operation works on a whole column with a value per row,
+	*  so the dispatch is paid once per block of rows and the loops of the typed operations can be vectorized.
+	*  Rows that branch differently are kept apart by selection masks. The rows that wait at the same operation
+	*  run as a group, the group at the lowest operation goes first, so the rows meet again behind an if and
+	*  leave a loop together. Only the current group writes its lanes, all lanes are written while every row
+	*  of the block is in it.
+	*  Every row starts with the globals after the code outside of functions, like StackMachine::call(), and
+	*  keeps its own copy of them. Functions with calls, spawn, yield, pfor or generic operations are rejected,
+	*  the Inliner removes the calls of small functions. */
+	class BatchMachine {
+	public:
+		static constexpr size_t blockRows = 1024; // rows that run together, their columns stay in the cache
+
+		BatchMachine(base::Program toExecute)
+			: BatchMachine(base::freeze(std::move(toExecute))) {}
+
+		BatchMachine(base::SharedProgram toExecute)
+			: image(checkedImage(std::move(toExecute))), program(*image), active(blockRows) {
+			literals.reserve(program.literals.size());
+			for (size_t i = 0; i < program.literals.size(); i++) {
+				literals.push_back(toSlot(program.literals[i]));
+			}
+		}
+
+		/* Calls the function once per row, the arguments are one column per parameter with a value per row.
+		*  Returns the column of the return values, the globals of the rows are kept until the next run. An error
+		*  of any row ends the whole batch. */
+		std::optional<Column> run(size_t entry, const std::vector<Column>& arguments) {
+			const Layout& layout = checkedLayout(entry, arguments);
+			const base::FunctionSignature& function = *layout.function;
+			const size_t rows = arguments.front().size();
+
+			if (!declaredGlobals.has_value()) {
+				declaredGlobals.emplace();
+				for (const base::BasicType& global : StackMachine(image).runDeclarations()) {
+					declaredGlobals->push_back(toSlot(global));
+				}
+			}
+			globals.clear();
+			for (size_t i = 0; i < program.globalTypes.size(); i++) {
+				globals.emplace_back(program.globalTypes[i], rows);
+			}
+
+			std::optional<Column> result;
+			if (function.returnType.has_value()) {
+				result.emplace(function.returnType.value(), rows);
+			}
+
+			stack.resize(layout.maxDepth * blockRows);
+			for (size_t first = 0; first < rows; first += blockRows) {
+				runBlock(layout, arguments, first, std::min(blockRows, rows - first), result);
+			}
+			return result;
+		}
+
+		// The function is picked by its name and the types of the columns
+		std::optional<Column> run(const std::string& function, const std::vector<Column>& arguments) {
+			std::vector<base::TypeIndex> params;
+			for (const Column& argument : arguments) {
+				params.push_back(argument.typeId());
+			}
+			const base::FunctionSignature* signature = program.function(function, params);
+			if (signature == nullptr) {
+				throw ex::Exception("Unknown function: " + function);
+			}
+			return run(signature->entry, arguments);
+		}
+
+		// A global of every row after the last run
+		const Column& getGlobalColumn(size_t offset) const {
+			assert(offset < globals.size());
+			return globals[offset];
+		}
+
+		const base::SharedProgram& getProgram() const {
+			return image;
+		}
+
+	private:
+		using Mask = std::vector<uint8_t>; // a byte per row of the block, the loops over it vectorize better than over bits
+
+		// What a function needs to run in batches, worked out on its first run
+		struct Layout {
+			const base::FunctionSignature* function;
+			size_t maxDepth;
+			std::vector<size_t> depths; // stack depth at every operation of the program, only those of the function are set
+		};
+
+		const base::SharedProgram image;
+		const base::Program& program; // *image, shared with other machines
+		std::vector<Slot> literals;
+		std::optional<std::vector<Slot>> declaredGlobals;
+		std::map<size_t, Layout> layouts;
+
+		std::vector<Slot> stack; // column after column, each blockRows long
+		std::vector<Column> globals; // all rows of the run, a block uses its part
+		size_t sp; // next free column
+
+		// state of the current block
+		size_t first; // row of the first lane
+		size_t width; // lanes of the block
+		Mask active; // lanes of the current group
+		size_t activeRows;
+		size_t finishedRows;
+		std::map<size_t, Mask> waiting; // lanes of the other groups by the operation they continue at
+
+		const Layout& checkedLayout(size_t entry, const std::vector<Column>& arguments) {
+			const base::FunctionSignature* function = program.function(entry);
+			if (function == nullptr) {
+				throw ex::Exception("No function at " + std::to_string(entry));
+			}
+			if (arguments.size() != function->params.size()) {
+				throw ex::Exception("Wrong number of arguments for " + function->name);
+			}
+			if (arguments.empty()) {
+				throw ex::Exception("A batch needs at least one column: " + function->name);
+			}
+			for (size_t i = 0; i < arguments.size(); i++) {
+				if (arguments[i].typeId() != function->params[i]) {
+					throw ex::Exception("Wrong argument type for " + function->name);
+				}
+				if (arguments[i].size() != arguments.front().size()) {
+					throw ex::Exception("Columns of different length for " + function->name);
+				}
+			}
+
+			auto layout = layouts.find(entry);
+			if (layout == layouts.end()) {
+				const base::StackDepths depths(program.bytecode, { { entry, static_cast<uint32_t>(function->params.size()) } });
+				Layout created{ function, depths.function(entry).maxDepth, std::vector<size_t>(program.bytecode.size()) };
+				for (size_t i = 0; i < program.bytecode.size(); i++) {
+					if ((depths.owner(i) != entry) or !depths.depth(i).has_value()) {
+						continue;
+					}
+					if (!isSupported(program.bytecode[i].getOpCode())) {
+						throw ex::Exception("Operation not supported in a batch: "s + opCodeName(program.bytecode[i].getOpCode()).str);
+					}
+					created.depths[i] = depths.depth(i).value();
+				}
+				layout = layouts.emplace(entry, std::move(created)).first;
+			}
+			return layout->second;
+		}
+
+		static bool isSupported(base::OpCode opCode) {
+			switch (opCode) {
+				case base::OpCode::POP:
+				case base::OpCode::LOAD_LITERAL:
+				case base::OpCode::STORE_LOCAL:
+				case base::OpCode::LOAD_LOCAL:
+				case base::OpCode::CREATE_VARIABLE:
+				case base::OpCode::STORE_GLOBAL:
+				case base::OpCode::LOAD_GLOBAL:
+				case base::OpCode::JUMP:
+				case base::OpCode::JUMP_IF_NOT:
+				case base::OpCode::END_FUNCTION:
+				case base::OpCode::RETURN:
+					return true;
+				default:
+					return (opCode >= base::OpCode::ADD_INT) and (opCode <= base::OpCode::DECR_LOCAL_INT);
+			}
+		}
+
+		void runBlock(const Layout& layout, const std::vector<Column>& arguments, size_t firstRow, size_t rows, std::optional<Column>& result) {
+			first = firstRow;
+			width = rows;
+			std::fill(active.begin(), active.end(), 0);
+			std::fill(active.begin(), active.begin() + width, 1);
+			activeRows = width;
+			finishedRows = 0;
+			waiting.clear();
+
+			for (size_t i = 0; i < arguments.size(); i++) {
+				std::copy_n(arguments[i].data().begin() + first, width, column(i));
+			}
+			for (size_t i = 0; i < globals.size(); i++) {
+				std::fill_n(global(i), width, declaredGlobals->at(i));
+			}
+			sp = arguments.size();
+
+			size_t pc = layout.function->entry;
+			while (true) {
+				if (!waiting.empty() and (waiting.begin()->first == pc)) {
+					join(waiting.begin()->second);
+					waiting.erase(waiting.begin());
+				}
+
+				const base::Operation& op = program.bytecode[pc];
+				switch (op.getOpCode()) {
+					// ==== META ====
+					case base::OpCode::POP:
+						sp -= op.unsignedData();
+						break;
+					case base::OpCode::LOAD_LITERAL:
+					{
+						const Slot literal = literals[op.unsignedData()];
+						assign(column(sp++), [=](size_t) { return literal; });
+					}
+					break;
+					case base::OpCode::STORE_LOCAL:
+						copy(column(--sp), column(op.unsignedData()));
+						break;
+					case base::OpCode::LOAD_LOCAL:
+						copy(column(op.unsignedData()), column(sp++));
+						break;
+					case base::OpCode::CREATE_VARIABLE:
+						assign(column(sp++), [](size_t) { return Slot(0); });
+						break;
+					case base::OpCode::STORE_GLOBAL:
+						copy(column(--sp), global(op.unsignedData()));
+						break;
+					case base::OpCode::LOAD_GLOBAL:
+						copy(global(op.unsignedData()), column(sp++));
+						break;
+					case base::OpCode::JUMP:
+						wait(base::jumpTarget(program.bytecode, pc));
+						if (!resume(layout, pc)) {
+							return;
+						}
+						continue;
+					case base::OpCode::JUMP_IF_NOT:
+						if (!branch(layout, column(--sp), pc)) {
+							return;
+						}
+						continue;
+					case base::OpCode::RETURN:
+						if (op.unsignedData() > 0) {
+							copy(column(sp - 1), result->data().data() + first);
+						}
+						[[fallthrough]];
+					case base::OpCode::END_FUNCTION:
+						finishedRows += activeRows;
+						activeRows = 0;
+						if (!resume(layout, pc)) {
+							return;
+						}
+						continue;
+						// ==== TYPED ====
+					case base::OpCode::EQ_INT: binary<base::sm_int>(std::equal_to()); break;
+					case base::OpCode::EQ_UINT: binary<base::sm_uint>(std::equal_to()); break;
+					case base::OpCode::EQ_FLOAT: binary<base::sm_float>(std::equal_to()); break;
+					case base::OpCode::EQ_BOOL: binary<base::sm_bool>(std::equal_to()); break;
+					case base::OpCode::UNEQ_INT: binary<base::sm_int>(std::not_equal_to()); break;
+					case base::OpCode::UNEQ_UINT: binary<base::sm_uint>(std::not_equal_to()); break;
+					case base::OpCode::UNEQ_FLOAT: binary<base::sm_float>(std::not_equal_to()); break;
+					case base::OpCode::UNEQ_BOOL: binary<base::sm_bool>(std::not_equal_to()); break;
+					case base::OpCode::LESS_INT: binary<base::sm_int>(std::less()); break;
+					case base::OpCode::LESS_UINT: binary<base::sm_uint>(std::less()); break;
+					case base::OpCode::LESS_FLOAT: binary<base::sm_float>(std::less()); break;
+					case base::OpCode::BIGGER_INT: binary<base::sm_int>(std::greater()); break;
+					case base::OpCode::BIGGER_UINT: binary<base::sm_uint>(std::greater()); break;
+					case base::OpCode::BIGGER_FLOAT: binary<base::sm_float>(std::greater()); break;
+					case base::OpCode::INCR_INT: unary<base::sm_int>(std::plus(), 1); break;
+					case base::OpCode::INCR_UINT: unary<base::sm_uint>(std::plus(), 1); break;
+					case base::OpCode::INCR_FLOAT: unary<base::sm_float>(std::plus(), 1); break;
+					case base::OpCode::DECR_INT: unary<base::sm_int>(std::minus(), 1); break;
+					case base::OpCode::DECR_UINT: unary<base::sm_uint>(std::minus(), 1); break;
+					case base::OpCode::DECR_FLOAT: unary<base::sm_float>(std::minus(), 1); break;
+					case base::OpCode::ADD_INT: binary<base::sm_int>(std::plus()); break;
+					case base::OpCode::ADD_UINT: binary<base::sm_uint>(std::plus()); break;
+					case base::OpCode::ADD_FLOAT: binary<base::sm_float>(std::plus()); break;
+					case base::OpCode::SUB_INT: binary<base::sm_int>(std::minus()); break;
+					case base::OpCode::SUB_UINT: binary<base::sm_uint>(std::minus()); break;
+					case base::OpCode::SUB_FLOAT: binary<base::sm_float>(std::minus()); break;
+					case base::OpCode::MULT_INT: binary<base::sm_int>(std::multiplies()); break;
+					case base::OpCode::MULT_UINT: binary<base::sm_uint>(std::multiplies()); break;
+					case base::OpCode::MULT_FLOAT: binary<base::sm_float>(std::multiplies()); break;
+					case base::OpCode::DIV_INT: division<base::sm_int>(); break;
+					case base::OpCode::DIV_UINT: division<base::sm_uint>(); break;
+					case base::OpCode::DIV_FLOAT: division<base::sm_float>(); break;
+						// ==== SUPERINSTRUCTIONS ====
+					case base::OpCode::ADD_LOCAL_LITERAL_INT: localLiteral(op, std::plus()); break;
+					case base::OpCode::SUB_LOCAL_LITERAL_INT: localLiteral(op, std::minus()); break;
+					case base::OpCode::MULT_LOCAL_LITERAL_INT: localLiteral(op, std::multiplies()); break;
+					case base::OpCode::EQ_LOCAL_LITERAL_INT: localLiteral(op, std::equal_to()); break;
+					case base::OpCode::UNEQ_LOCAL_LITERAL_INT: localLiteral(op, std::not_equal_to()); break;
+					case base::OpCode::LESS_LOCAL_LITERAL_INT: localLiteral(op, std::less()); break;
+					case base::OpCode::BIGGER_LOCAL_LITERAL_INT: localLiteral(op, std::greater()); break;
+					case base::OpCode::EQ_LOCAL_LOCAL_INT: localLocal(op, std::equal_to()); break;
+					case base::OpCode::UNEQ_LOCAL_LOCAL_INT: localLocal(op, std::not_equal_to()); break;
+					case base::OpCode::LESS_LOCAL_LOCAL_INT: localLocal(op, std::less()); break;
+					case base::OpCode::BIGGER_LOCAL_LOCAL_INT: localLocal(op, std::greater()); break;
+					case base::OpCode::ADD_INT_STORE_LOCAL: storeLocal(op, std::plus()); break;
+					case base::OpCode::SUB_INT_STORE_LOCAL: storeLocal(op, std::minus()); break;
+					case base::OpCode::MULT_INT_STORE_LOCAL: storeLocal(op, std::multiplies()); break;
+					case base::OpCode::INCR_LOCAL_INT: inPlaceLocal(op, std::plus()); break;
+					case base::OpCode::DECR_LOCAL_INT: inPlaceLocal(op, std::minus()); break;
+					default:
+						throw ex::Exception("Unrecognized token: "s + opCodeName(op.getOpCode()));
+				}
+				pc++;
+			}
+		}
+
+		Slot* column(size_t slot) {
+			assert(slot < stack.size() / blockRows);
+			return stack.data() + slot * blockRows;
+		}
+
+		Slot* global(size_t offset) {
+			assert(offset < globals.size());
+			return globals[offset].data().data() + first;
+		}
+
+		// Writes the lanes of the current group, a globals column of a finished row must not change anymore
+		template<typename ValueFunction>
+		void assign(Slot* to, ValueFunction value) {
+			if (activeRows == width) {
+				for (size_t i = 0; i < width; i++) {
+					to[i] = value(i);
+				}
+			} else {
+				for (size_t i = 0; i < width; i++) {
+					to[i] = active[i] ? value(i) : to[i];
+				}
+			}
+		}
+
+		void copy(const Slot* from, Slot* to) {
+			assign(to, [=](size_t i) { return from[i]; });
+		}
+
+		template<typename T, typename ExecutionFunction>
+		void binary(ExecutionFunction func) {
+			const Slot* a = column(--sp);
+			Slot* b = column(sp - 1);
+			assign(b, [=](size_t i) { return stackmachine::toSlot(func(fromSlot<T>(b[i]), fromSlot<T>(a[i]))); });
+		}
+
+		template<typename T, typename ExecutionFunction>
+		void unary(ExecutionFunction func, T operand) {
+			Slot* a = column(sp - 1);
+			assign(a, [=](size_t i) { return stackmachine::toSlot(func(fromSlot<T>(a[i]), operand)); });
+		}
+
+		// The other lanes can hold anything, only the current group is checked and divided
+		template<typename T>
+		void division() {
+			const Slot* a = column(--sp);
+			Slot* b = column(sp - 1);
+			for (size_t i = 0; i < width; i++) {
+				if (active[i] and (fromSlot<T>(a[i]) == 0)) {
+					throw ex::Exception("Division through zero");
+				}
+			}
+			for (size_t i = 0; i < width; i++) {
+				if (active[i]) {
+					b[i] = stackmachine::toSlot(fromSlot<T>(b[i]) / fromSlot<T>(a[i]));
+				}
+			}
+		}
+
+		// LOAD_LOCAL, LOAD_LITERAL, OP
+		template<typename ExecutionFunction>
+		void localLiteral(const base::Operation& op, ExecutionFunction func) {
+			const Slot* local = column(op.side_unsignedData());
+			const base::sm_int literal = fromSlot<base::sm_int>(literals[op.unsignedData()]);
+			assign(column(sp++), [=](size_t i) { return stackmachine::toSlot(func(fromSlot<base::sm_int>(local[i]), literal)); });
+		}
+
+		// LOAD_LOCAL, LOAD_LOCAL, OP
+		template<typename ExecutionFunction>
+		void localLocal(const base::Operation& op, ExecutionFunction func) {
+			const Slot* a = column(op.side_unsignedData());
+			const Slot* b = column(op.unsignedData());
+			assign(column(sp++), [=](size_t i) { return stackmachine::toSlot(func(fromSlot<base::sm_int>(a[i]), fromSlot<base::sm_int>(b[i]))); });
+		}
+
+		template<typename ExecutionFunction>
+		void storeLocal(const base::Operation& op, ExecutionFunction func) {
+			const Slot* a = column(--sp);
+			const Slot* b = column(--sp);
+			assign(column(op.unsignedData()), [=](size_t i) { return stackmachine::toSlot(func(fromSlot<base::sm_int>(b[i]), fromSlot<base::sm_int>(a[i]))); });
+		}
+
+		// LOAD_LOCAL a, INCR, STORE_LOCAL a
+		template<typename ExecutionFunction>
+		void inPlaceLocal(const base::Operation& op, ExecutionFunction func) {
+			Slot* local = column(op.unsignedData());
+			assign(local, [=](size_t i) { return stackmachine::toSlot(func(fromSlot<base::sm_int>(local[i]), base::sm_int(1))); });
+		}
+
+		// Splits the current group by the condition, the rows where it's false continue at the jump target
+		bool branch(const Layout& layout, const Slot* condition, size_t& pc) {
+			Mask jumping(width);
+			size_t jumpingRows = 0;
+			for (size_t i = 0; i < width; i++) {
+				jumping[i] = active[i] & (condition[i] == 0);
+				jumpingRows += jumping[i];
+			}
+
+			const size_t target = base::jumpTarget(program.bytecode, pc);
+			if (jumpingRows == activeRows) {
+				wait(target);
+				return resume(layout, pc);
+			}
+			if (jumpingRows > 0) {
+				for (size_t i = 0; i < width; i++) {
+					active[i] &= !jumping[i];
+				}
+				activeRows -= jumpingRows;
+				join(waiting[target], jumping);
+			}
+			pc++;
+			if (!waiting.empty() and (waiting.begin()->first < pc)) {
+				wait(pc);
+				return resume(layout, pc);
+			}
+			return true;
+		}
+
+		// The current group stops at the operation until it's the lowest one with rows waiting
+		void wait(size_t at) {
+			if (activeRows > 0) {
+				join(waiting[at], active);
+				std::fill(active.begin(), active.end(), 0);
+				activeRows = 0;
+			}
+		}
+
+		// Continues with the group at the lowest operation, false when all rows are finished
+		bool resume(const Layout& layout, size_t& pc) {
+			assert(activeRows == 0);
+			if (waiting.empty()) {
+				assert(finishedRows == width);
+				return false;
+			}
+			pc = waiting.begin()->first;
+			active = std::move(waiting.begin()->second);
+			waiting.erase(waiting.begin());
+			activeRows = std::count(active.begin(), active.begin() + width, 1);
+			sp = layout.depths[pc];
+			return true;
+		}
+
+		void join(const Mask& rows) {
+			join(active, rows);
+			activeRows = std::count(active.begin(), active.begin() + width, 1);
+		}
+
+		void join(Mask& into, const Mask& rows) {
+			into.resize(blockRows);
+			for (size_t i = 0; i < width; i++) {
+				into[i] |= rows[i];
+			}
+		}
+	};
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+#include "src/Base/Program.h"
+
+namespace stackmachine {
+	using PcType = std::vector<base::Operation>::const_iterator;
+
+	/* The data stack and the call frames of a stack machine, Value is one slot of the stack. The machines
+	*  check the stack a call needs before they enter it, nothing here checks for an overflow. */
+	template<typename Value>
+	class CallStack {
+	protected:
+		/* One record per active call. The base of the current frame is cached in frameBase,
+		*  the record keeps the base of the caller */
+		struct Frame {
+			PcType returnPc;
+			Value* base;
+			uint32_t functionId; // bytecode index of the first operation of the called function
+		};
+
+		explicit CallStack(size_t maxStackDepth)
+			: dataStack(maxStackDepth) {
+			sp = dataStack.data();
+			frameBase = dataStack.data();
+			frames.reserve(64);
+			stackEnd = dataStack.data() + dataStack.size();
+		}
+
+		std::vector<Frame> frames;
+		Value* frameBase; // first slot of the current function, the globals outside of functions
+		std::vector<Value> dataStack; // only the values below sp are alive
+		Value* sp; // next free slot
+		Value* stackEnd;
+		PcType pc;
+
+		size_t stackSize() const {
+			return sp - dataStack.data();
+		}
+
+		void push(const Value& value) {
+			assert(sp < stackEnd); // guaranteed by the check in CALL_FUNCTION
+			*sp++ = value;
+		}
+
+		Value pop() {
+			assert(sp > dataStack.data());
+			return *--sp;
+		}
+
+		Value& top() {
+			assert(sp > dataStack.data());
+			return sp[-1];
+		}
+
+		Value& localVariable(size_t relativeOffset) {
+			assert(frameBase + relativeOffset < sp);
+			return frameBase[relativeOffset];
+		}
+
+		// The entry of the function the call at pc jumps to
+		uint32_t calledFunction(PcType begin) const {
+			return static_cast<uint32_t>(pc - begin + pc->signedData() + 1);
+		}
+
+		// The arguments on top of the stack become the first locals of the called function
+		void enterFunction(PcType begin) {
+			frames.push_back({ pc, frameBase, calledFunction(begin) });
+			frameBase = sp - pc->side_unsignedData();
+			pc += pc->signedData();
+		}
+
+		// Moves the arguments over the current frame and enters the called function, the caller stays the same
+		void tailCall(PcType begin) {
+			const uint16_t params = pc->side_unsignedData();
+			Value* const arguments = sp - params;
+			for (uint16_t i = 0; i < params; i++) {
+				frameBase[i] = arguments[i];
+			}
+			sp = frameBase + params;
+			frames.back().functionId = calledFunction(begin);
+			pc += pc->signedData();
+		}
+
+		void endFunction() {
+			const Frame& frame = frames.back();
+			pc = frame.returnPc;
+			sp = frameBase;
+			frameBase = frame.base;
+			frames.pop_back();
+		}
+	};
+}
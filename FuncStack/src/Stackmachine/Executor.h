@@ -0,0 +1,218 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "Stackmachine.h"
+
+namespace stackmachine {
+	/* A fixed pool of threads that runs function calls of independent programs, see StackMachine::call().
+	*  Every worker has a deque of its own: it takes its newest job from the back, idle workers steal the
+	*  oldest ones from the front of the others. Machines are kept per worker and program and reused,
+	*  their stacks are allocated once. It also runs the chunks of a pfor, see StackMachine::enableParallelFor(). */
+	class Executor : public ChunkRunner {
+	public:
+		static constexpr size_t machinesPerWorker = 8; // programs a worker keeps a machine for
+
+		// With a hotThreshold the machines of the workers compile hot functions, see StackMachine::enableJit()
+		explicit Executor(size_t threads = std::max(1u, std::thread::hardware_concurrency()), std::optional<size_t> hotThreshold = std::nullopt)
+			: hotThreshold(hotThreshold) {
+			if (threads == 0) {
+				throw ex::Exception("An executor needs at least one thread");
+			}
+			for (size_t i = 0; i < threads; i++) {
+				workers.push_back(std::make_unique<Worker>());
+			}
+			for (size_t i = 0; i < threads; i++) {
+				workers[i]->thread = std::thread(&Executor::work, this, i);
+			}
+		}
+
+		Executor(const Executor&) = delete;
+		Executor& operator=(const Executor&) = delete;
+
+		// Runs every job that got submitted before it returns
+		~Executor() {
+			{
+				std::lock_guard<std::mutex> lock(sleepMutex);
+				stopping = true;
+			}
+			wakeUp.notify_all();
+			for (std::unique_ptr<Worker>& worker : workers) {
+				worker->thread.join();
+			}
+		}
+
+		// The future holds the return value, or the exception the call ended with
+		std::future<std::optional<base::BasicType>> submit(base::SharedProgram program, size_t entry, std::vector<base::BasicType> arguments) {
+			const std::shared_ptr<std::promise<std::optional<base::BasicType>>> result = std::make_shared<std::promise<std::optional<base::BasicType>>>();
+			std::future<std::optional<base::BasicType>> future = result->get_future();
+			enqueue({ checkedImage(std::move(program)), [=, arguments = std::move(arguments)](StackMachine& machine) {
+				try {
+					result->set_value(machine.call(entry, arguments));
+				} catch (...) {
+					result->set_exception(std::current_exception());
+				}
+			}, [=](std::exception_ptr error) { result->set_exception(error); } });
+			return future;
+		}
+
+		// The function is picked by its name and the types of the arguments
+		std::future<std::optional<base::BasicType>> submit(base::SharedProgram program, const std::string& function, std::vector<base::BasicType> arguments) {
+			const base::Program& image = *checkedImage(program);
+			std::vector<base::TypeIndex> params;
+			for (const base::BasicType& argument : arguments) {
+				params.push_back(argument.typeId());
+			}
+			const base::FunctionSignature* signature = image.function(function, params);
+			if (signature == nullptr) {
+				throw ex::Exception("Unknown function: " + function);
+			}
+			return submit(std::move(program), signature->entry, std::move(arguments));
+		}
+
+		size_t size() const override {
+			return workers.size();
+		}
+
+		void runAll(const base::SharedProgram& program, std::vector<Task> tasks) override {
+			std::vector<std::future<void>> done;
+			for (Task& task : tasks) {
+				const std::shared_ptr<std::promise<void>> result = std::make_shared<std::promise<void>>();
+				done.push_back(result->get_future());
+				enqueue({ checkedImage(program), [=, task = std::move(task)](StackMachine& machine) {
+					try {
+						task(machine);
+						result->set_value();
+					} catch (...) {
+						result->set_exception(std::current_exception());
+					}
+				}, [=](std::exception_ptr error) { result->set_exception(error); } });
+			}
+
+			// the tasks may use the stack of the caller, none can still run when the first error gets thrown
+			for (std::future<void>& future : done) {
+				future.wait();
+			}
+			for (std::future<void>& future : done) {
+				future.get();
+			}
+		}
+
+	private:
+		struct Job {
+			base::SharedProgram program;
+			Task run; // reports its result itself
+			std::function<void(std::exception_ptr)> fail; // no machine for the program
+		};
+
+		struct Worker {
+			std::mutex mutex; // guards jobs, the other members belong to the thread
+			std::deque<Job> jobs;
+			std::vector<std::unique_ptr<StackMachine>> machines; // most recently used last
+			std::thread thread;
+		};
+
+		std::vector<std::unique_ptr<Worker>> workers;
+		std::atomic<size_t> nextWorker = 0;
+		const std::optional<size_t> hotThreshold;
+
+		std::mutex sleepMutex; // guards stopping and the changes of queued that idle workers wait for
+		std::condition_variable wakeUp;
+		std::atomic<size_t> queued = 0; // jobs in all deques together, counted before they get pushed
+		bool stopping = false;
+
+		// Counted before it's published, a worker that takes it right away must not bring queued below 0
+		void enqueue(Job job) {
+			Worker& worker = *workers[nextWorker++ % workers.size()];
+			{
+				std::lock_guard<std::mutex> lock(sleepMutex);
+				queued++;
+			}
+			{
+				std::lock_guard<std::mutex> lock(worker.mutex);
+				worker.jobs.push_back(std::move(job));
+			}
+			wakeUp.notify_one();
+		}
+
+		void work(size_t self) {
+			while (true) {
+				std::optional<Job> job = take(self);
+				if (job.has_value()) {
+					run(*workers[self], job.value());
+					continue;
+				}
+
+				std::unique_lock<std::mutex> lock(sleepMutex);
+				wakeUp.wait(lock, [&]() { return (queued > 0) or stopping; });
+				if (stopping and (queued == 0)) {
+					return;
+				}
+			}
+		}
+
+		// The newest job of its own deque, or the oldest one of another worker
+		std::optional<Job> take(size_t self) {
+			for (size_t i = 0; i < workers.size(); i++) {
+				Worker& victim = *workers[(self + i) % workers.size()];
+				std::lock_guard<std::mutex> lock(victim.mutex);
+				if (victim.jobs.empty()) {
+					continue;
+				}
+
+				std::optional<Job> job;
+				if (i == 0) {
+					job = std::move(victim.jobs.back());
+					victim.jobs.pop_back();
+				} else {
+					job = std::move(victim.jobs.front());
+					victim.jobs.pop_front();
+				}
+				assert(queued > 0);
+				queued--;
+				return job;
+			}
+			return {};
+		}
+
+		void run(Worker& worker, Job& job) {
+			StackMachine* machine = nullptr;
+			try {
+				machine = &machineFor(worker, job.program);
+			} catch (...) {
+				job.fail(std::current_exception());
+				return;
+			}
+			job.run(*machine);
+		}
+
+		StackMachine& machineFor(Worker& worker, const base::SharedProgram& program) {
+			const auto cached = std::find_if(worker.machines.begin(), worker.machines.end(), [&](const std::unique_ptr<StackMachine>& machine) {
+				return machine->getProgram() == program;
+			});
+			if (cached != worker.machines.end()) {
+				std::rotate(cached, cached + 1, worker.machines.end());
+			} else {
+				if (worker.machines.size() == machinesPerWorker) {
+					worker.machines.erase(worker.machines.begin());
+				}
+				worker.machines.push_back(std::make_unique<StackMachine>(program));
+				if (hotThreshold.has_value()) {
+					worker.machines.back()->enableJit(hotThreshold.value());
+				}
+			}
+			return *worker.machines.back();
+		}
+	};
+}
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "src/Base/Program.h"
+
+namespace stackmachine {
+	/* Execution counts of a StackMachine built with SM_INSTRUMENTATION: every dispatched operation by its OpCode,
+	*  every pair of operations that ran one after the other and every bytecode index. An operation that pauses
+	*  exec(budget) is counted again when it resumes, native code of the JIT isn't counted at all. */
+	class Instrumentation {
+	public:
+		static constexpr size_t opCodes = static_cast<size_t>(base::OpCode::END_ENUM_OPCODE);
+
+		explicit Instrumentation(const base::Bytecode& bytecode)
+			: bytecode(bytecode), opCounts(opCodes), pairCounts(opCodes * opCodes), indexCounts(bytecode.size()) {}
+
+		void count(size_t index, base::OpCode opCode) {
+			const size_t op = static_cast<size_t>(opCode);
+			opCounts[op]++;
+			if (previous < opCodes) {
+				pairCounts[previous * opCodes + op]++;
+			}
+			previous = op;
+			indexCounts[index]++;
+		}
+
+		uint64_t executions(base::OpCode opCode) const {
+			return opCounts[static_cast<size_t>(opCode)];
+		}
+
+		// How often second ran directly after first
+		uint64_t executions(base::OpCode first, base::OpCode second) const {
+			return pairCounts[static_cast<size_t>(first) * opCodes + static_cast<size_t>(second)];
+		}
+
+		uint64_t hits(size_t index) const {
+			return indexCounts[index];
+		}
+
+		// Executed operations per source line of the program, [0] are the ones of generated code and of bytecode without lines
+		std::vector<uint64_t> lineHits(const base::Program& program) const {
+			std::vector<uint64_t> lines(1);
+			for (size_t i = 0; i < indexCounts.size(); i++) {
+				const base::SourceLine* line = program.sourceLine(i);
+				const size_t lineNumber = (line != nullptr) ? line->line : 0;
+				if (lineNumber >= lines.size()) {
+					lines.resize(lineNumber + 1);
+				}
+				lines[lineNumber] += indexCounts[i];
+			}
+			return lines;
+		}
+
+		// The source the program was compiled from, every line prefixed with the operations it executed
+		std::string lineReport(const base::Program& program, const std::string& source) const {
+			const std::vector<uint64_t> lines = lineHits(program);
+			std::ostringstream stream;
+			std::istringstream text(source);
+			std::string sourceLine;
+			for (size_t lineNumber = 1; std::getline(text, sourceLine); lineNumber++) {
+				const uint64_t count = (lineNumber < lines.size()) ? lines[lineNumber] : 0;
+				stream << std::setw(12) << std::right << ((count > 0) ? std::to_string(count) : "") << " | " << std::setw(4) << lineNumber << " | " << sourceLine << "\n";
+			}
+			stream << std::setw(12) << std::right << lines[0] << " | generated code\n";
+			return stream.str();
+		}
+
+		void reset() {
+			std::fill(opCounts.begin(), opCounts.end(), 0);
+			std::fill(pairCounts.begin(), pairCounts.end(), 0);
+			std::fill(indexCounts.begin(), indexCounts.end(), 0);
+			previous = opCodes;
+		}
+
+		// Only the counts above zero, the OpCodes and pairs with the most executions first
+		std::string toJson() const {
+			std::ostringstream stream;
+			stream << "{\n\t\"opcodes\": [";
+			const char* separator = "\n";
+			for (const auto& [count, op] : sortedOps()) {
+				stream << separator << "\t\t{ \"op\": " << quoted(op) << ", \"count\": " << count << " }";
+				separator = ",\n";
+			}
+			stream << "\n\t],\n\t\"pairs\": [";
+			separator = "\n";
+			for (const auto& [count, pair] : sortedPairs()) {
+				stream << separator << "\t\t{ \"first\": " << quoted(pair / opCodes) << ", \"second\": " << quoted(pair % opCodes) << ", \"count\": " << count << " }";
+				separator = ",\n";
+			}
+			stream << "\n\t],\n\t\"indices\": [";
+			separator = "\n";
+			for (size_t i = 0; i < indexCounts.size(); i++) {
+				if (indexCounts[i] > 0) {
+					stream << separator << "\t\t{ \"index\": " << i << ", \"op\": " << quoted(opIndex(i)) << ", \"count\": " << indexCounts[i] << " }";
+					separator = ",\n";
+				}
+			}
+			stream << "\n\t]\n}\n";
+			return stream.str();
+		}
+
+		// One line per count: kind,first,second,index,count with kind opcode, pair or index
+		std::string toCsv() const {
+			std::ostringstream stream;
+			stream << "kind,first,second,index,count\n";
+			for (const auto& [count, op] : sortedOps()) {
+				stream << "opcode," << quoted(op) << ",,," << count << "\n";
+			}
+			for (const auto& [count, pair] : sortedPairs()) {
+				stream << "pair," << quoted(pair / opCodes) << "," << quoted(pair % opCodes) << ",," << count << "\n";
+			}
+			for (size_t i = 0; i < indexCounts.size(); i++) {
+				if (indexCounts[i] > 0) {
+					stream << "index," << quoted(opIndex(i)) << ",," << i << "," << indexCounts[i] << "\n";
+				}
+			}
+			return stream.str();
+		}
+
+		std::string toString() const {
+			std::ostringstream stream;
+			stream << "OpCodes:\n";
+			for (const auto& [count, op] : sortedOps()) {
+				stream << std::setw(12) << std::right << count << " | " << name(op) << "\n";
+			}
+			stream << "\nPairs:\n";
+			for (const auto& [count, pair] : sortedPairs()) {
+				stream << std::setw(12) << std::right << count << " | " << name(pair / opCodes) << " -> " << name(pair % opCodes) << "\n";
+			}
+			stream << "\nByteCode:\n";
+			for (size_t i = 0; i < indexCounts.size(); i++) {
+				stream << std::setw(12) << std::right << indexCounts[i] << " | " << std::setw(3) << i << " | " << name(opIndex(i)) << "\n";
+			}
+			return stream.str();
+		}
+
+	private:
+		const base::Bytecode& bytecode; // belongs to the program of the machine
+		std::vector<uint64_t> opCounts;
+		std::vector<uint64_t> pairCounts; // first * opCodes + second
+		std::vector<uint64_t> indexCounts;
+		size_t previous = opCodes; // none before the first operation
+
+		size_t opIndex(size_t index) const {
+			return static_cast<size_t>(bytecode[index].getOpCode());
+		}
+
+		static std::string name(size_t op) {
+			return base::opCodeName(static_cast<base::OpCode>(op)).str;
+		}
+
+		// Names like "," or "<literal>" need quotes in both formats, none of them contains a quote or backslash
+		static std::string quoted(size_t op) {
+			return "\"" + name(op) + "\"";
+		}
+
+		static std::vector<std::pair<uint64_t, size_t>> sortedCounts(const std::vector<uint64_t>& counts) {
+			std::vector<std::pair<uint64_t, size_t>> sorted;
+			for (size_t i = 0; i < counts.size(); i++) {
+				if (counts[i] > 0) {
+					sorted.emplace_back(counts[i], i);
+				}
+			}
+			std::stable_sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+			return sorted;
+		}
+
+		std::vector<std::pair<uint64_t, size_t>> sortedOps() const {
+			return sortedCounts(opCounts);
+		}
+
+		std::vector<std::pair<uint64_t, size_t>> sortedPairs() const {
+			return sortedCounts(pairCounts);
+		}
+	};
+}
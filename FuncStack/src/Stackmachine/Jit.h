@@ -0,0 +1,677 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "src/Base/Program.h"
+#include "src/Base/BytecodeAnalysis.h"
+#include "src/Utils/Utils.h"
+#include "src/Exception.h"
+
+// The JIT emits x86-64 machine code, every other target only has the interpreter
+#if (defined(__x86_64__) || defined(_M_X64)) && !defined(SM_NO_JIT)
+#define SM_JIT 1
+#else
+#define SM_JIT 0
+#endif
+
+#if SM_JIT
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+#endif
+
+namespace stackmachine::jit {
+#if SM_JIT
+	// Filled while it's writable, then switched to read and execute
+	class ExecutableMemory {
+	public:
+		explicit ExecutableMemory(const std::vector<uint8_t>& code) : size(code.size()) {
+#ifdef _WIN32
+			memory = VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+			if (memory == nullptr) {
+				throw ex::Exception("Can't allocate executable memory");
+			}
+			std::memcpy(memory, code.data(), size);
+			DWORD oldProtection;
+			if (!VirtualProtect(memory, size, PAGE_EXECUTE_READ, &oldProtection)) {
+				VirtualFree(memory, 0, MEM_RELEASE);
+				throw ex::Exception("Can't make memory executable");
+			}
+#else
+			memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (memory == MAP_FAILED) {
+				throw ex::Exception("Can't allocate executable memory");
+			}
+			std::memcpy(memory, code.data(), size);
+			if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+				munmap(memory, size);
+				throw ex::Exception("Can't make memory executable");
+			}
+#endif
+		}
+
+		ExecutableMemory(const ExecutableMemory&) = delete;
+		ExecutableMemory& operator=(const ExecutableMemory&) = delete;
+
+		~ExecutableMemory() {
+#ifdef _WIN32
+			VirtualFree(memory, 0, MEM_RELEASE);
+#else
+			munmap(memory, size);
+#endif
+		}
+
+		const void* data() const {
+			return memory;
+		}
+
+	private:
+		void* memory;
+		size_t size;
+	};
+
+#endif
+
+	/* Shared between the trampoline and the generated code. A function that fails sets error and returns,
+	*  every caller returns as well as soon as it sees it. */
+	struct Context {
+		int64_t error;
+		int64_t* slotLimit; // end of the slots the called function may use
+		uintptr_t hostStackLimit; // the generated code calls itself recursively on the native stack
+	};
+
+	// int64_t trampoline(int64_t* slots, Context* context)
+	using Trampoline = int64_t(*)(int64_t*, Context*);
+
+	class ExecutableMemory;
+
+	struct NativeFunction {
+		std::shared_ptr<ExecutableMemory> memory;
+		Trampoline code;
+		std::vector<base::TypeIndex> params;
+		std::optional<base::TypeIndex> returnType;
+	};
+
+#if SM_JIT
+	/* Only what the generated code needs. rbx points to slot 0 of the current frame, every value on the
+	*  stack of the interpreter is one 64 bit slot, r12 holds the Context. */
+	class Assembler {
+	public:
+		void bytes(std::initializer_list<uint8_t> values) {
+			code.insert(code.end(), values);
+		}
+
+		void int32(int32_t value) {
+			append(value);
+		}
+
+		void int64(int64_t value) {
+			append(value);
+		}
+
+		// [rbx + 8 * slot] as the memory operand of the instruction that starts with prefix
+		void slotOperand(std::initializer_list<uint8_t> prefix, uint8_t modRegRm, size_t slot) {
+			bytes(prefix);
+			bytes({ modRegRm });
+			int32(static_cast<int32_t>(slot * sizeof(int64_t)));
+		}
+
+		void loadRax(size_t slot) { slotOperand({ 0x48, 0x8B }, 0x83, slot); } // mov rax, [rbx + d]
+		void loadRcx(size_t slot) { slotOperand({ 0x48, 0x8B }, 0x8B, slot); } // mov rcx, [rbx + d]
+		void storeRax(size_t slot) { slotOperand({ 0x48, 0x89 }, 0x83, slot); } // mov [rbx + d], rax
+
+		void store(size_t slot, int32_t value) { // mov qword [rbx + d], imm32
+			slotOperand({ 0x48, 0xC7 }, 0x83, slot);
+			int32(value);
+		}
+
+		void movRcx(int64_t value) { // mov rcx, imm64
+			bytes({ 0x48, 0xB9 });
+			int64(value);
+		}
+
+		void movRax(int64_t value) { // mov rax, imm64
+			bytes({ 0x48, 0xB8 });
+			int64(value);
+		}
+
+		// Flags of 'rax - operand' as 0 or 1 in rax, setcc al + movzx eax, al
+		void setRax(uint8_t setcc) {
+			bytes({ 0x0F, setcc, 0xC0, 0x0F, 0xB6, 0xC0 });
+		}
+
+		// Jumps and calls to labels that are not known yet, opcode ends right before the rel32
+		void jump(std::initializer_list<uint8_t> opcode, size_t label) {
+			bytes(opcode);
+			fixups.emplace_back(code.size(), label);
+			int32(0);
+		}
+
+		size_t newLabel() {
+			labels.push_back(0);
+			return labels.size() - 1;
+		}
+
+		void bind(size_t label) {
+			labels[label] = code.size();
+		}
+
+		std::vector<uint8_t> finish() {
+			for (const auto& [at, label] : fixups) {
+				const int32_t relative = static_cast<int32_t>(labels[label]) - static_cast<int32_t>(at + sizeof(int32_t));
+				std::memcpy(code.data() + at, &relative, sizeof(relative));
+			}
+			return std::move(code);
+		}
+
+	private:
+		std::vector<uint8_t> code;
+		std::vector<size_t> labels;
+		std::vector<std::pair<size_t, size_t>> fixups;
+
+		template<typename T>
+		void append(T value) {
+			uint8_t raw[sizeof(T)];
+			std::memcpy(raw, &value, sizeof(T));
+			code.insert(code.end(), std::begin(raw), std::end(raw));
+		}
+	};
+
+	namespace opcodes {
+		constexpr uint8_t sete = 0x94;
+		constexpr uint8_t setne = 0x95;
+		constexpr uint8_t setl = 0x9C;
+		constexpr uint8_t setg = 0x9F;
+	}
+
+	/* Translates a function and every function it calls into one block of machine code, the values stay in
+	*  the same slots the interpreter would use. Functions that touch globals or anything but int and bool
+	*  are not compiled, their calls stay in the interpreter. */
+	class FunctionCompiler {
+	public:
+		FunctionCompiler(const base::Program& program, const base::StackDepths& depths)
+			: program(program), depths(depths) {}
+
+		std::optional<NativeFunction> compile(size_t entry) {
+			const base::FunctionSignature* signature = program.function(entry);
+			if ((signature == nullptr) or !collectClosure(entry)) {
+				return std::nullopt;
+			}
+
+			failLabel = assembler.newLabel();
+			returnLabel = assembler.newLabel();
+			emitTrampoline();
+			for (size_t function : closure) {
+				emitFunction(function);
+			}
+			emitStubs();
+
+			NativeFunction native;
+			native.memory = std::make_shared<ExecutableMemory>(assembler.finish());
+			native.code = reinterpret_cast<Trampoline>(const_cast<void*>(native.memory->data()));
+			native.params = signature->params;
+			native.returnType = signature->returnType;
+			return native;
+		}
+
+	private:
+		const base::Program& program;
+		const base::StackDepths& depths;
+		Assembler assembler;
+		std::vector<size_t> closure; // entries of all functions that end up in the block
+		std::map<size_t, size_t> functionLabels;
+		std::map<size_t, size_t> operationLabels;
+		size_t failLabel = 0;
+		size_t returnLabel = 0;
+
+		static bool isSupportedType(base::TypeIndex type) {
+			return (type == base::TypeIndex::Int) or (type == base::TypeIndex::Bool);
+		}
+
+		std::vector<size_t> body(size_t entry) const {
+			std::vector<size_t> operations;
+			for (size_t i = 0; i < program.bytecode.size(); i++) {
+				if (depths.depth(i).has_value() and (depths.owner(i) == entry)) {
+					operations.push_back(i);
+				}
+			}
+			return operations;
+		}
+
+		bool collectClosure(size_t root) {
+			std::vector<size_t> open = { root };
+			while (!open.empty()) {
+				const size_t entry = open.back();
+				open.pop_back();
+				if (functionLabels.count(entry) > 0) {
+					continue;
+				}
+
+				const base::FunctionSignature* signature = program.function(entry);
+				if ((signature == nullptr) or (depths.allFunctions().count(entry) == 0)) {
+					return false;
+				}
+				if (!std::all_of(signature->params.begin(), signature->params.end(), isSupportedType)) {
+					return false;
+				}
+				if (signature->returnType.has_value() and !isSupportedType(signature->returnType.value())) {
+					return false;
+				}
+
+				for (size_t i : body(entry)) {
+					if (!isSupported(program.bytecode[i])) {
+						return false;
+					}
+					operationLabels[i] = assembler.newLabel();
+					if (base::isCall(program.bytecode[i].getOpCode())) {
+						open.push_back(base::jumpTarget(program.bytecode, i));
+					}
+				}
+				functionLabels[entry] = assembler.newLabel();
+				closure.push_back(entry);
+			}
+			return true;
+		}
+
+		bool isLiteral(size_t index) const {
+			return (index < program.literals.size()) and isSupportedType(program.literals[index].typeId());
+		}
+
+		bool isSupported(const base::Operation& op) const {
+			switch (op.getOpCode()) {
+				case base::OpCode::LOAD_LITERAL:
+					return isLiteral(op.unsignedData());
+				case base::OpCode::CREATE_VARIABLE:
+					return isSupportedType(static_cast<base::TypeIndex>(op.unsignedData()));
+				case base::OpCode::ADD_LOCAL_LITERAL_INT:
+				case base::OpCode::SUB_LOCAL_LITERAL_INT:
+				case base::OpCode::MULT_LOCAL_LITERAL_INT:
+				case base::OpCode::EQ_LOCAL_LITERAL_INT:
+				case base::OpCode::UNEQ_LOCAL_LITERAL_INT:
+				case base::OpCode::LESS_LOCAL_LITERAL_INT:
+				case base::OpCode::BIGGER_LOCAL_LITERAL_INT:
+					return isLiteral(op.unsignedData());
+				case base::OpCode::LOAD_LOCAL:
+				case base::OpCode::STORE_LOCAL:
+				case base::OpCode::POP:
+				case base::OpCode::JUMP:
+				case base::OpCode::JUMP_IF_NOT:
+				case base::OpCode::CALL_FUNCTION:
+				case base::OpCode::TAIL_CALL:
+				case base::OpCode::RETURN:
+				case base::OpCode::END_FUNCTION:
+				case base::OpCode::ADD_INT:
+				case base::OpCode::SUB_INT:
+				case base::OpCode::MULT_INT:
+				case base::OpCode::DIV_INT:
+				case base::OpCode::INCR_INT:
+				case base::OpCode::DECR_INT:
+				case base::OpCode::EQ_INT:
+				case base::OpCode::UNEQ_INT:
+				case base::OpCode::LESS_INT:
+				case base::OpCode::BIGGER_INT:
+				case base::OpCode::EQ_BOOL:
+				case base::OpCode::UNEQ_BOOL:
+				case base::OpCode::EQ_LOCAL_LOCAL_INT:
+				case base::OpCode::UNEQ_LOCAL_LOCAL_INT:
+				case base::OpCode::LESS_LOCAL_LOCAL_INT:
+				case base::OpCode::BIGGER_LOCAL_LOCAL_INT:
+				case base::OpCode::ADD_INT_STORE_LOCAL:
+				case base::OpCode::SUB_INT_STORE_LOCAL:
+				case base::OpCode::MULT_INT_STORE_LOCAL:
+				case base::OpCode::INCR_LOCAL_INT:
+				case base::OpCode::DECR_LOCAL_INT:
+					return true;
+				default:
+					return false;
+			}
+		}
+
+		int64_t literal(size_t index) const {
+			const base::BasicType& value = program.literals[index];
+			return (value.typeId() == base::TypeIndex::Bool) ? value.getUnchecked<base::sm_bool>() : value.getUnchecked<base::sm_int>();
+		}
+
+		// push rbx; push r12; sub rsp, 8; rbx = slots; r12 = context; call root; add rsp, 8; pop r12; pop rbx; ret
+		void emitTrampoline() {
+			assembler.bytes({ 0x53, 0x41, 0x54, 0x48, 0x83, 0xEC, 0x08 });
+#ifdef _WIN32
+			assembler.bytes({ 0x48, 0x89, 0xCB, 0x49, 0x89, 0xD4 }); // rcx, rdx
+#else
+			assembler.bytes({ 0x48, 0x89, 0xFB, 0x49, 0x89, 0xF4 }); // rdi, rsi
+#endif
+			assembler.jump({ 0xE8 }, functionLabels.at(closure.front()));
+			assembler.bytes({ 0x48, 0x83, 0xC4, 0x08, 0x41, 0x5C, 0x5B, 0xC3 });
+		}
+
+		void emitStubs() {
+			assembler.bind(failLabel);
+			assembler.bytes({ 0x49, 0xC7, 0x04, 0x24 }); // mov qword [r12], 1
+			assembler.int32(1);
+			assembler.bind(returnLabel);
+			assembler.bytes({ 0xC3 });
+		}
+
+		void emitFunction(size_t entry) {
+			// the frame has to fit into the slots and the recursion into the native stack
+			assembler.bind(functionLabels.at(entry));
+			assembler.slotOperand({ 0x48, 0x8D }, 0x83, depths.function(entry).maxDepth); // lea rax, [rbx + d]
+			assembler.bytes({ 0x49, 0x3B, 0x44, 0x24, 0x08 }); // cmp rax, [r12 + 8]
+			assembler.jump({ 0x0F, 0x87 }, failLabel); // ja
+			assembler.bytes({ 0x49, 0x3B, 0x64, 0x24, 0x10 }); // cmp rsp, [r12 + 16]
+			assembler.jump({ 0x0F, 0x82 }, failLabel); // jb
+
+			// the operations of the body in bytecode order, falling through works like in the interpreter
+			for (size_t i : body(entry)) {
+				assembler.bind(operationLabels.at(i));
+				emitOperation(i, depths.depth(i).value());
+			}
+		}
+
+		void jumpTo(std::initializer_list<uint8_t> opcode, size_t target) {
+			assembler.jump(opcode, operationLabels.at(target));
+		}
+
+		// Slots a and b combined into a, the destination of the typed operations
+		void binary(size_t depth, std::initializer_list<uint8_t> opcode) {
+			assembler.loadRax(depth - 2);
+			assembler.slotOperand(opcode, 0x83, depth - 1);
+			assembler.storeRax(depth - 2);
+		}
+
+		void compare(size_t depth, uint8_t setcc) {
+			assembler.loadRax(depth - 2);
+			assembler.slotOperand({ 0x48, 0x3B }, 0x83, depth - 1); // cmp rax, [b]
+			assembler.setRax(setcc);
+			assembler.storeRax(depth - 2);
+		}
+
+		// rax = local <op> literal, pushed
+		void localLiteral(const base::Operation& op, size_t depth, std::initializer_list<uint8_t> raxRcx) {
+			assembler.loadRax(op.side_unsignedData());
+			assembler.movRcx(literal(op.unsignedData()));
+			assembler.bytes(raxRcx);
+			assembler.storeRax(depth);
+		}
+
+		void compareLocalLiteral(const base::Operation& op, size_t depth, uint8_t setcc) {
+			assembler.loadRax(op.side_unsignedData());
+			assembler.movRcx(literal(op.unsignedData()));
+			assembler.bytes({ 0x48, 0x39, 0xC8 }); // cmp rax, rcx
+			assembler.setRax(setcc);
+			assembler.storeRax(depth);
+		}
+
+		void compareLocalLocal(const base::Operation& op, size_t depth, uint8_t setcc) {
+			assembler.loadRax(op.side_unsignedData());
+			assembler.slotOperand({ 0x48, 0x3B }, 0x83, op.unsignedData());
+			assembler.setRax(setcc);
+			assembler.storeRax(depth);
+		}
+
+		void storeLocal(const base::Operation& op, size_t depth, std::initializer_list<uint8_t> opcode) {
+			assembler.loadRax(depth - 2);
+			assembler.slotOperand(opcode, 0x83, depth - 1);
+			assembler.storeRax(op.unsignedData());
+		}
+
+		// add/sub qword [slot], 1
+		void inPlace(size_t slot, uint8_t modRegRm) {
+			assembler.slotOperand({ 0x48, 0x81 }, modRegRm, slot);
+			assembler.int32(1);
+		}
+
+		void moveFrame(uint8_t modRegRm, size_t slots) { // add/sub rbx, 8 * slots
+			if (slots > 0) {
+				assembler.bytes({ 0x48, 0x81, modRegRm });
+				assembler.int32(static_cast<int32_t>(slots * sizeof(int64_t)));
+			}
+		}
+
+		void emitOperation(size_t index, size_t depth) {
+			const base::Operation& op = program.bytecode[index];
+			switch (op.getOpCode()) {
+				case base::OpCode::POP:
+					break; // the depth of every operation is known
+				case base::OpCode::LOAD_LITERAL:
+					assembler.movRax(literal(op.unsignedData()));
+					assembler.storeRax(depth);
+					break;
+				case base::OpCode::CREATE_VARIABLE:
+					assembler.store(depth, 0);
+					break;
+				case base::OpCode::LOAD_LOCAL:
+					assembler.loadRax(op.unsignedData());
+					assembler.storeRax(depth);
+					break;
+				case base::OpCode::STORE_LOCAL:
+					assembler.loadRax(depth - 1);
+					assembler.storeRax(op.unsignedData());
+					break;
+				case base::OpCode::JUMP:
+					jumpTo({ 0xE9 }, base::jumpTarget(program.bytecode, index));
+					break;
+				case base::OpCode::JUMP_IF_NOT:
+					assembler.loadRax(depth - 1);
+					assembler.bytes({ 0x48, 0x85, 0xC0 }); // test rax, rax
+					jumpTo({ 0x0F, 0x84 }, base::jumpTarget(program.bytecode, index)); // je
+					break;
+				case base::OpCode::CALL_FUNCTION:
+				{
+					const size_t frame = depth - op.side_unsignedData();
+					const size_t callee = base::jumpTarget(program.bytecode, index);
+					moveFrame(0xC3, frame);
+					assembler.jump({ 0xE8 }, functionLabels.at(callee));
+					moveFrame(0xEB, frame);
+					assembler.bytes({ 0x49, 0x83, 0x3C, 0x24, 0x00 }); // cmp qword [r12], 0
+					assembler.jump({ 0x0F, 0x85 }, returnLabel); // jne
+					if (depths.function(callee).returnsValue) {
+						assembler.storeRax(frame);
+					}
+					break;
+				}
+				case base::OpCode::TAIL_CALL:
+				{
+					const size_t arguments = depth - op.side_unsignedData();
+					for (size_t i = 0; (arguments > 0) and (i < op.side_unsignedData()); i++) { // copied upwards like in the interpreter
+						assembler.loadRax(arguments + i);
+						assembler.storeRax(i);
+					}
+					assembler.jump({ 0xE9 }, functionLabels.at(base::jumpTarget(program.bytecode, index)));
+					break;
+				}
+				case base::OpCode::RETURN:
+					if (op.unsignedData() > 0) {
+						assembler.loadRax(depth - 1);
+					} else {
+						assembler.bytes({ 0x31, 0xC0 }); // xor eax, eax
+					}
+					assembler.bytes({ 0xC3 });
+					break;
+				case base::OpCode::END_FUNCTION:
+					assembler.bytes({ 0x31, 0xC0, 0xC3 });
+					break;
+				case base::OpCode::ADD_INT:
+					binary(depth, { 0x48, 0x03 });
+					break;
+				case base::OpCode::SUB_INT:
+					binary(depth, { 0x48, 0x2B });
+					break;
+				case base::OpCode::MULT_INT:
+					binary(depth, { 0x48, 0x0F, 0xAF });
+					break;
+				case base::OpCode::DIV_INT:
+					// the interpreter throws, it gets the call back and throws the same error
+					assembler.loadRcx(depth - 1);
+					assembler.bytes({ 0x48, 0x85, 0xC9 }); // test rcx, rcx
+					assembler.jump({ 0x0F, 0x84 }, failLabel);
+					assembler.loadRax(depth - 2);
+					assembler.bytes({ 0x48, 0x99, 0x48, 0xF7, 0xF9 }); // cqo; idiv rcx
+					assembler.storeRax(depth - 2);
+					break;
+				case base::OpCode::INCR_INT:
+					inPlace(depth - 1, 0x83);
+					break;
+				case base::OpCode::DECR_INT:
+					inPlace(depth - 1, 0xAB);
+					break;
+				case base::OpCode::EQ_INT:
+				case base::OpCode::EQ_BOOL:
+					compare(depth, opcodes::sete);
+					break;
+				case base::OpCode::UNEQ_INT:
+				case base::OpCode::UNEQ_BOOL:
+					compare(depth, opcodes::setne);
+					break;
+				case base::OpCode::LESS_INT:
+					compare(depth, opcodes::setl);
+					break;
+				case base::OpCode::BIGGER_INT:
+					compare(depth, opcodes::setg);
+					break;
+				case base::OpCode::ADD_LOCAL_LITERAL_INT:
+					localLiteral(op, depth, { 0x48, 0x01, 0xC8 });
+					break;
+				case base::OpCode::SUB_LOCAL_LITERAL_INT:
+					localLiteral(op, depth, { 0x48, 0x29, 0xC8 });
+					break;
+				case base::OpCode::MULT_LOCAL_LITERAL_INT:
+					localLiteral(op, depth, { 0x48, 0x0F, 0xAF, 0xC1 });
+					break;
+				case base::OpCode::EQ_LOCAL_LITERAL_INT:
+					compareLocalLiteral(op, depth, opcodes::sete);
+					break;
+				case base::OpCode::UNEQ_LOCAL_LITERAL_INT:
+					compareLocalLiteral(op, depth, opcodes::setne);
+					break;
+				case base::OpCode::LESS_LOCAL_LITERAL_INT:
+					compareLocalLiteral(op, depth, opcodes::setl);
+					break;
+				case base::OpCode::BIGGER_LOCAL_LITERAL_INT:
+					compareLocalLiteral(op, depth, opcodes::setg);
+					break;
+				case base::OpCode::EQ_LOCAL_LOCAL_INT:
+					compareLocalLocal(op, depth, opcodes::sete);
+					break;
+				case base::OpCode::UNEQ_LOCAL_LOCAL_INT:
+					compareLocalLocal(op, depth, opcodes::setne);
+					break;
+				case base::OpCode::LESS_LOCAL_LOCAL_INT:
+					compareLocalLocal(op, depth, opcodes::setl);
+					break;
+				case base::OpCode::BIGGER_LOCAL_LOCAL_INT:
+					compareLocalLocal(op, depth, opcodes::setg);
+					break;
+				case base::OpCode::ADD_INT_STORE_LOCAL:
+					storeLocal(op, depth, { 0x48, 0x03 });
+					break;
+				case base::OpCode::SUB_INT_STORE_LOCAL:
+					storeLocal(op, depth, { 0x48, 0x2B });
+					break;
+				case base::OpCode::MULT_INT_STORE_LOCAL:
+					storeLocal(op, depth, { 0x48, 0x0F, 0xAF });
+					break;
+				case base::OpCode::INCR_LOCAL_INT:
+					inPlace(op.unsignedData(), 0x83);
+					break;
+				case base::OpCode::DECR_LOCAL_INT:
+					inPlace(op.unsignedData(), 0xAB);
+					break;
+				default:
+					throw ex::Exception("Operation not supported by the JIT: "s + opCodeName(op.getOpCode()));
+			}
+		}
+	};
+#endif
+
+	/* Counts the calls of every function and compiles it once it got called hotThreshold times.
+	*  Compiled functions only see copies of their arguments and no globals, so a call that fails in
+	*  native code (stack overflow, division through zero) can be repeated by the interpreter. */
+	class JitCompiler {
+	public:
+		static constexpr size_t defaultHotThreshold = 1000;
+		static constexpr size_t hostStackBudget = 256 * 1024; // bytes of the native stack the recursion may use
+
+		JitCompiler(base::SharedProgram toCompile, size_t hotThreshold, size_t maxStackDepth)
+			: image(std::move(toCompile)), depths(image->bytecode), states(image->bytecode.size()), hotThreshold(hotThreshold), slots(maxStackDepth) {}
+
+		// The compiled function, nullptr while it's not hot or can't be compiled
+		const NativeFunction* hit(size_t entry) {
+			State& state = states[entry];
+			if (state.native or state.failed) {
+				return state.native.get();
+			}
+			if (++state.calls < hotThreshold) {
+				return nullptr;
+			}
+
+#if SM_JIT
+			std::optional<NativeFunction> native = FunctionCompiler(*image, depths).compile(entry);
+			if (native.has_value()) {
+				state.native = std::make_unique<NativeFunction>(std::move(native.value()));
+				return state.native.get();
+			}
+#endif
+			state.failed = true;
+			return nullptr;
+		}
+
+		/* Runs the function on the arguments, freeSlots counts from the first argument like the frame the
+		*  interpreter would create. Nothing if the interpreter has to execute the call itself. */
+		std::optional<base::BasicType> run(const NativeFunction& function, std::span<const base::BasicType> arguments, size_t freeSlots) {
+#if SM_JIT
+			for (size_t i = 0; i < arguments.size(); i++) {
+				if (arguments[i].typeId() != function.params[i]) {
+					return std::nullopt;
+				}
+				slots[i] = (function.params[i] == base::TypeIndex::Bool) ? arguments[i].getUnchecked<base::sm_bool>() : arguments[i].getUnchecked<base::sm_int>();
+			}
+
+			const char stackMarker = 0;
+			Context context{ 0, slots.data() + std::min(freeSlots, slots.size()), reinterpret_cast<uintptr_t>(&stackMarker) - hostStackBudget };
+			const int64_t result = function.code(slots.data(), &context);
+			if (context.error != 0) {
+				return std::nullopt;
+			}
+
+			if (function.returnType == base::TypeIndex::Bool) {
+				return base::BasicType(result != 0);
+			}
+			return base::BasicType(static_cast<base::sm_int>(result));
+#else
+			return std::nullopt;
+#endif
+		}
+
+		bool isCompiled(size_t entry) const {
+			return states[entry].native != nullptr;
+		}
+
+	private:
+		struct State {
+			size_t calls = 0;
+			bool failed = false;
+			std::unique_ptr<NativeFunction> native;
+		};
+
+		const base::SharedProgram image;
+		const base::StackDepths depths;
+		std::vector<State> states; // indexed by the entry of the function
+		const size_t hotThreshold;
+		std::vector<int64_t> slots;
+	};
+}
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Stackmachine.h"
+
+// The timer is a SIGPROF of setitimer(), other targets can build the code but can't start a Profiler
+#if defined(__unix__) || defined(__APPLE__)
+#define SM_PROFILER 1
+#include <signal.h>
+#include <sys/time.h>
+#else
+#define SM_PROFILER 0
+#endif
+
+namespace stackmachine {
+	/* Samples a running StackMachine: a SIGPROF timer counts the cpu time of the process and asks the machine
+	*  for a sample every interval. The signal handler only sets Sampler::due, the machine takes the sample on
+	*  its next call or backward jump, where pc and the frames are consistent. Each sample is the call chain,
+	*  named by the functions of the program, and the bytecode index it was taken at.
+	*  Only one Profiler can run at a time. Time spent in native code of the JIT is sampled at the next call
+	*  the interpreter makes, the functions inlined by the compiler have no frame of their own. */
+	class Profiler : public Sampler {
+	public:
+		static constexpr std::chrono::microseconds defaultInterval{ 10'000 }; // 100 samples per second of cpu time
+
+		// The machine has to outlive the Profiler
+		explicit Profiler(StackMachine& machine, [[maybe_unused]] std::chrono::microseconds interval = defaultInterval)
+			: machine(machine), program(*machine.getProgram()), indexSamples(program.bytecode.size()) {
+#if SM_PROFILER
+			if (interval.count() <= 0) {
+				throw ex::Exception("The sampling interval has to be positive");
+			}
+			Profiler* expected = nullptr;
+			if (!active.compare_exchange_strong(expected, this)) {
+				throw ex::Exception("Only one Profiler can run at a time");
+			}
+			installHandler();
+			machine.enableSampling(this);
+
+			itimerval timer{};
+			timer.it_interval.tv_sec = static_cast<time_t>(interval.count() / 1'000'000);
+			timer.it_interval.tv_usec = static_cast<suseconds_t>(interval.count() % 1'000'000);
+			timer.it_value = timer.it_interval;
+			setitimer(ITIMER_PROF, &timer, nullptr);
+#else
+			throw ex::Exception("The Profiler needs SIGPROF");
+#endif
+		}
+
+		Profiler(const Profiler&) = delete;
+		Profiler& operator=(const Profiler&) = delete;
+
+		~Profiler() {
+			stop();
+		}
+
+		// The samples stay, the machine runs on without sampling
+		void stop() {
+#if SM_PROFILER
+			if (active.load() != this) {
+				return;
+			}
+			const itimerval off{};
+			setitimer(ITIMER_PROF, &off, nullptr);
+			machine.enableSampling(nullptr);
+			active = nullptr;
+#endif
+		}
+
+		void sample(const StackMachine& sampled) override {
+			std::string stack;
+			for (size_t entry : sampled.callChain()) {
+				if (!stack.empty()) {
+					stack += ';';
+				}
+				stack += functionName(entry);
+			}
+			if (stack.empty()) {
+				stack = "<global>"; // the code outside of functions
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			stacks[stack]++;
+			indexSamples[sampled.currentOperation()]++;
+			sampleCount++;
+		}
+
+		uint64_t samples() const {
+			std::lock_guard<std::mutex> lock(mutex);
+			return sampleCount;
+		}
+
+		// Samples taken while the operation at the bytecode index was next
+		uint64_t samples(size_t index) const {
+			std::lock_guard<std::mutex> lock(mutex);
+			return indexSamples[index];
+		}
+
+		/* One line per call chain, the outermost function first: "main;fib;fib 12". The format of
+		*  stackcollapse, flamegraph.pl and speedscope read it directly. */
+		std::string toFolded() const {
+			std::lock_guard<std::mutex> lock(mutex);
+			std::ostringstream stream;
+			for (const auto& [stack, count] : stacks) {
+				stream << stack << " " << count << "\n";
+			}
+			return stream.str();
+		}
+
+	private:
+		inline static std::atomic<Profiler*> active = nullptr;
+
+		StackMachine& machine;
+		const base::Program& program;
+
+		mutable std::mutex mutex; // sample() runs on the thread of the machine, the results are read from anywhere
+		std::map<std::string, uint64_t> stacks;
+		std::vector<uint64_t> indexSamples;
+		uint64_t sampleCount = 0;
+
+		// Overloads are told apart by their parameters, a name can't contain the ';' of the folded format
+		std::string functionName(size_t entry) const {
+			const base::FunctionSignature* function = program.function(entry);
+			if (function == nullptr) {
+				return "?";
+			}
+			if (std::count_if(program.functions.begin(), program.functions.end(), [&](const base::FunctionSignature& f) { return f.name == function->name; }) == 1) {
+				return function->name;
+			}
+			std::string name = function->name + "(";
+			for (size_t i = 0; i < function->params.size(); i++) {
+				if (i > 0) {
+					name += ',';
+				}
+				name += base::typeName(function->params[i]);
+			}
+			return name + ")";
+		}
+
+#if SM_PROFILER
+		// Stays installed after the last Profiler, a late SIGPROF would end the process with the default action
+		static void installHandler() {
+			static std::once_flag installed;
+			std::call_once(installed, []() {
+				struct sigaction action {};
+				action.sa_handler = &Profiler::onSignal;
+				action.sa_flags = SA_RESTART;
+				sigemptyset(&action.sa_mask);
+				sigaction(SIGPROF, &action, nullptr);
+			});
+		}
+
+		// Only lock free atomics, that's all a signal handler may touch
+		static void onSignal(int) {
+			Profiler* profiler = active.load(std::memory_order_relaxed);
+			if (profiler != nullptr) {
+				profiler->due.store(true, std::memory_order_relaxed);
+			}
+		}
+#endif
+	};
+}
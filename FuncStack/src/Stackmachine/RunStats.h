@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <sstream>
+#include <string>
+
+namespace stackmachine {
+	/* Counters of one run of a StackMachine built with SM_STATS, from the start of exec() or call() to its end.
+	*  A run that exec(budget) pauses goes on counting when it resumes. Native code of the JIT isn't counted,
+	*  its calls only by the call that entered it. */
+	struct RunStats {
+		uint64_t instructions = 0; // dispatched operations
+		uint64_t calls = 0; // CALL_FUNCTION, TAIL_CALL, SPAWN and PFOR
+		uint64_t maxStackDepth = 0; // used slots of the data stack, the globals included
+		uint64_t maxCallDepth = 0; // active calls
+		uint64_t literalLoads = 0; // LOAD_LITERAL and the fused operations that read a literal
+		uint64_t stackReallocations = 0; // the data stack grew to a new buffer
+
+		std::string toJson() const {
+			std::ostringstream stream;
+			stream << "{\n";
+			stream << "\t\"instructions\": " << instructions << ",\n";
+			stream << "\t\"calls\": " << calls << ",\n";
+			stream << "\t\"maxStackDepth\": " << maxStackDepth << ",\n";
+			stream << "\t\"maxCallDepth\": " << maxCallDepth << ",\n";
+			stream << "\t\"literalLoads\": " << literalLoads << ",\n";
+			stream << "\t\"stackReallocations\": " << stackReallocations << "\n";
+			stream << "}\n";
+			return stream.str();
+		}
+	};
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <deque>
+#include <memory>
+
+#include "Stackmachine.h"
+
+namespace stackmachine {
+	/* Runs many scripts on one StackMachine, each one a fiber with a small stack of its own. A fiber runs until
+	*  it yields, ends or used up its slice, then the next one continues. Functions started with 'spawn' become
+	*  fibers of the same Scheduler and share the globals of their script, so a script never leaves the
+	*  Scheduler it started on. Not thread safe, one Scheduler per thread multiplexes any number of scripts. */
+	class Scheduler {
+	public:
+		static constexpr size_t defaultSlice = 10'000; // operations per turn, see StackMachine::exec(budget)
+
+		explicit Scheduler(base::SharedProgram program, size_t slice = defaultSlice, DispatchMode dispatchMode = DispatchMode::Switch, size_t maxStackDepth = StackMachine::defaultStackDepth)
+			: machine(std::move(program), dispatchMode, maxStackDepth), slice(slice) {
+		}
+
+		// Queues another run of the program, its globals can be read from the fiber once it finished
+		std::shared_ptr<const StackMachine::Fiber> spawn() {
+			ready.push_back(machine.createFiber());
+			return ready.back();
+		}
+
+		// Runs until every fiber finished. An error only ends the fiber that caused it, see Fiber::getError()
+		void run() {
+			while (!ready.empty()) {
+				std::shared_ptr<StackMachine::Fiber> fiber = std::move(ready.front());
+				ready.pop_front();
+
+				ExecState state = ExecState::Finished;
+				try {
+					state = machine.resume(fiber, slice);
+				} catch (const std::exception&) {
+					// kept in the fiber
+				}
+
+				for (std::shared_ptr<StackMachine::Fiber>& spawned : machine.takeSpawned()) {
+					ready.push_back(std::move(spawned));
+				}
+				if (state == ExecState::Paused) {
+					ready.push_back(std::move(fiber));
+				}
+			}
+		}
+
+		// Fibers that didn't finish yet
+		size_t size() const {
+			return ready.size();
+		}
+
+	private:
+		StackMachine machine;
+		const size_t slice;
+		std::deque<std::shared_ptr<StackMachine::Fiber>> ready;
+	};
+}
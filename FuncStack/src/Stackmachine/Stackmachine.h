@@ -1,234 +1,1266 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <limits>
 #include <list>
+#include <map>
+#include <memory>
+#include <optional>
+#include <span>
 #include <sstream>
+#include <utility>
 #include <vector>
 
 #include "src/Base/Program.h"
+#include "src/Base/BytecodeAnalysis.h"
 #include "src/Utils/Utils.h"
 #include "src/Exception.h"
+#include "CallStack.h"
+#include "Jit.h"
+#include "Instrumentation.h"
+#include "Trace.h"
+#include "RunStats.h"
+
+// Computed goto ("labels as values") is a GCC/Clang extension, everything else uses the portable switch
+#if defined(__GNUC__) && !defined(SM_NO_THREADED_DISPATCH)
+#define SM_THREADED_DISPATCH 1
+#else
+#define SM_THREADED_DISPATCH 0
+#endif
 
 namespace stackmachine {
-	class StackMachine {
+	enum class DispatchMode {
+		Switch, // one switch per operation, the default as Threaded isn't faster on every benchmark, see test/Benchmarks/Dispatch.h
+		Threaded // every handler jumps directly to the next one, falls back to Switch if not supported
+	};
+
+	enum class ExecState {
+		Finished, // END_PROGRAM was reached
+		Paused // the budget ran out, the next exec() continues where this one stopped
+	};
+
+	// The operation at bytecode index i with its decoded data
+	inline std::string operationToString(const base::Program& program, int64_t i) {
+		std::ostringstream stream;
+		const base::Operation& op = program.bytecode[i];
+		base::OpCode opCode = op.getOpCode();
+		const int64_t value = op.signedData();
+
+		stream << std::setw(20) << std::left << opCodeName(opCode) << " ";
+		switch (opCode) {
+			case base::OpCode::CREATE_VARIABLE:
+				stream << value << " (" << idToString(static_cast<base::TypeIndex>(value)) << ")";
+				break;
+			case base::OpCode::JUMP: // fallthrough
+			case base::OpCode::JUMP_IF_NOT:
+				stream << value << " -> " << (i + value);
+				break;
+			case base::OpCode::LOAD_LITERAL:
+				stream << value << " (" << program.literals[value].toString() << ")";
+				break;
+			case base::OpCode::CALL_FUNCTION: // fallthrough
+			case base::OpCode::TAIL_CALL: // fallthrough
+			case base::OpCode::SPAWN: // fallthrough
+			case base::OpCode::PFOR:
+				stream << op.side_unsignedData() << " params; jump " << value << " -> " << (i + value);
+				break;
+			case base::OpCode::ADD_LOCAL_LITERAL_INT: // fallthrough
+			case base::OpCode::SUB_LOCAL_LITERAL_INT: // fallthrough
+			case base::OpCode::MULT_LOCAL_LITERAL_INT: // fallthrough
+			case base::OpCode::EQ_LOCAL_LITERAL_INT: // fallthrough
+			case base::OpCode::UNEQ_LOCAL_LITERAL_INT: // fallthrough
+			case base::OpCode::LESS_LOCAL_LITERAL_INT: // fallthrough
+			case base::OpCode::BIGGER_LOCAL_LITERAL_INT:
+				stream << "local " << op.side_unsignedData() << ", literal " << value << " (" << program.literals[value].toString() << ")";
+				break;
+			case base::OpCode::EQ_LOCAL_LOCAL_INT: // fallthrough
+			case base::OpCode::UNEQ_LOCAL_LOCAL_INT: // fallthrough
+			case base::OpCode::LESS_LOCAL_LOCAL_INT: // fallthrough
+			case base::OpCode::BIGGER_LOCAL_LOCAL_INT:
+				stream << "local " << op.side_unsignedData() << ", local " << value;
+				break;
+			case base::OpCode::ADD_INT_STORE_LOCAL: // fallthrough
+			case base::OpCode::SUB_INT_STORE_LOCAL: // fallthrough
+			case base::OpCode::MULT_INT_STORE_LOCAL: // fallthrough
+			case base::OpCode::INCR_LOCAL_INT: // fallthrough
+			case base::OpCode::DECR_LOCAL_INT: // fallthrough
+			case base::OpCode::END_SCOPE: // fallthrough
+			case base::OpCode::STORE_LOCAL: // fallthrough
+			case base::OpCode::LOAD_LOCAL: // fallthrough
+			case base::OpCode::POP:
+				stream << value;
+				break;
+		}
+		return stream.str();
+	}
+
+	inline std::string literalsToString(const base::Program& program) {
+		std::ostringstream stream;
+		for (int i = 0; i < program.literals.size(); i++) {
+			stream << std::setw(3) << std::right << i << " | " << std::setw(20) << std::left;
+			stream << program.literals[i].toString() << " ";
+			stream << " (" << idToString(program.literals[i].typeId()) << ")\n";
+		}
+		return stream.str();
+	}
+
+	inline std::string bytecodeToString(const base::Program& program) {
+		std::ostringstream stream;
+		for (int i = 0; i < program.bytecode.size(); i++) {
+			stream << std::setw(3) << std::right << i << " | " << operationToString(program, i) << "\n";
+		}
+		return stream.str();
+	}
+
+	// One line per traced operation, the oldest first
+	inline std::string traceToString(const base::Program& program, const std::vector<TraceEntry>& entries) {
+		std::ostringstream stream;
+		stream << " index | stack | calls | operation\n";
+		for (const TraceEntry& entry : entries) {
+			stream << std::setw(6) << std::right << entry.index << " | " << std::setw(5) << entry.stackDepth << " | " << std::setw(5) << entry.callDepth << " | " << operationToString(program, entry.index) << "\n";
+		}
+		return stream.str();
+	}
+
+	/* Free stack slots every CALL_FUNCTION needs for the frame of the called function, indexed by the
+	*  position of the call. Checking them once per call makes the overflow check on every push unnecessary.
+	*  A TAIL_CALL replaces the current frame, its need is counted from the frame base instead of sp.
+	*  A SPAWN needs the same on top of the arguments for the stack of the new fiber, a PFOR calls its chunk function. */
+	inline std::vector<uint32_t> callStackNeeds(const base::Bytecode& bytecode, const base::StackDepths& depths) {
+		std::vector<uint32_t> needs(bytecode.size(), 0);
+		for (size_t i = 0; i < bytecode.size(); i++) {
+			if (base::entersFunction(bytecode[i].getOpCode()) and depths.depth(i).has_value()) {
+				const base::StackDepths::Function& function = depths.function(base::jumpTarget(bytecode, i));
+				const bool tailCall = bytecode[i].getOpCode() == base::OpCode::TAIL_CALL;
+				needs[i] = static_cast<uint32_t>(tailCall ? function.maxDepth : function.maxDepth - function.params);
+			}
+		}
+		return needs;
+	}
+
+	/* Budget every call takes from exec(budget), indexed by the position of the call: the length of the
+	*  called function. Together with the loop length a backward JUMP takes, only calls and backward jumps
+	*  have to look at the budget, straight code in between is always shorter than what got charged. */
+	inline std::vector<uint32_t> callFuelCosts(const base::Bytecode& bytecode, const base::StackDepths& depths) {
+		std::vector<uint32_t> functionLengths(bytecode.size(), 0);
+		for (size_t i = 0; i < bytecode.size(); i++) {
+			if (depths.owner(i) != base::StackDepths::topLevel) {
+				functionLengths[depths.owner(i)]++;
+			}
+		}
+
+		std::vector<uint32_t> costs(bytecode.size(), 0);
+		for (size_t i = 0; i < bytecode.size(); i++) {
+			if (base::entersFunction(bytecode[i].getOpCode())) {
+				costs[i] = std::max<uint32_t>(functionLengths[base::jumpTarget(bytecode, i)], 1);
+			}
+		}
+		return costs;
+	}
+
+	inline base::SharedProgram checkedImage(base::SharedProgram image) {
+		if (image == nullptr) {
+			throw ex::Exception("No program to execute");
+		}
+		return image;
+	}
+
+	class StackMachine;
+
+	/* Runs tasks on other threads, each with a machine of its own for the program, see enableParallelFor().
+	*  Implemented by the Executor. */
+	class ChunkRunner {
+	public:
+		using Task = std::function<void(StackMachine&)>;
+
+		virtual ~ChunkRunner() = default;
+
+		virtual size_t size() const = 0; // threads
+
+		// Returns after every task ended, rethrows the first error
+		virtual void runAll(const base::SharedProgram& program, std::vector<Task> tasks) = 0;
+	};
+
+	/* Gets the machine to look at once it asked for it with due, see enableSampling(). The machine only checks
+	*  on calls and backward jumps, so the sample is taken at the next of them. Implemented by the Profiler. */
+	class Sampler {
+	public:
+		std::atomic<bool> due = false; // set from anywhere, even a signal handler, cleared by the machine
+
+		virtual void sample(const StackMachine& machine) = 0;
+
+	protected:
+		~Sampler() = default;
+	};
+
+	class StackMachine : private CallStack<base::BasicType> {
 	public:
-		StackMachine(base::Program toExecute)
-			: program(std::move(toExecute)) {
+		static constexpr size_t defaultStackDepth = 1 << 16;
+		static constexpr size_t chunksPerThread = 4; // a PFOR makes more chunks than threads, the runner balances them
+
+		StackMachine(base::Program toExecute, DispatchMode dispatchMode = DispatchMode::Switch, size_t maxStackDepth = defaultStackDepth)
+			: StackMachine(base::freeze(std::move(toExecute)), dispatchMode, maxStackDepth) {}
+
+		// Shares the program with every other machine that executes it, only the stack belongs to this machine
+		StackMachine(base::SharedProgram toExecute, DispatchMode dispatchMode = DispatchMode::Switch, size_t maxStackDepth = defaultStackDepth)
+			: CallStack(maxStackDepth), stackLimit(maxStackDepth), image(checkedImage(std::move(toExecute))), program(*image), dispatchMode(SM_THREADED_DISPATCH ? dispatchMode : DispatchMode::Switch) {
+			globals = dataStack.data();
 			pc = program.bytecode.begin();
+
+			const base::StackDepths depths(program.bytecode);
+			topLevelStackNeed = depths.topLevelMaxDepth();
+			stackNeeds = callStackNeeds(program.bytecode, depths);
+			fuelCosts = callFuelCosts(program.bytecode, depths);
+		}
+
+		// Functions get compiled to native code after hotThreshold calls, on targets without a JIT nothing changes
+		void enableJit(size_t hotThreshold = jit::JitCompiler::defaultHotThreshold) {
+			jit = std::make_unique<jit::JitCompiler>(image, hotThreshold, stackLimit);
+		}
+
+		bool isJitCompiled(size_t entry) const {
+			return jit and jit->isCompiled(entry);
+		}
+
+		/* Every PFOR splits its range into chunks that the runner executes, the runner has to outlive the machine.
+		*  Without it, and in the machines of the runner, the chunk function runs over the whole range. */
+		void enableParallelFor(ChunkRunner& runner) {
+			parallel = &runner;
+		}
+
+		// nullptr stops the sampling, the sampler has to outlive the machine otherwise
+		void enableSampling(Sampler* newSampler) {
+			sampler = newSampler;
+		}
+
+		// Bytecode index of the operation that runs next
+		size_t currentOperation() const {
+			return pc - program.bytecode.begin();
+		}
+
+		// Entries of the functions of the active calls, the outermost first
+		std::vector<size_t> callChain() const {
+			std::vector<size_t> chain;
+			chain.reserve(frames.size());
+			for (const Frame& frame : frames) {
+				chain.push_back(frame.functionId);
+			}
+			return chain;
 		}
 
 		size_t addVariable(base::BasicType variableValue) {
-			dataStack.push_back(variableValue);
-			return dataStack.size() - 1;
+			push(variableValue);
+			return stackSize() - 1;
 		}
 
 		void setVariable(size_t offset, base::BasicType variableValue) {
-			offset += functionFrames.top();
-			assert(offset < dataStack.size());
-			dataStack[offset] = std::move(variableValue);
+			assert(frameBase + offset < sp);
+			frameBase[offset] = std::move(variableValue);
 		}
 
 		base::BasicType getVariable(size_t relativeOffset) const {
-			const size_t offset = relativeOffset + functionFrames.top();
-			assert(offset < dataStack.size());
-			return dataStack[offset];
+			assert(frameBase + relativeOffset < sp);
+			return frameBase[relativeOffset];
 		}
 
 		void setGlobalVariable(size_t offset, base::BasicType variableValue) {
-			assert(offset < dataStack.size());
+			assert(offset < stackSize());
 			dataStack[offset] = std::move(variableValue);
 		}
 
 		base::BasicType getGlobalVariable(size_t offset) const {
-			assert(offset < dataStack.size());
+			assert(offset < stackSize());
 			return dataStack[offset];
 		}
 
 		size_t size() const {
-			return dataStack.size();
+			return stackSize();
 		}
 
 		void exec() {
-			while (pc->getOpCode() != base::OpCode::END_PROGRAM) {
+			resetStats();
+			start<false>(0);
+		}
+
+		/* Runs about budget operations and pauses, the state stays in the machine until the next call.
+		*  The budget is only looked at on calls and backward jumps, so it can be exceeded by one loop
+		*  iteration or function body. Native code of the JIT runs to its end, charged like the call. */
+		ExecState exec(size_t budget) {
+			if (pc == program.bytecode.begin()) {
+				resetStats(); // a paused run goes on counting
+			}
+			return start<true>(budget);
+		}
+
+		/* Calls a function the way the program calls main, the globals are initialized by the code outside of
+		*  functions first. That code runs only once per machine, every call starts with a copy of its globals.
+		*  Returns the return value of the function, the machine can be reused for the next call. */
+		std::optional<base::BasicType> call(size_t entry, std::span<const base::BasicType> arguments) {
+			const base::FunctionSignature& function = checkedFunction(entry, arguments);
+			if (!declaredGlobals.has_value()) {
+				declaredGlobals = runDeclarations();
+			}
+			return runCall(function, arguments, declaredGlobals.value());
+		}
+
+		// The same with the given values of the globals, they stay on the stack after the call
+		std::optional<base::BasicType> call(size_t entry, std::span<const base::BasicType> arguments, std::span<const base::BasicType> globalValues) {
+			const base::FunctionSignature& function = checkedFunction(entry, arguments);
+			if (globalValues.size() != program.globalTypes.size()) {
+				throw ex::Exception("Wrong number of globals for " + function.name);
+			}
+			return runCall(function, arguments, globalValues);
+		}
+
+		// The globals after the code outside of functions, a copy of the program ends instead of calling main
+		std::vector<base::BasicType> runDeclarations() const {
+			base::Program declarations = program;
+			declarations.bytecode[program.mainCall] = base::Operation(base::OpCode::END_PROGRAM);
+			StackMachine machine(std::move(declarations), DispatchMode::Switch, stackLimit);
+			machine.exec();
+			return std::vector<base::BasicType>(machine.getDataStack().begin(), machine.getDataStack().end());
+		}
+
+		class Fiber;
+
+		// A fiber that runs the whole program, it starts with just the stack the code outside of functions needs
+		std::shared_ptr<Fiber> createFiber() const {
+			std::shared_ptr<Fiber> fiber = std::make_shared<Fiber>();
+			fiber->dataStack.resize(topLevelStackNeed);
+			return fiber;
+		}
+
+		/* Runs the fiber on this machine until it finishes, yields or uses up the budget. An error ends the fiber
+		*  and is kept in it before it gets rethrown. Fibers started by SPAWN wait in takeSpawned(). */
+		ExecState resume(const std::shared_ptr<Fiber>& fiber, size_t budget) {
+			assert((running == nullptr) and !fiber->isFinished());
+			swapState(*fiber);
+			running = fiber;
+			globals = (fiber->root != nullptr) ? fiber->root->dataStack.data() : dataStack.data();
+
+			ExecState state = ExecState::Finished;
+			try {
+				state = start<true>(budget);
+			} catch (...) {
+				fiber->error = std::current_exception();
+			}
+
+			swapState(*fiber);
+			running.reset();
+			globals = dataStack.data();
+			fiber->finished = (state == ExecState::Finished);
+			if (fiber->error) {
+				std::rethrow_exception(fiber->error);
+			}
+			return state;
+		}
+
+		std::vector<std::shared_ptr<Fiber>> takeSpawned() {
+			return std::exchange(spawned, {});
+		}
+
+		DispatchMode getDispatchMode() const {
+			return dispatchMode;
+		}
+
+		const base::SharedProgram& getProgram() const {
+			return image;
+		}
+
+		std::string toString() const {
+			std::ostringstream stream;
+
+			stream << "Literals:\n";
+			stream << literalsToString(program);
+
+			stream << "\nStack:\n";
+			for (int i = 0; i < stackSize(); i++) {
+				stream << std::setw(3) << std::right << i << " | " << std::setw(20) << std::left;
+				stream << dataStack[i].toString() << " ";
+				stream << " (" << idToString(dataStack[i].typeId()) << ")\n";
+			}
+
+			stream << "\nByteCode:\n";
+			stream << bytecodeToString(program);
+#ifdef SM_INSTRUMENTATION
+
+			stream << "\nInstrumentation:\n";
+			stream << instrumentation.toString();
+#endif
+#ifdef SM_STATS
+
+			stream << "\nStats:\n";
+			stream << stats.toJson();
+#endif
+#ifdef SM_TRACE
+
+			stream << "\nTrace:\n";
+			stream << dumpTrace();
+#endif
+
+			return stream.str();
+		}
+
+#ifdef SM_INSTRUMENTATION
+		// Counts of all runs of this machine, reset() starts over
+		Instrumentation& getInstrumentation() {
+			return instrumentation;
+		}
+
+		const Instrumentation& getInstrumentation() const {
+			return instrumentation;
+		}
+
+#endif
+#ifdef SM_STATS
+		// The counters of the last exec() or call(), fibers count into the run of the machine that resumes them
+		const RunStats& getStats() const {
+			return stats;
+		}
+
+#endif
+#ifdef SM_TRACE
+		// The last operations of all runs of this machine, readable from any thread while it runs
+		const Trace& getTrace() const {
+			return trace;
+		}
+
+		// The trace decoded by the disassembler of toString()
+		std::string dumpTrace() const {
+			return traceToString(program, trace.entries());
+		}
+
+		// An exception thrown by exec(), call() or resume() gets the trace written to the stream first, nullptr turns it off
+		void dumpTraceOnError(std::ostream* stream) {
+			traceOnError = stream;
+		}
+
+#endif
+		std::span<const base::BasicType> getDataStack() const {
+			return std::span<const base::BasicType>(dataStack.data(), stackSize());
+		}
+
+	public:
+		/* Everything of a run that is not shared: data stack, frames and pc. All fibers of a Scheduler share
+		*  one program and one machine, resume() swaps the state of a fiber in and out of the machine.
+		*  A fiber started by SPAWN uses the globals of the script that spawned it. */
+		class Fiber {
+		public:
+			bool isFinished() const {
+				return finished or error;
+			}
+
+			std::exception_ptr getError() const {
+				return error;
+			}
+
+			base::BasicType getGlobalVariable(size_t offset) const {
+				assert(offset < sp);
+				return dataStack[offset];
+			}
+
+			// The globals of a script, the return value of a spawned function
+			std::span<const base::BasicType> getDataStack() const {
+				return std::span<const base::BasicType>(dataStack.data(), sp);
+			}
+
+		private:
+			friend class StackMachine;
+
+			std::vector<base::BasicType> dataStack; // grows on demand, see growStack()
+			std::vector<Frame> frames;
+			size_t pc = 0;
+			size_t sp = 0;
+			size_t frameBase = 0;
+			std::shared_ptr<Fiber> root; // the script that owns the globals, nullptr for the script itself
+			bool finished = false;
+			std::exception_ptr error;
+		};
+
+	private:
+		const size_t stackLimit; // the stack of a fiber grows up to it
+		base::BasicType* globals; // bottom of the stack of the running script
+		std::shared_ptr<Fiber> running; // only set during resume()
+		std::vector<std::shared_ptr<Fiber>> spawned;
+		std::optional<std::vector<base::BasicType>> declaredGlobals; // see call()
+		std::map<size_t, uint32_t> entryStackNeeds; // stack a function needs with its parameters, see call()
+		size_t topLevelStackNeed;
+		std::vector<uint32_t> stackNeeds; // see callStackNeeds
+		std::vector<uint32_t> fuelCosts; // see callFuelCosts
+
+		const base::SharedProgram image;
+		const base::Program& program; // *image, read only like for every other machine sharing it
+#ifdef SM_INSTRUMENTATION
+		Instrumentation instrumentation{ program.bytecode };
+#endif
+#ifdef SM_STATS
+		RunStats stats;
+#endif
+#ifdef SM_TRACE
+		Trace trace;
+		std::ostream* traceOnError = nullptr;
+#endif
+
+		const DispatchMode dispatchMode;
+		std::unique_ptr<jit::JitCompiler> jit; // only set after enableJit()
+		size_t nativeFailedDepth = std::numeric_limits<size_t>::max(); // frames.size() at the last call native code failed, see callNative()
+		ChunkRunner* parallel = nullptr; // only set after enableParallelFor()
+		Sampler* sampler = nullptr; // only set after enableSampling()
+
+		// SM_INSTRUMENTATION counts, SM_TRACE records and SM_STATS sums up every dispatched operation, without them nothing of it gets compiled
+		void observe() {
+#ifdef SM_INSTRUMENTATION
+			instrumentation.count(pc - program.bytecode.begin(), pc->getOpCode());
+#endif
+#ifdef SM_TRACE
+			trace.record(pc - program.bytecode.begin(), pc->getOpCode(), sp - dataStack.data(), frames.size());
+#endif
+#ifdef SM_STATS
+			stats.instructions++;
+			switch (pc->getOpCode()) {
+				case base::OpCode::LOAD_LITERAL: // fallthrough
+				case base::OpCode::ADD_LOCAL_LITERAL_INT: // fallthrough
+				case base::OpCode::SUB_LOCAL_LITERAL_INT: // fallthrough
+				case base::OpCode::MULT_LOCAL_LITERAL_INT: // fallthrough
+				case base::OpCode::EQ_LOCAL_LITERAL_INT: // fallthrough
+				case base::OpCode::UNEQ_LOCAL_LITERAL_INT: // fallthrough
+				case base::OpCode::LESS_LOCAL_LITERAL_INT: // fallthrough
+				case base::OpCode::BIGGER_LOCAL_LITERAL_INT:
+					stats.literalLoads++;
+					break;
+				case base::OpCode::CALL_FUNCTION: // fallthrough
+				case base::OpCode::TAIL_CALL: // fallthrough
+				case base::OpCode::SPAWN: // fallthrough
+				case base::OpCode::PFOR:
+					stats.calls++;
+					break;
+			}
+			// the depths an operation leaves behind are seen by the next one, the last operation ends the program
+			stats.maxStackDepth = std::max<uint64_t>(stats.maxStackDepth, sp - dataStack.data());
+			stats.maxCallDepth = std::max<uint64_t>(stats.maxCallDepth, frames.size());
+#endif
+		}
+
+		// The operation at pc didn't run, resuming dispatches and counts it again
+		ExecState pause() {
+#ifdef SM_STATS
+			stats.instructions--;
+			stats.calls -= base::entersFunction(pc->getOpCode()) ? 1 : 0;
+#endif
+			return ExecState::Paused;
+		}
+
+		void resetStats() {
+#ifdef SM_STATS
+			stats = {};
+#endif
+		}
+
+#if defined(SM_INSTRUMENTATION) || defined(SM_TRACE) || defined(SM_STATS)
+#define SM_OBSERVE() observe()
+#else
+#define SM_OBSERVE()
+#endif
+#if SM_THREADED_DISPATCH
+#define SM_HANDLER(op) case base::OpCode::op: label_##op
+#define SM_REGISTER_HANDLER(op) dispatchTable[static_cast<size_t>(base::OpCode::op)] = &&label_##op
+#define SM_NEXT() \
+			if constexpr (mode == DispatchMode::Threaded) { \
+				pc++; \
+				SM_OBSERVE(); \
+				goto *dispatchTable[static_cast<size_t>(pc->getOpCode())]; \
+			} else { \
+				pc++; \
+				continue; \
+			}
+#else
+#define SM_HANDLER(op) case base::OpCode::op
+#define SM_NEXT() pc++; continue
+#endif
+
+		template<bool budgeted>
+		ExecState start(size_t budget) {
+			if (pc == program.bytecode.begin() and topLevelStackNeed > static_cast<size_t>(stackEnd - sp)) {
+				growStack(sp, topLevelStackNeed);
+			}
+
+#ifdef SM_TRACE
+			try {
+				return dispatch<budgeted>(budget);
+			} catch (...) {
+				if (traceOnError != nullptr) {
+					*traceOnError << "Trace:\n" << dumpTrace();
+				}
+				throw;
+			}
+#else
+			return dispatch<budgeted>(budget);
+#endif
+		}
+
+		template<bool budgeted>
+		ExecState dispatch(size_t budget) {
+#if SM_THREADED_DISPATCH
+			if (dispatchMode == DispatchMode::Threaded) {
+				return run<DispatchMode::Threaded, budgeted>(budget);
+			}
+#endif
+			return run<DispatchMode::Switch, budgeted>(budget);
+		}
+
+		/* Both dispatch modes share this body. In Switch mode every handler goes back to the switch,
+		*  in Threaded mode every handler jumps directly into the handler of the next operation.
+		*  Without a budget the fuel checks are compiled out. A pause leaves pc on the operation that
+		*  didn't run yet, resuming dispatches it again. */
+		template<DispatchMode mode, bool budgeted>
+		ExecState run(size_t budget) {
+			[[maybe_unused]] int64_t fuel = static_cast<int64_t>(std::min<size_t>(budget, std::numeric_limits<int64_t>::max()));
+#if SM_THREADED_DISPATCH
+			void* dispatchTable[static_cast<size_t>(base::OpCode::END_ENUM_OPCODE)];
+			std::fill(std::begin(dispatchTable), std::end(dispatchTable), &&label_unknown);
+			SM_REGISTER_HANDLER(POP);
+			SM_REGISTER_HANDLER(LOAD_LITERAL);
+			SM_REGISTER_HANDLER(STORE_LOCAL);
+			SM_REGISTER_HANDLER(LOAD_LOCAL);
+			SM_REGISTER_HANDLER(CREATE_VARIABLE);
+			SM_REGISTER_HANDLER(STORE_GLOBAL);
+			SM_REGISTER_HANDLER(LOAD_GLOBAL);
+			SM_REGISTER_HANDLER(JUMP);
+			SM_REGISTER_HANDLER(JUMP_IF_NOT);
+			SM_REGISTER_HANDLER(PFOR);
+			SM_REGISTER_HANDLER(CALL_FUNCTION);
+			SM_REGISTER_HANDLER(TAIL_CALL);
+			SM_REGISTER_HANDLER(END_FUNCTION);
+			SM_REGISTER_HANDLER(RETURN);
+			SM_REGISTER_HANDLER(SPAWN);
+			SM_REGISTER_HANDLER(YIELD);
+			SM_REGISTER_HANDLER(END_PROGRAM);
+			SM_REGISTER_HANDLER(EQ);
+			SM_REGISTER_HANDLER(UNEQ);
+			SM_REGISTER_HANDLER(LESS);
+			SM_REGISTER_HANDLER(BIGGER);
+			SM_REGISTER_HANDLER(INCR);
+			SM_REGISTER_HANDLER(DECR);
+			SM_REGISTER_HANDLER(ADD);
+			SM_REGISTER_HANDLER(SUB);
+			SM_REGISTER_HANDLER(MULT);
+			SM_REGISTER_HANDLER(DIV);
+			SM_REGISTER_HANDLER(EQ_INT);
+			SM_REGISTER_HANDLER(EQ_UINT);
+			SM_REGISTER_HANDLER(EQ_FLOAT);
+			SM_REGISTER_HANDLER(EQ_BOOL);
+			SM_REGISTER_HANDLER(UNEQ_INT);
+			SM_REGISTER_HANDLER(UNEQ_UINT);
+			SM_REGISTER_HANDLER(UNEQ_FLOAT);
+			SM_REGISTER_HANDLER(UNEQ_BOOL);
+			SM_REGISTER_HANDLER(LESS_INT);
+			SM_REGISTER_HANDLER(LESS_UINT);
+			SM_REGISTER_HANDLER(LESS_FLOAT);
+			SM_REGISTER_HANDLER(BIGGER_INT);
+			SM_REGISTER_HANDLER(BIGGER_UINT);
+			SM_REGISTER_HANDLER(BIGGER_FLOAT);
+			SM_REGISTER_HANDLER(ADD_LOCAL_LITERAL_INT);
+			SM_REGISTER_HANDLER(SUB_LOCAL_LITERAL_INT);
+			SM_REGISTER_HANDLER(MULT_LOCAL_LITERAL_INT);
+			SM_REGISTER_HANDLER(EQ_LOCAL_LITERAL_INT);
+			SM_REGISTER_HANDLER(UNEQ_LOCAL_LITERAL_INT);
+			SM_REGISTER_HANDLER(LESS_LOCAL_LITERAL_INT);
+			SM_REGISTER_HANDLER(BIGGER_LOCAL_LITERAL_INT);
+			SM_REGISTER_HANDLER(EQ_LOCAL_LOCAL_INT);
+			SM_REGISTER_HANDLER(UNEQ_LOCAL_LOCAL_INT);
+			SM_REGISTER_HANDLER(LESS_LOCAL_LOCAL_INT);
+			SM_REGISTER_HANDLER(BIGGER_LOCAL_LOCAL_INT);
+			SM_REGISTER_HANDLER(ADD_INT_STORE_LOCAL);
+			SM_REGISTER_HANDLER(SUB_INT_STORE_LOCAL);
+			SM_REGISTER_HANDLER(MULT_INT_STORE_LOCAL);
+			SM_REGISTER_HANDLER(INCR_LOCAL_INT);
+			SM_REGISTER_HANDLER(DECR_LOCAL_INT);
+			SM_REGISTER_HANDLER(INCR_INT);
+			SM_REGISTER_HANDLER(INCR_UINT);
+			SM_REGISTER_HANDLER(INCR_FLOAT);
+			SM_REGISTER_HANDLER(DECR_INT);
+			SM_REGISTER_HANDLER(DECR_UINT);
+			SM_REGISTER_HANDLER(DECR_FLOAT);
+			SM_REGISTER_HANDLER(ADD_INT);
+			SM_REGISTER_HANDLER(ADD_UINT);
+			SM_REGISTER_HANDLER(ADD_FLOAT);
+			SM_REGISTER_HANDLER(SUB_INT);
+			SM_REGISTER_HANDLER(SUB_UINT);
+			SM_REGISTER_HANDLER(SUB_FLOAT);
+			SM_REGISTER_HANDLER(MULT_INT);
+			SM_REGISTER_HANDLER(MULT_UINT);
+			SM_REGISTER_HANDLER(MULT_FLOAT);
+			SM_REGISTER_HANDLER(DIV_INT);
+			SM_REGISTER_HANDLER(DIV_UINT);
+			SM_REGISTER_HANDLER(DIV_FLOAT);
+#endif
+
+			while (true) {
+				SM_OBSERVE(); // in Threaded mode only the first operation, the others are observed by SM_NEXT
 				switch (pc->getOpCode()) {
 					// ==== META ====
-					case base::OpCode::POP:
-					{
-						uint32_t popCount = pc->unsignedData();
-						for (int i = 0; i < popCount; i++) {
-							dataStack.pop_back();
-						}
-					}
-						break;
-					case base::OpCode::LOAD_LITERAL:
-						dataStack.push_back(program.literals.get(pc->unsignedData()));
-						break;
-					case base::OpCode::STORE_LOCAL:
+					SM_HANDLER(POP):
+						assert(stackSize() >= pc->unsignedData());
+						sp -= pc->unsignedData();
+						SM_NEXT();
+					SM_HANDLER(LOAD_LITERAL):
+						push(program.literals.get(pc->unsignedData()));
+						SM_NEXT();
+					SM_HANDLER(STORE_LOCAL):
 						setVariable(pc->unsignedData(), pop());
-						break;
-					case base::OpCode::LOAD_LOCAL:
-						dataStack.push_back(getVariable(pc->unsignedData()));
-						break;
-					case base::OpCode::CREATE_VARIABLE:
-						dataStack.push_back(base::BasicType::fromId(static_cast<base::TypeIndex>(pc->unsignedData())));
-						break;
-					case base::OpCode::STORE_GLOBAL:
-						setGlobalVariable(pc->unsignedData(), pop());
-						break;
-					case base::OpCode::LOAD_GLOBAL:
-						dataStack.push_back(getGlobalVariable(pc->unsignedData()));
-						break;
-					case base::OpCode::JUMP:
+						SM_NEXT();
+					SM_HANDLER(LOAD_LOCAL):
+						push(getVariable(pc->unsignedData()));
+						SM_NEXT();
+					SM_HANDLER(CREATE_VARIABLE):
+						push(base::BasicType::fromId(static_cast<base::TypeIndex>(pc->unsignedData())));
+						SM_NEXT();
+					SM_HANDLER(STORE_GLOBAL):
+						globals[pc->unsignedData()] = pop();
+						SM_NEXT();
+					SM_HANDLER(LOAD_GLOBAL):
+						push(globals[pc->unsignedData()]);
+						SM_NEXT();
+					SM_HANDLER(JUMP):
+						if constexpr (budgeted) {
+							if (pc->signedData() < 0) {
+								if (fuel <= 0) {
+									return pause();
+								}
+								fuel += pc->signedData();
+							}
+						}
+						if (sampler and (pc->signedData() < 0)) {
+							sampleIfDue();
+						}
 						pc += pc->signedData();
-						break;
-					case base::OpCode::JUMP_IF_NOT:
+						SM_NEXT();
+					SM_HANDLER(JUMP_IF_NOT):
 						if (pop().getBool() == false) {
 							pc += pc->signedData();
 						}
-						break;
-					case base::OpCode::CALL_FUNCTION:
-						pcHistory.push(pc);
-						functionFrames.push(dataStack.size() - pc->side_unsignedData());
-						pc += pc->signedData();
-						break;
-					case base::OpCode::END_FUNCTION:
+						SM_NEXT();
+					SM_HANDLER(PFOR):
+						if (parallel and parallelFor()) {
+							if constexpr (budgeted) {
+								fuel -= fuelCosts[pc - program.bytecode.begin()];
+							}
+							SM_NEXT();
+						}
+						[[fallthrough]]; // the chunk function runs over the whole range
+					SM_HANDLER(CALL_FUNCTION):
+						if constexpr (budgeted) {
+							if (fuel <= 0) {
+								return pause();
+							}
+							fuel -= fuelCosts[pc - program.bytecode.begin()];
+						}
+						if (sampler) {
+							sampleIfDue();
+						}
+						if (stackNeeds[pc - program.bytecode.begin()] > static_cast<size_t>(stackEnd - sp)) {
+							growStack(sp, stackNeeds[pc - program.bytecode.begin()]);
+						}
+						if (!budgeted and jit and callNative()) { // native code runs the call to its end, no budget could stop it
+							SM_NEXT();
+						}
+						enterFunction(program.bytecode.begin());
+						SM_NEXT();
+					SM_HANDLER(TAIL_CALL):
+						if constexpr (budgeted) {
+							if (fuel <= 0) {
+								return pause();
+							}
+							fuel -= fuelCosts[pc - program.bytecode.begin()];
+						}
+						if (sampler) {
+							sampleIfDue();
+						}
+						if (stackNeeds[pc - program.bytecode.begin()] > static_cast<size_t>(stackEnd - frameBase)) {
+							growStack(frameBase, stackNeeds[pc - program.bytecode.begin()]);
+						}
+						tailCall(program.bytecode.begin());
+						SM_NEXT();
+					SM_HANDLER(END_FUNCTION):
 						endFunction();
-						break;
-					case base::OpCode::RETURN:
+						SM_NEXT();
+					SM_HANDLER(RETURN):
 					{
 						base::BasicType returnValue = pop();
 						endFunction();
-						dataStack.push_back(returnValue);
+						push(returnValue);
 					}
-					break;
+					SM_NEXT();
+					SM_HANDLER(SPAWN):
+						spawn();
+						SM_NEXT();
+					SM_HANDLER(YIELD):
+						if constexpr (budgeted) {
+							pc++;
+							return ExecState::Paused;
+						}
+						SM_NEXT();
+					SM_HANDLER(END_PROGRAM):
+						assert(frames.empty());
+						return ExecState::Finished;
 						// ==== COMPARE ====
-					case base::OpCode::EQ:
+					SM_HANDLER(EQ):
 						executeOP(std::equal_to());
-						break;
-					case base::OpCode::UNEQ:
+						SM_NEXT();
+					SM_HANDLER(UNEQ):
 						executeOP(std::not_equal_to());
-						break;
-					case base::OpCode::LESS:
+						SM_NEXT();
+					SM_HANDLER(LESS):
 						executeOP(std::less());
-						break;
-					case base::OpCode::BIGGER:
+						SM_NEXT();
+					SM_HANDLER(BIGGER):
 						executeOP(std::greater());
-						break;
+						SM_NEXT();
 						// ==== MATH ====
-					case base::OpCode::INCR:
+					SM_HANDLER(INCR):
 						executeOP(std::plus(), base::BasicType(1));
-						break;
-					case base::OpCode::DECR:
+						SM_NEXT();
+					SM_HANDLER(DECR):
 						executeOP(std::minus(), base::BasicType(1));
-						break;
-					case base::OpCode::ADD:
+						SM_NEXT();
+					SM_HANDLER(ADD):
 						executeOP(std::plus());
-						break;
-					case base::OpCode::SUB:
+						SM_NEXT();
+					SM_HANDLER(SUB):
 						executeOP(std::minus());
-						break;
-					case base::OpCode::MULT:
+						SM_NEXT();
+					SM_HANDLER(MULT):
 						executeOP(std::multiplies());
-						break;
-					case base::OpCode::DIV:
+						SM_NEXT();
+					SM_HANDLER(DIV):
 						executeOP(std::divides());
-						break;
+						SM_NEXT();
+						// ==== TYPED ====
+					SM_HANDLER(EQ_INT):
+						executeTypedOP<base::sm_int>(std::equal_to());
+						SM_NEXT();
+					SM_HANDLER(EQ_UINT):
+						executeTypedOP<base::sm_uint>(std::equal_to());
+						SM_NEXT();
+					SM_HANDLER(EQ_FLOAT):
+						executeTypedOP<base::sm_float>(std::equal_to());
+						SM_NEXT();
+					SM_HANDLER(EQ_BOOL):
+						executeTypedOP<base::sm_bool>(std::equal_to());
+						SM_NEXT();
+					SM_HANDLER(UNEQ_INT):
+						executeTypedOP<base::sm_int>(std::not_equal_to());
+						SM_NEXT();
+					SM_HANDLER(UNEQ_UINT):
+						executeTypedOP<base::sm_uint>(std::not_equal_to());
+						SM_NEXT();
+					SM_HANDLER(UNEQ_FLOAT):
+						executeTypedOP<base::sm_float>(std::not_equal_to());
+						SM_NEXT();
+					SM_HANDLER(UNEQ_BOOL):
+						executeTypedOP<base::sm_bool>(std::not_equal_to());
+						SM_NEXT();
+					SM_HANDLER(LESS_INT):
+						executeTypedOP<base::sm_int>(std::less());
+						SM_NEXT();
+					SM_HANDLER(LESS_UINT):
+						executeTypedOP<base::sm_uint>(std::less());
+						SM_NEXT();
+					SM_HANDLER(LESS_FLOAT):
+						executeTypedOP<base::sm_float>(std::less());
+						SM_NEXT();
+					SM_HANDLER(BIGGER_INT):
+						executeTypedOP<base::sm_int>(std::greater());
+						SM_NEXT();
+					SM_HANDLER(BIGGER_UINT):
+						executeTypedOP<base::sm_uint>(std::greater());
+						SM_NEXT();
+					SM_HANDLER(BIGGER_FLOAT):
+						executeTypedOP<base::sm_float>(std::greater());
+						SM_NEXT();
+						// ==== SUPERINSTRUCTIONS ====
+					SM_HANDLER(ADD_LOCAL_LITERAL_INT):
+						executeLocalLiteralOP(std::plus());
+						SM_NEXT();
+					SM_HANDLER(SUB_LOCAL_LITERAL_INT):
+						executeLocalLiteralOP(std::minus());
+						SM_NEXT();
+					SM_HANDLER(MULT_LOCAL_LITERAL_INT):
+						executeLocalLiteralOP(std::multiplies());
+						SM_NEXT();
+					SM_HANDLER(EQ_LOCAL_LITERAL_INT):
+						executeLocalLiteralOP(std::equal_to());
+						SM_NEXT();
+					SM_HANDLER(UNEQ_LOCAL_LITERAL_INT):
+						executeLocalLiteralOP(std::not_equal_to());
+						SM_NEXT();
+					SM_HANDLER(LESS_LOCAL_LITERAL_INT):
+						executeLocalLiteralOP(std::less());
+						SM_NEXT();
+					SM_HANDLER(BIGGER_LOCAL_LITERAL_INT):
+						executeLocalLiteralOP(std::greater());
+						SM_NEXT();
+					SM_HANDLER(EQ_LOCAL_LOCAL_INT):
+						executeLocalLocalOP(std::equal_to());
+						SM_NEXT();
+					SM_HANDLER(UNEQ_LOCAL_LOCAL_INT):
+						executeLocalLocalOP(std::not_equal_to());
+						SM_NEXT();
+					SM_HANDLER(LESS_LOCAL_LOCAL_INT):
+						executeLocalLocalOP(std::less());
+						SM_NEXT();
+					SM_HANDLER(BIGGER_LOCAL_LOCAL_INT):
+						executeLocalLocalOP(std::greater());
+						SM_NEXT();
+					SM_HANDLER(ADD_INT_STORE_LOCAL):
+						executeStoreLocalOP(std::plus());
+						SM_NEXT();
+					SM_HANDLER(SUB_INT_STORE_LOCAL):
+						executeStoreLocalOP(std::minus());
+						SM_NEXT();
+					SM_HANDLER(MULT_INT_STORE_LOCAL):
+						executeStoreLocalOP(std::multiplies());
+						SM_NEXT();
+					SM_HANDLER(INCR_LOCAL_INT):
+						executeInPlaceLocalOP(std::plus());
+						SM_NEXT();
+					SM_HANDLER(DECR_LOCAL_INT):
+						executeInPlaceLocalOP(std::minus());
+						SM_NEXT();
+					SM_HANDLER(INCR_INT):
+						executeTypedOP<base::sm_int>(std::plus(), 1);
+						SM_NEXT();
+					SM_HANDLER(INCR_UINT):
+						executeTypedOP<base::sm_uint>(std::plus(), 1);
+						SM_NEXT();
+					SM_HANDLER(INCR_FLOAT):
+						executeTypedOP<base::sm_float>(std::plus(), 1);
+						SM_NEXT();
+					SM_HANDLER(DECR_INT):
+						executeTypedOP<base::sm_int>(std::minus(), 1);
+						SM_NEXT();
+					SM_HANDLER(DECR_UINT):
+						executeTypedOP<base::sm_uint>(std::minus(), 1);
+						SM_NEXT();
+					SM_HANDLER(DECR_FLOAT):
+						executeTypedOP<base::sm_float>(std::minus(), 1);
+						SM_NEXT();
+					SM_HANDLER(ADD_INT):
+						executeTypedOP<base::sm_int>(std::plus());
+						SM_NEXT();
+					SM_HANDLER(ADD_UINT):
+						executeTypedOP<base::sm_uint>(std::plus());
+						SM_NEXT();
+					SM_HANDLER(ADD_FLOAT):
+						executeTypedOP<base::sm_float>(std::plus());
+						SM_NEXT();
+					SM_HANDLER(SUB_INT):
+						executeTypedOP<base::sm_int>(std::minus());
+						SM_NEXT();
+					SM_HANDLER(SUB_UINT):
+						executeTypedOP<base::sm_uint>(std::minus());
+						SM_NEXT();
+					SM_HANDLER(SUB_FLOAT):
+						executeTypedOP<base::sm_float>(std::minus());
+						SM_NEXT();
+					SM_HANDLER(MULT_INT):
+						executeTypedOP<base::sm_int>(std::multiplies());
+						SM_NEXT();
+					SM_HANDLER(MULT_UINT):
+						executeTypedOP<base::sm_uint>(std::multiplies());
+						SM_NEXT();
+					SM_HANDLER(MULT_FLOAT):
+						executeTypedOP<base::sm_float>(std::multiplies());
+						SM_NEXT();
+					SM_HANDLER(DIV_INT):
+						executeTypedDivision<base::sm_int>();
+						SM_NEXT();
+					SM_HANDLER(DIV_UINT):
+						executeTypedDivision<base::sm_uint>();
+						SM_NEXT();
+					SM_HANDLER(DIV_FLOAT):
+						executeTypedDivision<base::sm_float>();
+						SM_NEXT();
 					default:
+#if SM_THREADED_DISPATCH
+					label_unknown:
+#endif
 						throw ex::Exception("Unrecognized token: "s + opCodeName(pc->getOpCode()));
 				}
-				pc++;
 			}
-			assert(functionFrames.size() == 0);
 		}
 
-		std::string toString() const {
-			std::ostringstream stream;
+#undef SM_OBSERVE
+#undef SM_HANDLER
+#undef SM_REGISTER_HANDLER
+#undef SM_NEXT
 
-			stream << "Literals:\n";
-			for (int i = 0; i < program.literals.size(); i++) {
-				stream << std::setw(3) << std::right << i << " | " << std::setw(20) << std::left;
-				stream << program.literals[i].toString() << " ";
-				stream << " (" << idToString(program.literals[i].typeId()) << ")\n";
+		void sampleIfDue() {
+			if (sampler->due.load(std::memory_order_relaxed) and sampler->due.exchange(false)) {
+				sampler->sample(*this);
 			}
+		}
 
-			stream << "\nStack:\n";
-			for (int i = 0; i < dataStack.size(); i++) {
-				stream << std::setw(3) << std::right << i << " | " << std::setw(20) << std::left;
-				stream << dataStack[i].toString() << " ";
-				stream << " (" << idToString(dataStack[i].typeId()) << ")\n";
+		template<typename ExecutionFunction>
+		void executeOP(ExecutionFunction func) {
+			const base::BasicType a = pop();
+			const base::BasicType b = pop();
+			push(func(b, a));
+		}
+
+		template<typename ExecutionFunction>
+		void executeOP(ExecutionFunction func, const base::BasicType& operand) {
+			const base::BasicType a = pop();
+			push(func(a, operand));
+		}
+
+		// Typed operations work directly on the payload, the compiler guarantees the operand types
+		template<typename T, typename ExecutionFunction>
+		void executeTypedOP(ExecutionFunction func) {
+			const T a = top().getUnchecked<T>();
+			sp--;
+			base::BasicType& b = top();
+			b = base::BasicType(func(b.getUnchecked<T>(), a));
+		}
+
+		template<typename T, typename ExecutionFunction>
+		void executeTypedOP(ExecutionFunction func, T operand) {
+			base::BasicType& a = top();
+			a = base::BasicType(func(a.getUnchecked<T>(), operand));
+		}
+
+		template<typename T>
+		void executeTypedDivision() {
+			const T a = top().getUnchecked<T>();
+			if (a == 0) {
+				throw ex::Exception("Division through zero");
 			}
+			sp--;
+			base::BasicType& b = top();
+			b = base::BasicType(b.getUnchecked<T>() / a);
+		}
 
-			stream << "\nByteCode:\n";
-			for (int i = 0; i < program.bytecode.size(); i++) {
-				const base::Operation& op = program.bytecode[i];
-				base::OpCode opCode = op.getOpCode();
-				const int64_t value = op.signedData();
-
-				stream << std::setw(3) << std::right << i << " | " << std::setw(20) << std::left << opCodeName(opCode) << " ";
-				switch (opCode) {
-					case base::OpCode::CREATE_VARIABLE:
-						stream << value << " (" << idToString(static_cast<base::TypeIndex>(value)) << ")";
-						break;
-					case base::OpCode::JUMP: // fallthrough
-					case base::OpCode::JUMP_IF_NOT:
-						stream << value << " -> " << (i + value);
-						break;
-					case base::OpCode::LOAD_LITERAL:
-						stream << value << " (" << program.literals[value].toString() << ")";
-						break;
-					case base::OpCode::CALL_FUNCTION:
-						stream << op.side_unsignedData() << " params; jump " << value << " -> " << (i + value);
-						break;
-					case base::OpCode::END_SCOPE: // fallthrough
-					case base::OpCode::STORE_LOCAL: // fallthrough
-					case base::OpCode::LOAD_LOCAL: // fallthrough
-					case base::OpCode::POP:
-						stream << value;
-						break;
-				}
+		// LOAD_LOCAL, LOAD_LITERAL, OP
+		template<typename ExecutionFunction>
+		void executeLocalLiteralOP(ExecutionFunction func) {
+			const base::sm_int a = localVariable(pc->side_unsignedData()).getUnchecked<base::sm_int>();
+			const base::sm_int b = program.literals.get(pc->unsignedData()).getUnchecked<base::sm_int>();
+			push(base::BasicType(func(a, b)));
+		}
+
+		// LOAD_LOCAL, LOAD_LOCAL, OP
+		template<typename ExecutionFunction>
+		void executeLocalLocalOP(ExecutionFunction func) {
+			const base::sm_int a = localVariable(pc->side_unsignedData()).getUnchecked<base::sm_int>();
+			const base::sm_int b = localVariable(pc->unsignedData()).getUnchecked<base::sm_int>();
+			push(base::BasicType(func(a, b)));
+		}
 
-				stream << "\n";
+		// OP, STORE_LOCAL
+		template<typename ExecutionFunction>
+		void executeStoreLocalOP(ExecutionFunction func) {
+			const base::sm_int a = top().getUnchecked<base::sm_int>();
+			sp--;
+			const base::sm_int b = top().getUnchecked<base::sm_int>();
+			sp--;
+			localVariable(pc->unsignedData()) = base::BasicType(func(b, a));
+		}
+
+		// LOAD_LOCAL a, INCR, STORE_LOCAL a
+		template<typename ExecutionFunction>
+		void executeInPlaceLocalOP(ExecutionFunction func) {
+			base::BasicType& a = localVariable(pc->unsignedData());
+			a = base::BasicType(func(a.getUnchecked<base::sm_int>(), base::sm_int(1)));
+		}
+
+		// Executes the called function in native code if it's compiled, the arguments get replaced by the return value
+		bool callNative() {
+			if (frames.size() > nativeFailedDepth) {
+				return false; // inside the call that failed in native code, the calls below it would fail again
 			}
+			nativeFailedDepth = std::numeric_limits<size_t>::max();
 
-			return stream.str();
+			const jit::NativeFunction* function = jit->hit(calledFunction(program.bytecode.begin()));
+			if (function == nullptr) {
+				return false;
+			}
+
+			base::BasicType* const arguments = sp - pc->side_unsignedData();
+			const std::optional<base::BasicType> result = jit->run(*function, std::span<const base::BasicType>(arguments, sp), stackEnd - arguments);
+			if (!result.has_value()) {
+				nativeFailedDepth = frames.size();
+				return false; // the interpreter runs into the same error or has more stack to work with
+			}
+
+			sp = arguments;
+			if (function->returnType.has_value()) {
+				push(result.value());
+			}
+			return true;
 		}
 
-		const std::vector<base::BasicType>& getDataStack() const {
-			return dataStack;
+		/* Moves the stack into a bigger allocation so that slots values fit above from. A machine of its own
+		*  starts with the whole stackLimit already, only fibers start small and grow. */
+		void growStack(base::BasicType* from, size_t slots) {
+			const size_t needed = static_cast<size_t>(from - dataStack.data()) + slots;
+			if (needed > stackLimit) {
+				throw ex::Exception("Stack overflow");
+			}
+
+			std::vector<base::BasicType> grown(std::min(std::max(needed, 2 * dataStack.size()), stackLimit));
+			const auto moved = [&](base::BasicType* slot) {
+				return grown.data() + (slot - dataStack.data());
+			};
+			std::copy(dataStack.data(), sp, grown.data());
+			for (Frame& frame : frames) {
+				frame.base = moved(frame.base);
+			}
+			if (globals == dataStack.data()) {
+				globals = grown.data();
+			}
+			frameBase = moved(frameBase);
+			sp = moved(sp);
+			dataStack.swap(grown);
+			stackEnd = dataStack.data() + dataStack.size();
+#ifdef SM_STATS
+			stats.stackReallocations++;
+#endif
 		}
 
-	private:
-		using PcType = std::vector<base::Operation>::const_iterator;
+		// Exchanges the state of the machine with the one of the fiber, the frames keep pointing into their stack
+		void swapState(Fiber& fiber) {
+			const size_t pcIndex = pc - program.bytecode.begin();
+			const size_t spIndex = sp - dataStack.data();
+			const size_t frameBaseIndex = frameBase - dataStack.data();
 
-		std::stack<PcType, std::vector<PcType>> pcHistory;
+			dataStack.swap(fiber.dataStack);
+			frames.swap(fiber.frames);
+			pc = program.bytecode.begin() + fiber.pc;
+			sp = dataStack.data() + fiber.sp;
+			frameBase = dataStack.data() + fiber.frameBase;
+			stackEnd = dataStack.data() + dataStack.size();
 
-		std::stack<size_t, std::vector<size_t>> functionFrames;
-		std::vector<base::BasicType> dataStack;
+			fiber.pc = pcIndex;
+			fiber.sp = spIndex;
+			fiber.frameBase = frameBaseIndex;
+		}
+
+		const base::FunctionSignature& checkedFunction(size_t entry, std::span<const base::BasicType> arguments) const {
+			const base::FunctionSignature* function = program.function(entry);
+			if (function == nullptr) {
+				throw ex::Exception("No function at " + std::to_string(entry));
+			}
+			if (arguments.size() != function->params.size()) {
+				throw ex::Exception("Wrong number of arguments for " + function->name);
+			}
+			for (size_t i = 0; i < arguments.size(); i++) {
+				if (arguments[i].typeId() != function->params[i]) {
+					throw ex::Exception("Wrong argument type for " + function->name);
+				}
+			}
+			return *function;
+		}
 
-		base::Program program;
-		PcType pc;
+		std::optional<base::BasicType> runCall(const base::FunctionSignature& function, std::span<const base::BasicType> arguments, std::span<const base::BasicType> globalValues) {
+			resetStats();
+			const size_t entry = function.entry;
+			auto need = entryStackNeeds.find(entry);
+			if (need == entryStackNeeds.end()) {
+				const uint32_t params = static_cast<uint32_t>(arguments.size());
+				const base::StackDepths depths(program.bytecode, { { entry, params } });
+				need = entryStackNeeds.emplace(entry, static_cast<uint32_t>(depths.function(entry).maxDepth)).first;
+			}
 
-		base::BasicType pop() {
-			base::BasicType data = dataStack.back();
-			dataStack.pop_back();
-			return data;
+			frames.clear();
+			frameBase = dataStack.data();
+			sp = dataStack.data();
+			if (globalValues.size() + need->second > static_cast<size_t>(stackEnd - sp)) {
+				growStack(sp, globalValues.size() + need->second);
+			}
+			sp = std::copy(globalValues.begin(), globalValues.end(), sp);
+			frames.push_back({ returnToEnd(), frameBase, static_cast<uint32_t>(entry) });
+			frameBase = sp;
+			sp = std::copy(arguments.begin(), arguments.end(), sp);
+			pc = program.bytecode.begin() + entry;
+			start<false>(0);
+
+			if (function.returnType.has_value()) {
+				return pop();
+			}
+			return {};
 		}
 
-		template<typename ExecutionFunction>
-		void executeOP(ExecutionFunction func) {
-			const base::BasicType a = pop();
-			const base::BasicType b = pop();
-			dataStack.push_back(func(b, a));
+		// Return address of a function that doesn't return into the program, it continues at END_PROGRAM
+		PcType returnToEnd() const {
+			assert(program.bytecode.back().getOpCode() == base::OpCode::END_PROGRAM);
+			return program.bytecode.end() - 2;
 		}
 
-		template<typename ExecutionFunction>
-		void executeOP(ExecutionFunction func, const base::BasicType& operand) {
-			const base::BasicType a = pop();
-			dataStack.push_back(func(a, operand));
+		/* The called function starts in a new fiber with the arguments as its whole stack. Its only frame
+		*  returns in front of END_PROGRAM, which ends the fiber with the return value left on its stack. */
+		void spawn() {
+			if (running == nullptr) {
+				throw ex::Exception("spawn needs a Scheduler");
+			}
+
+			const uint16_t params = pc->side_unsignedData();
+			const size_t entry = calledFunction(program.bytecode.begin());
+			std::shared_ptr<Fiber> fiber = std::make_shared<Fiber>();
+			fiber->dataStack.resize(params + stackNeeds[pc - program.bytecode.begin()]);
+			std::copy(sp - params, sp, fiber->dataStack.data());
+			sp -= params;
+
+			fiber->frames.push_back({ returnToEnd(), fiber->dataStack.data(), static_cast<uint32_t>(entry) });
+			fiber->pc = entry;
+			fiber->sp = params;
+			fiber->root = (running->root != nullptr) ? running->root : running;
+			spawned.push_back(std::move(fiber));
 		}
 
-		void endFunction() {
-			pc = top_and_pop(pcHistory);
-			dataStack.resize(top_and_pop(functionFrames));
+		/* Splits the range of a PFOR into chunks for the runner. Every chunk starts with the current globals and its
+		*  reductions at zero, the sums of the chunks get added to the reductions after all of them ended.
+		*  Returns false if the range is too small to split, the caller runs the chunk function itself then. */
+		bool parallelFor() {
+			const base::sm_int begin = sp[-2].getInt();
+			const base::sm_int end = sp[-1].getInt();
+			if ((parallel->size() < 2) or (end - begin < 2)) {
+				return false;
+			}
+
+			const size_t entry = calledFunction(program.bytecode.begin());
+			const std::vector<uint32_t>& reductions = program.function(entry)->reductions;
+			std::vector<base::BasicType> chunkGlobals(globals, globals + program.globalTypes.size());
+			for (uint32_t global : reductions) {
+				chunkGlobals[global] = base::BasicType::fromId(program.globalTypes[global]);
+			}
+
+			const size_t chunks = static_cast<size_t>(std::min<base::sm_int>(end - begin, parallel->size() * chunksPerThread));
+			std::vector<std::vector<base::BasicType>> sums(chunks);
+			std::vector<ChunkRunner::Task> tasks;
+			for (size_t chunk = 0; chunk < chunks; chunk++) {
+				const base::BasicType range[] = {
+					base::BasicType(begin + (end - begin) * static_cast<base::sm_int>(chunk) / static_cast<base::sm_int>(chunks)),
+					base::BasicType(begin + (end - begin) * static_cast<base::sm_int>(chunk + 1) / static_cast<base::sm_int>(chunks))
+				};
+				tasks.push_back([&, chunk, range](StackMachine& machine) {
+					machine.call(entry, range, chunkGlobals);
+					for (uint32_t global : reductions) {
+						sums[chunk].push_back(machine.getGlobalVariable(global));
+					}
+				});
+			}
+			parallel->runAll(image, std::move(tasks));
+
+			for (const std::vector<base::BasicType>& sum : sums) {
+				for (size_t i = 0; i < reductions.size(); i++) {
+					globals[reductions[i]] = globals[reductions[i]] + sum[i];
+				}
+			}
+			sp -= 2;
+			return true;
 		}
 	};
 }
\ No newline at end of file
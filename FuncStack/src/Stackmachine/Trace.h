@@ -0,0 +1,84 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "src/Base/OpCode.h"
+
+// Operations a Trace keeps, a power of two
+#ifndef SM_TRACE_SIZE
+#define SM_TRACE_SIZE 4096
+#endif
+
+namespace stackmachine {
+	struct TraceEntry {
+		uint32_t index; // bytecode index of the operation
+		base::OpCode opCode;
+		uint32_t stackDepth; // used slots of the data stack before the operation ran
+		uint32_t callDepth; // active calls
+	};
+
+	/* The last operations a StackMachine built with SM_TRACE dispatched, a ring buffer that overwrites the oldest.
+	*  Only the machine writes, three release stores per operation, plain moves on x86. Any thread can take
+	*  entries() without a lock while the machine runs, the ones the machine overwrote during the copy are
+	*  dropped. Native code of the JIT isn't traced. */
+	class Trace {
+	public:
+		static constexpr size_t capacity = SM_TRACE_SIZE;
+		static_assert((capacity > 0) and ((capacity & (capacity - 1)) == 0), "SM_TRACE_SIZE has to be a power of two");
+
+		Trace() : slots(capacity) {}
+
+		void record(size_t index, base::OpCode opCode, size_t stackDepth, size_t callDepth) {
+			const uint64_t position = next.load(std::memory_order_relaxed);
+			Slot& slot = slots[position & (capacity - 1)];
+			// release: a reader that sees the new slot sees the position that tells it that the old one is gone
+			slot.operation.store((static_cast<uint64_t>(index) << 32) | static_cast<uint64_t>(opCode), std::memory_order_release);
+			slot.depths.store((static_cast<uint64_t>(callDepth) << 32) | static_cast<uint32_t>(stackDepth), std::memory_order_release);
+			next.store(position + 1, std::memory_order_release);
+		}
+
+		// The oldest first
+		std::vector<TraceEntry> entries() const {
+			const uint64_t end = next.load(std::memory_order_acquire);
+			const uint64_t begin = (end > capacity) ? end - capacity : 0;
+			std::vector<TraceEntry> copy;
+			copy.reserve(end - begin);
+			for (uint64_t position = begin; position < end; position++) {
+				const Slot& slot = slots[position & (capacity - 1)];
+				const uint64_t operation = slot.operation.load(std::memory_order_acquire);
+				const uint64_t depths = slot.depths.load(std::memory_order_acquire);
+				copy.push_back({ static_cast<uint32_t>(operation >> 32), static_cast<base::OpCode>(operation & 0xFFFFFFFF), static_cast<uint32_t>(depths), static_cast<uint32_t>(depths >> 32) });
+			}
+
+			// the machine may have lapped the copy, the operation it records right now overwrites one more
+			const uint64_t written = next.load(std::memory_order_acquire) + 1;
+			const uint64_t overwritten = (written > capacity) ? written - capacity : 0;
+			if (overwritten > begin) {
+				copy.erase(copy.begin(), copy.begin() + static_cast<ptrdiff_t>(std::min(overwritten, end) - begin));
+			}
+			return copy;
+		}
+
+		// Operations recorded since the last clear(), older ones than capacity are gone
+		uint64_t recorded() const {
+			return next.load(std::memory_order_acquire);
+		}
+
+		void clear() {
+			next.store(0, std::memory_order_release);
+		}
+
+	private:
+		struct Slot {
+			std::atomic<uint64_t> operation; // index << 32 | opCode
+			std::atomic<uint64_t> depths; // callDepth << 32 | stackDepth
+		};
+
+		std::vector<Slot> slots;
+		std::atomic<uint64_t> next = 0; // position of the next record, slot position % capacity
+	};
+}
@@ -0,0 +1,324 @@
+#pragma once
+
+#include <bit>
+#include <span>
+#include <sstream>
+#include <vector>
+
+#include "Stackmachine.h"
+
+namespace stackmachine {
+	using Slot = uint64_t;
+
+	template<typename T>
+	constexpr Slot toSlot(T value) {
+		if constexpr (std::is_same_v<T, base::sm_bool>) {
+			return value ? 1 : 0;
+		} else {
+			return std::bit_cast<Slot>(value);
+		}
+	}
+
+	template<typename T>
+	constexpr T fromSlot(Slot slot) {
+		if constexpr (std::is_same_v<T, base::sm_bool>) {
+			return slot != 0;
+		} else {
+			return std::bit_cast<T>(slot);
+		}
+	}
+
+	inline Slot toSlot(const base::BasicType& value) {
+		switch (value.typeId()) {
+			case base::TypeIndex::Int: return toSlot(value.getInt());
+			case base::TypeIndex::Uint: return toSlot(value.getUint());
+			case base::TypeIndex::Float: return toSlot(value.getFloat());
+			case base::TypeIndex::Bool: return toSlot(value.getBool());
+			default: throw ex::Exception("Unknown type id");
+		}
+	}
+
+	inline base::BasicType fromSlot(Slot slot, base::TypeIndex type) {
+		switch (type) {
+			case base::TypeIndex::Int: return base::BasicType(fromSlot<base::sm_int>(slot));
+			case base::TypeIndex::Uint: return base::BasicType(fromSlot<base::sm_uint>(slot));
+			case base::TypeIndex::Float: return base::BasicType(fromSlot<base::sm_float>(slot));
+			case base::TypeIndex::Bool: return base::BasicType(fromSlot<base::sm_bool>(slot));
+			default: throw ex::Exception("Unknown type id");
+		}
+	}
+
+	/* Executes the bytecode with raw 8 byte slots on the data stack. The types of all operations have to be known
+	*  by the compiler, the only type information at runtime are the types of the globals in the program.
+	*  Programs that still contain generic operations (e.g. mixing int and float) are rejected. */
+	class UntaggedStackMachine : private CallStack<Slot> {
+	public:
+		UntaggedStackMachine(base::Program toExecute, size_t maxStackDepth = StackMachine::defaultStackDepth)
+			: UntaggedStackMachine(base::freeze(std::move(toExecute)), maxStackDepth) {}
+
+		UntaggedStackMachine(base::SharedProgram toExecute, size_t maxStackDepth = StackMachine::defaultStackDepth)
+			: CallStack(maxStackDepth), image(checkedImage(std::move(toExecute))), program(*image) {
+			for (const base::Operation& op : program.bytecode) {
+				if (needsTypeTag(op.getOpCode())) {
+					throw ex::Exception("Operation needs type information at runtime: "s + opCodeName(op.getOpCode()).str);
+				}
+				if (needsStackMachine(op.getOpCode())) {
+					throw ex::Exception("Operation not supported by the untagged stackmachine: "s + opCodeName(op.getOpCode()).str);
+				}
+			}
+
+			literals.reserve(program.literals.size());
+			for (size_t i = 0; i < program.literals.size(); i++) {
+				literals.push_back(toSlot(program.literals[i]));
+			}
+
+			pc = program.bytecode.begin();
+
+			const base::StackDepths depths(program.bytecode);
+			topLevelStackNeed = depths.topLevelMaxDepth();
+			stackNeeds = callStackNeeds(program.bytecode, depths);
+		}
+
+		base::BasicType getGlobalVariable(size_t offset) const {
+			assert(offset < stackSize());
+			assert(offset < program.globalTypes.size());
+			return fromSlot(dataStack[offset], program.globalTypes[offset]);
+		}
+
+		size_t size() const {
+			return stackSize();
+		}
+
+		std::span<const Slot> getDataStack() const {
+			return std::span<const Slot>(dataStack.data(), stackSize());
+		}
+
+		void exec() {
+			if (topLevelStackNeed > static_cast<size_t>(stackEnd - sp)) {
+				throw ex::Exception("Stack overflow");
+			}
+
+			while (true) {
+				switch (pc->getOpCode()) {
+					// ==== META ====
+					case base::OpCode::POP:
+						assert(stackSize() >= pc->unsignedData());
+						sp -= pc->unsignedData();
+						break;
+					case base::OpCode::LOAD_LITERAL:
+						push(literals[pc->unsignedData()]);
+						break;
+					case base::OpCode::STORE_LOCAL:
+						localVariable(pc->unsignedData()) = pop();
+						break;
+					case base::OpCode::LOAD_LOCAL:
+						push(localVariable(pc->unsignedData()));
+						break;
+					case base::OpCode::CREATE_VARIABLE:
+						push(0); // the default value of every type has no bits set
+						break;
+					case base::OpCode::STORE_GLOBAL:
+						dataStack[pc->unsignedData()] = pop();
+						break;
+					case base::OpCode::LOAD_GLOBAL:
+						push(dataStack[pc->unsignedData()]);
+						break;
+					case base::OpCode::JUMP:
+						pc += pc->signedData();
+						break;
+					case base::OpCode::JUMP_IF_NOT:
+						if (pop() == 0) {
+							pc += pc->signedData();
+						}
+						break;
+					case base::OpCode::CALL_FUNCTION:
+						if (stackNeeds[pc - program.bytecode.begin()] > static_cast<size_t>(stackEnd - sp)) {
+							throw ex::Exception("Stack overflow");
+						}
+						enterFunction(program.bytecode.begin());
+						break;
+					case base::OpCode::TAIL_CALL:
+						if (stackNeeds[pc - program.bytecode.begin()] > static_cast<size_t>(stackEnd - frameBase)) {
+							throw ex::Exception("Stack overflow");
+						}
+						tailCall(program.bytecode.begin());
+						break;
+					case base::OpCode::END_FUNCTION:
+						endFunction();
+						break;
+					case base::OpCode::RETURN:
+					{
+						const Slot returnValue = pop();
+						endFunction();
+						push(returnValue);
+					}
+					break;
+					case base::OpCode::END_PROGRAM:
+						assert(frames.empty());
+						return;
+						// ==== TYPED ====
+					case base::OpCode::EQ_INT: executeTypedOP<base::sm_int>(std::equal_to()); break;
+					case base::OpCode::EQ_UINT: executeTypedOP<base::sm_uint>(std::equal_to()); break;
+					case base::OpCode::EQ_FLOAT: executeTypedOP<base::sm_float>(std::equal_to()); break;
+					case base::OpCode::EQ_BOOL: executeTypedOP<base::sm_bool>(std::equal_to()); break;
+					case base::OpCode::UNEQ_INT: executeTypedOP<base::sm_int>(std::not_equal_to()); break;
+					case base::OpCode::UNEQ_UINT: executeTypedOP<base::sm_uint>(std::not_equal_to()); break;
+					case base::OpCode::UNEQ_FLOAT: executeTypedOP<base::sm_float>(std::not_equal_to()); break;
+					case base::OpCode::UNEQ_BOOL: executeTypedOP<base::sm_bool>(std::not_equal_to()); break;
+					case base::OpCode::LESS_INT: executeTypedOP<base::sm_int>(std::less()); break;
+					case base::OpCode::LESS_UINT: executeTypedOP<base::sm_uint>(std::less()); break;
+					case base::OpCode::LESS_FLOAT: executeTypedOP<base::sm_float>(std::less()); break;
+					case base::OpCode::BIGGER_INT: executeTypedOP<base::sm_int>(std::greater()); break;
+					case base::OpCode::BIGGER_UINT: executeTypedOP<base::sm_uint>(std::greater()); break;
+					case base::OpCode::BIGGER_FLOAT: executeTypedOP<base::sm_float>(std::greater()); break;
+					case base::OpCode::INCR_INT: executeTypedOP<base::sm_int>(std::plus(), 1); break;
+					case base::OpCode::INCR_UINT: executeTypedOP<base::sm_uint>(std::plus(), 1); break;
+					case base::OpCode::INCR_FLOAT: executeTypedOP<base::sm_float>(std::plus(), 1); break;
+					case base::OpCode::DECR_INT: executeTypedOP<base::sm_int>(std::minus(), 1); break;
+					case base::OpCode::DECR_UINT: executeTypedOP<base::sm_uint>(std::minus(), 1); break;
+					case base::OpCode::DECR_FLOAT: executeTypedOP<base::sm_float>(std::minus(), 1); break;
+					case base::OpCode::ADD_INT: executeTypedOP<base::sm_int>(std::plus()); break;
+					case base::OpCode::ADD_UINT: executeTypedOP<base::sm_uint>(std::plus()); break;
+					case base::OpCode::ADD_FLOAT: executeTypedOP<base::sm_float>(std::plus()); break;
+					case base::OpCode::SUB_INT: executeTypedOP<base::sm_int>(std::minus()); break;
+					case base::OpCode::SUB_UINT: executeTypedOP<base::sm_uint>(std::minus()); break;
+					case base::OpCode::SUB_FLOAT: executeTypedOP<base::sm_float>(std::minus()); break;
+					case base::OpCode::MULT_INT: executeTypedOP<base::sm_int>(std::multiplies()); break;
+					case base::OpCode::MULT_UINT: executeTypedOP<base::sm_uint>(std::multiplies()); break;
+					case base::OpCode::MULT_FLOAT: executeTypedOP<base::sm_float>(std::multiplies()); break;
+					case base::OpCode::DIV_INT: executeTypedDivision<base::sm_int>(); break;
+					case base::OpCode::DIV_UINT: executeTypedDivision<base::sm_uint>(); break;
+					case base::OpCode::DIV_FLOAT: executeTypedDivision<base::sm_float>(); break;
+						// ==== SUPERINSTRUCTIONS ====
+					case base::OpCode::ADD_LOCAL_LITERAL_INT: executeLocalLiteralOP(std::plus()); break;
+					case base::OpCode::SUB_LOCAL_LITERAL_INT: executeLocalLiteralOP(std::minus()); break;
+					case base::OpCode::MULT_LOCAL_LITERAL_INT: executeLocalLiteralOP(std::multiplies()); break;
+					case base::OpCode::EQ_LOCAL_LITERAL_INT: executeLocalLiteralOP(std::equal_to()); break;
+					case base::OpCode::UNEQ_LOCAL_LITERAL_INT: executeLocalLiteralOP(std::not_equal_to()); break;
+					case base::OpCode::LESS_LOCAL_LITERAL_INT: executeLocalLiteralOP(std::less()); break;
+					case base::OpCode::BIGGER_LOCAL_LITERAL_INT: executeLocalLiteralOP(std::greater()); break;
+					case base::OpCode::EQ_LOCAL_LOCAL_INT: executeLocalLocalOP(std::equal_to()); break;
+					case base::OpCode::UNEQ_LOCAL_LOCAL_INT: executeLocalLocalOP(std::not_equal_to()); break;
+					case base::OpCode::LESS_LOCAL_LOCAL_INT: executeLocalLocalOP(std::less()); break;
+					case base::OpCode::BIGGER_LOCAL_LOCAL_INT: executeLocalLocalOP(std::greater()); break;
+					case base::OpCode::ADD_INT_STORE_LOCAL: executeStoreLocalOP(std::plus()); break;
+					case base::OpCode::SUB_INT_STORE_LOCAL: executeStoreLocalOP(std::minus()); break;
+					case base::OpCode::MULT_INT_STORE_LOCAL: executeStoreLocalOP(std::multiplies()); break;
+					case base::OpCode::INCR_LOCAL_INT: executeInPlaceLocalOP(std::plus()); break;
+					case base::OpCode::DECR_LOCAL_INT: executeInPlaceLocalOP(std::minus()); break;
+					default:
+						throw ex::Exception("Unrecognized token: "s + opCodeName(pc->getOpCode()));
+				}
+				pc++;
+			}
+		}
+
+		std::string toString() const {
+			std::ostringstream stream;
+
+			stream << "Literals:\n";
+			stream << literalsToString(program);
+
+			stream << "\nStack:\n";
+			for (size_t i = 0; i < stackSize(); i++) {
+				stream << std::setw(3) << std::right << i << " | " << std::setw(20) << std::left;
+				if (i < program.globalTypes.size()) {
+					stream << getGlobalVariable(i).toString() << " ";
+					stream << " (" << idToString(program.globalTypes[i]) << ")\n";
+				} else {
+					stream << dataStack[i] << " ";
+					stream << " (raw)\n";
+				}
+			}
+
+			stream << "\nByteCode:\n";
+			stream << bytecodeToString(program);
+
+			return stream.str();
+		}
+
+	private:
+		size_t topLevelStackNeed;
+		std::vector<uint32_t> stackNeeds; // see callStackNeeds
+
+		const base::SharedProgram image;
+		const base::Program& program; // *image, shared with other machines
+		std::vector<Slot> literals; // untagged copy of the literals of the program
+
+		static bool needsTypeTag(base::OpCode opCode) {
+			switch (opCode) {
+				case base::OpCode::EQ:
+				case base::OpCode::UNEQ:
+				case base::OpCode::LESS:
+				case base::OpCode::BIGGER:
+				case base::OpCode::INCR:
+				case base::OpCode::DECR:
+				case base::OpCode::ADD:
+				case base::OpCode::SUB:
+				case base::OpCode::MULT:
+				case base::OpCode::DIV:
+					return true;
+				default:
+					return false;
+			}
+		}
+
+		// Fibers and parallel loops run on a StackMachine with its Scheduler or Executor
+		static bool needsStackMachine(base::OpCode opCode) {
+			return (opCode == base::OpCode::SPAWN) or (opCode == base::OpCode::YIELD) or (opCode == base::OpCode::PFOR);
+		}
+
+		template<typename T, typename ExecutionFunction>
+		void executeTypedOP(ExecutionFunction func) {
+			const T a = stackmachine::fromSlot<T>(pop());
+			Slot& b = top();
+			b = stackmachine::toSlot(func(stackmachine::fromSlot<T>(b), a));
+		}
+
+		template<typename T, typename ExecutionFunction>
+		void executeTypedOP(ExecutionFunction func, T operand) {
+			Slot& a = top();
+			a = stackmachine::toSlot(func(stackmachine::fromSlot<T>(a), operand));
+		}
+
+		template<typename T>
+		void executeTypedDivision() {
+			const T a = stackmachine::fromSlot<T>(pop());
+			if (a == 0) {
+				throw ex::Exception("Division through zero");
+			}
+			Slot& b = top();
+			b = stackmachine::toSlot(stackmachine::fromSlot<T>(b) / a);
+		}
+
+		// LOAD_LOCAL, LOAD_LITERAL, OP
+		template<typename ExecutionFunction>
+		void executeLocalLiteralOP(ExecutionFunction func) {
+			const base::sm_int local = stackmachine::fromSlot<base::sm_int>(localVariable(pc->side_unsignedData()));
+			const base::sm_int literal = stackmachine::fromSlot<base::sm_int>(literals[pc->unsignedData()]);
+			push(stackmachine::toSlot(func(local, literal)));
+		}
+
+		// LOAD_LOCAL, LOAD_LOCAL, OP
+		template<typename ExecutionFunction>
+		void executeLocalLocalOP(ExecutionFunction func) {
+			const base::sm_int a = stackmachine::fromSlot<base::sm_int>(localVariable(pc->side_unsignedData()));
+			const base::sm_int b = stackmachine::fromSlot<base::sm_int>(localVariable(pc->unsignedData()));
+			push(stackmachine::toSlot(func(a, b)));
+		}
+
+		template<typename ExecutionFunction>
+		void executeStoreLocalOP(ExecutionFunction func) {
+			const base::sm_int a = stackmachine::fromSlot<base::sm_int>(pop());
+			const base::sm_int b = stackmachine::fromSlot<base::sm_int>(pop());
+			localVariable(pc->unsignedData()) = stackmachine::toSlot(func(b, a));
+		}
+
+		// LOAD_LOCAL a, INCR, STORE_LOCAL a
+		template<typename ExecutionFunction>
+		void executeInPlaceLocalOP(ExecutionFunction func) {
+			Slot& local = localVariable(pc->unsignedData());
+			local = stackmachine::toSlot(func(stackmachine::fromSlot<base::sm_int>(local), base::sm_int(1)));
+		}
+	};
+}
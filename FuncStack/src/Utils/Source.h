@@ -1,7 +1,10 @@
 #pragma once
 
+#include <algorithm>
 #include <string>
 #include <string_view>
+#include <utility>
+#include <vector>
 
 class Source {
 public:
@@ -43,10 +46,25 @@ public:
 		return out;
 	}
 
+	// 1 based line and column of the character at pos
+	std::pair<size_t, size_t> lineAndColumn(size_t pos) const {
+		if (lineStarts.empty()) {
+			lineStarts.push_back(0);
+			for (size_t i = 0; i < code.length(); i++) {
+				if (code[i] == '\n') {
+					lineStarts.push_back(i + 1);
+				}
+			}
+		}
+		const size_t line = std::distance(lineStarts.begin(), std::upper_bound(lineStarts.begin(), lineStarts.end(), pos));
+		return { line, pos - lineStarts[line - 1] + 1 };
+	}
+
 	const std::string& str() const {
 		return code;
 	}
 
 private:
 	std::string code;
+	mutable std::vector<size_t> lineStarts; // index of the first character of every line, built on first use
 };
\ No newline at end of file
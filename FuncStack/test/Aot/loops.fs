@@ -0,0 +1,41 @@
+int sum = 0;
+int fibonacci = 0;
+int tail = 0;
+float average = 0.0;
+bool even = false;
+
+func int fib(int n) {
+	if (n < 2) {
+		return n;
+	}
+	return fib(n - 1) + fib(n - 2);
+}
+
+func int accumulate(int n, int acc) {
+	if (n == 0) {
+		return acc;
+	}
+	return accumulate(n - 1, acc + n);
+}
+
+func bool isEven(int n) {
+	return (n / 2) * 2 == n;
+}
+
+func main() {
+	for (int i = 0; i < 100000; i++) {
+		for (int j = 0; j < 10; j++) {
+			sum = sum + i * j - j;
+		}
+	}
+
+	float total = 0.0;
+	for (int k = 0; k < 1000; k++) {
+		total = total + 1.5;
+	}
+	average = total / 1000.0;
+
+	fibonacci = fib(20);
+	tail = accumulate(10000, 0);
+	even = isEven(sum);
+}
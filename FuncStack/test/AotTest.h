@@ -0,0 +1,93 @@
+#pragma once
+
+#include <fstream>
+#include <sstream>
+
+#include "catch.hpp"
+#include "ForcedJit.h"
+#include "../src/Stackmachine/Stackmachine.h"
+#include "../src/Compiler/Compiler.h"
+#include "../src/Aot/CppTranslator.h"
+#include "../src/Aot/AotMachine.h"
+
+using namespace base;
+using namespace compiler;
+
+namespace aotTest {
+	size_t count(const std::string& text, const std::string& pattern) {
+		size_t found = 0;
+		for (size_t pos = text.find(pattern); pos != std::string::npos; pos = text.find(pattern, pos + 1)) {
+			found++;
+		}
+		return found;
+	}
+
+	TEST_CASE("Aot-Test-translation") {
+		std::string code = R"(
+int i = 0;
+
+func int fib(int n) {
+	if (n < 2) {
+		return n;
+	}
+	return fib(n - 1) + fib(n - 2);
+}
+
+func int sum(int n, int acc) {
+	if (n == 0) {
+		return acc;
+	}
+	return sum(n - 1, acc + n);
+}
+
+func main() {
+	for (int k = 0; k < 3; k++) {
+		i = i + fib(k) + sum(k, 0);
+	}
+}
+)";
+		Compiler compiler(std::move(code), 0);
+		const base::Program program = compiler.run();
+		REQUIRE(compiler.isSuccess());
+
+		const std::string translated = aot::CppTranslator(program).run();
+		INFO(translated);
+		REQUIRE(count(translated, "BasicType f") == 4); // declaration and definition of fib and sum
+		REQUIRE(count(translated, "void f") == 2); // main
+		REQUIRE(count(translated, "goto entry;") == 1); // the self tail call of sum
+		REQUIRE(count(translated, "goto L") >= 3); // if, loop condition and loop back jump
+		REQUIRE(count(translated, "FUNCSTACK_AOT_EXPORT size_t funcstack_aot_exec(") == 1);
+	}
+
+#ifdef SM_AOT_TEST_LIBRARY
+	// SM_AOT_TEST_SCRIPT got translated and built into SM_AOT_TEST_LIBRARY by CMake
+	TEST_CASE("Aot-Test") {
+		std::ifstream script(SM_AOT_TEST_SCRIPT);
+		REQUIRE(script.good());
+		std::stringstream code;
+		code << script.rdbuf();
+
+		Compiler compiler(code.str());
+		const base::Program program = compiler.run();
+		REQUIRE(compiler.isSuccess());
+		stackmachine::StackMachine reference(program);
+		forcedJit::apply(reference);
+		reference.exec();
+
+		aot::AotMachine machine(SM_AOT_TEST_LIBRARY);
+		machine.exec();
+		REQUIRE(machine.getDataStack().size() == reference.getDataStack().size());
+		for (size_t i = 0; i < reference.getDataStack().size(); i++) {
+			REQUIRE(machine.getGlobalVariable(i).typeId() == reference.getGlobalVariable(i).typeId());
+			REQUIRE((machine.getGlobalVariable(i) == reference.getGlobalVariable(i)).getBool());
+		}
+
+		// fib(20) needs more than 20 slots
+		stackmachine::StackMachine smallReference(program, stackmachine::DispatchMode::Threaded, 20);
+		forcedJit::apply(smallReference);
+		REQUIRE_THROWS_WITH(smallReference.exec(), "Stack overflow");
+		aot::AotMachine small(SM_AOT_TEST_LIBRARY, 20);
+		REQUIRE_THROWS_WITH(small.exec(), "Stack overflow");
+	}
+#endif
+}
@@ -0,0 +1,160 @@
+#pragma once
+
+#include "catch.hpp"
+#include "ForcedJit.h"
+#include "../src/Stackmachine/Stackmachine.h"
+#include "../src/Stackmachine/BatchMachine.h"
+#include "../src/Compiler/Compiler.h"
+
+using namespace base;
+using namespace compiler;
+
+namespace batchMachineTest {
+	const std::string code = R"(
+int limit = 100;
+int big = 0;
+float sum = 0.0;
+
+func int atMost(int n, int high) {
+	if (n > high) {
+		return high;
+	}
+	return n;
+}
+
+func int score(int price, int amount) {
+	int total = atMost(price, 50) * amount;
+	if (total > limit) {
+		big++;
+		total = total - total / 10;
+	} else if (amount == 0) {
+		return 0;
+	}
+	return total + 1;
+}
+
+func int collatz(int n) {
+	int steps = 0;
+	while (n != 1) {
+		if (n / 2 * 2 == n) {
+			n = n / 2;
+		} else {
+			n = 3 * n + 1;
+		}
+		steps++;
+		if (steps == 100) {
+			break;
+		}
+	}
+	return steps;
+}
+
+func float mix(float x, int k, bool flip) {
+	for (int i = 0; i < k; i++) {
+		if (flip) {
+			continue;
+		}
+		sum = sum + x;
+		x = x * 0.5;
+	}
+	return sum;
+}
+
+func int divide(int a, int b) {
+	if (a > 0) {
+		return a / b;
+	}
+	return 0;
+}
+
+func main() {
+	limit = 7;
+}
+)";
+
+	// Every row has to end like a call() with the same arguments, with the same return value and globals
+	void compare(const base::SharedProgram& program, const std::string& function, const std::vector<stackmachine::Column>& arguments) {
+		INFO(function);
+		stackmachine::BatchMachine batch(program);
+		const std::optional<stackmachine::Column> result = batch.run(function, arguments);
+		REQUIRE(result.has_value());
+
+		std::vector<TypeIndex> params;
+		for (const stackmachine::Column& argument : arguments) {
+			params.push_back(argument.typeId());
+		}
+		const size_t entry = program->function(function, params)->entry;
+		stackmachine::StackMachine reference(program);
+		forcedJit::apply(reference);
+		for (size_t row = 0; row < arguments.front().size(); row++) {
+			INFO(row);
+			std::vector<BasicType> rowArguments;
+			for (const stackmachine::Column& argument : arguments) {
+				rowArguments.push_back(argument[row]);
+			}
+			REQUIRE((reference.call(entry, rowArguments).value() == (*result)[row]).getBool());
+			for (size_t i = 0; i < program->globalTypes.size(); i++) {
+				REQUIRE((reference.getGlobalVariable(i) == batch.getGlobalColumn(i)[row]).getBool());
+			}
+		}
+	}
+
+	TEST_CASE("BatchMachine-Test") {
+		Compiler compiler(std::string(code), compiler::Inliner::defaultThreshold);
+		const base::SharedProgram program = base::freeze(compiler.run());
+		REQUIRE(compiler.isSuccess());
+
+		// more rows than a block, the last block is only partly used
+		std::vector<sm_int> prices;
+		std::vector<sm_int> amounts;
+		std::vector<sm_float> floats;
+		std::vector<bool> flips;
+		for (sm_int row = 0; row < 2500; row++) {
+			prices.push_back((row * 37) % 120 - 10);
+			amounts.push_back(row % 7);
+			floats.push_back(row * 0.25);
+			flips.push_back(row % 3 == 0);
+		}
+		const stackmachine::Column price(prices);
+		const stackmachine::Column amount(amounts);
+		compare(program, "score", { price, amount });
+		compare(program, "atMost", { price, stackmachine::Column(std::vector<sm_int>(prices.size(), 40)) });
+		compare(program, "collatz", { stackmachine::Column(std::vector<sm_int>(amounts.size(), 27)) });
+		compare(program, "mix", { stackmachine::Column(floats), amount, stackmachine::Column(flips) });
+
+		std::vector<sm_int> starts;
+		for (sm_int row = 1; row < 300; row++) {
+			starts.push_back(row);
+		}
+		compare(program, "collatz", { stackmachine::Column(starts) });
+
+		stackmachine::BatchMachine batch(program);
+		const stackmachine::Column result = batch.run("score", { price, amount }).value();
+		REQUIRE(result.typeId() == TypeIndex::Int);
+		REQUIRE(result.size() == prices.size());
+		REQUIRE(result.values<sm_int>()[3] == 50 * 3 - 50 * 3 / 10 + 1); // price 101 is cut to 50, the main that lowers the limit never ran
+		REQUIRE_THROWS_WITH(result.values<sm_float>(), "Column is of type TypeIndex::Int");
+	}
+
+	TEST_CASE("BatchMachine-Test-errors") {
+		Compiler compiler(std::string(code), 0);
+		const base::SharedProgram program = base::freeze(compiler.run());
+		REQUIRE(compiler.isSuccess());
+
+		stackmachine::BatchMachine batch(program);
+		const stackmachine::Column numerators(std::vector<sm_int>{ 4, -2, 9 });
+
+		// the row that would divide through zero doesn't run the division
+		const std::optional<stackmachine::Column> divided = batch.run("divide", { numerators, stackmachine::Column(std::vector<sm_int>{ 2, 0, 3 }) });
+		REQUIRE(divided.value().values<sm_int>() == std::vector<sm_int>{ 2, 0, 3 });
+		REQUIRE_THROWS_WITH(batch.run("divide", { numerators, stackmachine::Column(std::vector<sm_int>{ 2, 1, 0 }) }), "Division through zero");
+
+		REQUIRE_THROWS_WITH(batch.run("divide", { numerators, stackmachine::Column(std::vector<sm_int>{ 2, 1 }) }), "Columns of different length for divide");
+		REQUIRE_THROWS_WITH(batch.run("divide", { numerators }), "Unknown function: divide");
+		REQUIRE_THROWS_WITH(batch.run(program->function("divide", { TypeIndex::Int, TypeIndex::Int })->entry, { numerators }), "Wrong number of arguments for divide");
+		REQUIRE_THROWS_WITH(batch.run(program->function("main", {})->entry, {}), "A batch needs at least one column: main");
+
+		// without the Inliner score still calls atMost
+		REQUIRE_THROWS_WITH(batch.run("score", { numerators, numerators }), "Operation not supported in a batch: <call_function>");
+	}
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <chrono>
+
+#include "Benchmark.h"
+#include "src/Base/BasicType.h"
+
+namespace benchmark {
+	namespace basicType {
+		constexpr int repeats = 10;
+		constexpr int iterations = 1'000'000;
+
+		// Compile with and without SM_VARIANT_BASICTYPE to compare the representations
+		template<typename Function>
+		void test(Function func, const std::string& name) {
+			std::vector<base::BasicType> values;
+			for (int i = 0; i < 1000; i++) {
+				values.push_back((i % 3 == 0) ? base::BasicType(i * 0.5) : base::BasicType(i));
+			}
+
+			std::vector<long double> times;
+			times.reserve(repeats);
+			for (int i = 0; i < repeats; i++) {
+				const auto start = std::chrono::steady_clock::now();
+				const base::BasicType result = func(values);
+				const auto end = std::chrono::steady_clock::now();
+				times.push_back((end - start).count());
+
+				if (result.typeId() == base::TypeIndex::Err) { // keeps the result alive
+					std::cout << result << std::endl;
+				}
+			}
+			printResults(name, times);
+		}
+
+		void testGenericArithmetic() {
+			test([](const std::vector<base::BasicType>& values) {
+				base::BasicType sum(0.0);
+				for (int i = 0; i < iterations; i++) {
+					sum = sum + values[i % values.size()] * base::BasicType(2);
+				}
+				return sum;
+			}, __func__);
+		}
+
+		void testCompare() {
+			test([](const std::vector<base::BasicType>& values) {
+				base::BasicType count(0);
+				for (int i = 0; i < iterations; i++) {
+					if ((values[i % values.size()] < base::BasicType(500)).getBool()) {
+						count = count + base::BasicType(1);
+					}
+				}
+				return count;
+			}, __func__);
+		}
+
+		void run() {
+			testGenericArithmetic();
+			testCompare();
+		}
+	}
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <chrono>
+
+#include "Benchmark.h"
+#include "src/Compiler/Compiler.h"
+#include "src/Stackmachine/Stackmachine.h"
+#include "src/Stackmachine/BatchMachine.h"
+
+namespace benchmark {
+	namespace batch {
+		constexpr int repeats = 5;
+		constexpr size_t rows = 1'000'000;
+
+		// The same small function over a million rows, one call() per row against one run of the batch machine
+		void run() {
+			std::string code = R"(
+int limit = 1000;
+
+func int score(int price, int amount) {
+	int total = price * amount;
+	if (total > limit) {
+		total = total - total / 10;
+	}
+	return total + 1;
+}
+
+func main() {
+}
+)";
+			compiler::Compiler compiler(std::move(code));
+			const base::SharedProgram program = base::freeze(compiler.run());
+			const size_t entry = program->function("score", { base::TypeIndex::Int, base::TypeIndex::Int })->entry;
+
+			std::vector<base::sm_int> prices(rows);
+			std::vector<base::sm_int> amounts(rows);
+			for (size_t row = 0; row < rows; row++) {
+				prices[row] = static_cast<base::sm_int>(row % 500);
+				amounts[row] = static_cast<base::sm_int>(row % 7);
+			}
+			const std::vector<stackmachine::Column> columns = { stackmachine::Column(prices), stackmachine::Column(amounts) };
+
+			std::vector<long double> callTimes;
+			std::vector<long double> batchTimes;
+			for (int i = 0; i < repeats; i++) {
+				stackmachine::StackMachine machine(program);
+				std::vector<base::BasicType> arguments(2);
+				const auto callStart = std::chrono::steady_clock::now();
+				for (size_t row = 0; row < rows; row++) {
+					arguments[0] = base::BasicType(prices[row]);
+					arguments[1] = base::BasicType(amounts[row]);
+					machine.call(entry, arguments);
+				}
+				const auto callEnd = std::chrono::steady_clock::now();
+				callTimes.push_back((callEnd - callStart).count());
+
+				stackmachine::BatchMachine batchMachine(program);
+				const auto batchStart = std::chrono::steady_clock::now();
+				batchMachine.run(entry, columns);
+				const auto batchEnd = std::chrono::steady_clock::now();
+				batchTimes.push_back((batchEnd - batchStart).count());
+			}
+
+			std::cout << "\tper row: " << scale(*std::min_element(callTimes.begin(), callTimes.end()) / rows) << " call, ";
+			std::cout << scale(*std::min_element(batchTimes.begin(), batchTimes.end()) / rows) << " batch (fastest run)\n";
+			printResults(std::to_string(rows) + " rows, call per row", callTimes);
+			printResults(std::to_string(rows) + " rows, batch", batchTimes);
+		}
+	}
+}
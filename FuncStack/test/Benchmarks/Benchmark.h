@@ -0,0 +1,45 @@
+#pragma once
+
+#include <iostream>
+#include <sstream>
+#include <numeric>
+#include <algorithm>
+#include <vector>
+
+namespace benchmark {
+	std::string scale(long double ticks) {
+		std::ostringstream o;
+		if (ticks > 1'000'000'000) {
+			o << (ticks / 1'000'000'000) << "s";
+		} else if (ticks > 1'000'000) {
+			o << (ticks / 1'000'000) << "ms";
+		} else if (ticks > 1'000) {
+			o << (ticks / 1'000) << "us";
+		} else {
+			o << ticks << "ns";
+		}
+
+		return o.str();
+	}
+
+	long double avg(const std::vector<long double>& v) {
+		return std::accumulate(v.begin(), v.end(), 0.0) / v.size();
+	}
+
+	long double median(std::vector<long double> v) {
+		const auto mid = v.begin() + (v.size() / 2);
+		std::nth_element(v.begin(), mid, v.end());
+		return *mid;
+	}
+
+	void printResults(const std::string& name, std::vector<long double>& times) {
+		const auto mid = times.begin() + (times.size() / 2);
+		std::nth_element(times.begin(), mid, times.end());
+
+		std::cout << "Benchmark results (" << name << "):\n";
+		std::cout << "\tlongest:  " << scale(*std::max_element(times.begin(), times.end())) << "\n";
+		std::cout << "\tshortest: " << scale(*std::min_element(times.begin(), times.end())) << "\n";
+		std::cout << "\tmedian:   " << scale(*mid) << "\n";
+		std::cout << "\taverage:  " << scale(std::accumulate(times.begin(), times.end(), 0.0) / times.size()) << "\n\n";
+	}
+}
\ No newline at end of file
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <chrono>
+
+#include "Benchmark.h"
+#include "src/Compiler/Compiler.h"
+#include "src/Stackmachine/Stackmachine.h"
+#include "src/Stackmachine/UntaggedStackmachine.h"
+
+namespace benchmark {
+	namespace calls {
+		constexpr int repeats = 10;
+
+		// Hot functions run in native code, measured together with the interpreted calls before they get hot
+		struct JitStackMachine : stackmachine::StackMachine {
+			explicit JitStackMachine(base::Program program) : StackMachine(std::move(program)) {
+				enableJit();
+			}
+		};
+
+		template<typename Machine>
+		void test(const base::Program& program, const std::string& name, size_t calls) {
+			std::vector<long double> times;
+			times.reserve(repeats);
+			for (int i = 0; i < repeats; i++) {
+				Machine machine(program);
+
+				const auto start = std::chrono::steady_clock::now();
+				machine.exec();
+				const auto end = std::chrono::steady_clock::now();
+				times.push_back((end - start).count());
+			}
+
+			std::cout << "\tper call: " << scale(*std::min_element(times.begin(), times.end()) / calls) << " (fastest run)\n";
+			printResults(name, times);
+		}
+
+		void testFib() {
+			std::string code = R"(
+int i = 0;
+
+func int fib(int n) {
+	if (n < 2) {
+		return n;
+	}
+	return fib(n - 1) + fib(n - 2);
+}
+
+func main() {
+	i = fib(27);
+}
+)";
+			compiler::Compiler compiler(std::move(code));
+			const base::Program program = compiler.run();
+
+			constexpr size_t calls = 635'622; // fib(27) calls itself 2 * fib(28) - 1 times, plus main
+			test<stackmachine::StackMachine>(program, "fib(27) tagged", calls);
+			test<stackmachine::UntaggedStackMachine>(program, "fib(27) untagged", calls);
+			test<JitStackMachine>(program, "fib(27) jit", calls);
+		}
+
+		void testTailCall() {
+			std::string code = R"(
+int i = 0;
+
+func int sum(int n, int acc) {
+	if (n == 0) {
+		return acc;
+	}
+	return sum(n - 1, acc + n);
+}
+
+func main() {
+	i = sum(20000, 0);
+}
+)";
+			compiler::Compiler compiler(std::move(code));
+			const base::Program program = compiler.run();
+
+			constexpr size_t calls = 20'002;
+			test<stackmachine::StackMachine>(program, "sum(20000) tagged", calls);
+			test<stackmachine::UntaggedStackMachine>(program, "sum(20000) untagged", calls);
+			test<JitStackMachine>(program, "sum(20000) jit", calls);
+		}
+
+		void run() {
+			testFib();
+			testTailCall();
+		}
+	}
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iomanip>
+
+#include "Benchmark.h"
+#include "src/Compiler/Compiler.h"
+
+/* Compile time of generated programs that grow in one dimension: functions, globals, locals or distinct
+*  literals, from 10^2 to 10^5 of them. Every size gets the median of its runs per phase, the exponent
+*  between two sizes is how the time grows with the size: 1 is linear, 2 quadratic. A dimension stops
+*  growing when the next size would take longer than maxCompileTime at the growth seen so far. */
+namespace benchmark {
+	namespace compilerScaling {
+		constexpr int repeats = 5;
+		constexpr double superLinear = 1.3; // exponents above it get flagged
+		constexpr std::chrono::seconds maxCompileTime{ 20 };
+
+		// n functions, main calls every one of them
+		std::string functions(size_t n) {
+			std::ostringstream code;
+			for (size_t i = 0; i < n; i++) {
+				code << "func int f" << i << "(int a) {\n\treturn a + 1;\n}\n";
+			}
+			code << "func main() {\n\tint x = 0;\n";
+			for (size_t i = 0; i < n; i++) {
+				code << "\tx = f" << i << "(x);\n";
+			}
+			code << "}\n";
+			return code.str();
+		}
+
+		// n globals, main writes every one of them
+		std::string globals(size_t n) {
+			std::ostringstream code;
+			for (size_t i = 0; i < n; i++) {
+				code << "int g" << i << " = 0;\n";
+			}
+			code << "func main() {\n";
+			for (size_t i = 0; i < n; i++) {
+				code << "\tg" << i << " = g" << ((i + 1) % n) << " + 1;\n";
+			}
+			code << "}\n";
+			return code.str();
+		}
+
+		// n locals of main, each one reads the one before
+		std::string locals(size_t n) {
+			std::ostringstream code;
+			code << "func main() {\n\tint l0 = 0;\n";
+			for (size_t i = 1; i < n; i++) {
+				code << "\tint l" << i << " = l" << (i - 1) << " + 1;\n";
+			}
+			code << "}\n";
+			return code.str();
+		}
+
+		// n distinct literals
+		std::string literals(size_t n) {
+			std::ostringstream code;
+			code << "func main() {\n\tint x = 0;\n";
+			for (size_t i = 0; i < n; i++) {
+				code << "\tx = x + " << (i + 1) << ";\n";
+			}
+			code << "}\n";
+			return code.str();
+		}
+
+		void test(const std::string& name, const std::function<std::string(size_t)>& generate) {
+			std::cout << "Compiler scaling (" << name << "):\n";
+			std::cout << std::setw(8) << std::right << "size" << std::setw(14) << "tokenize" << std::setw(14) << "shunting" << std::setw(14) << "codegen"
+				<< std::setw(14) << "inlining" << std::setw(14) << "total" << std::setw(10) << "exponent" << "\n";
+
+			size_t previousSize = 0;
+			long double previousTotal = 0;
+			for (size_t size = 100; size <= 100'000; size *= 10) {
+				const std::string code = generate(size);
+
+				std::vector<long double> tokenize, shuntingYard, codegen, inlining, total;
+				for (int i = 0; i < repeats; i++) {
+					compiler::PhaseTimes times;
+					compiler::Compiler compiler{ std::string(code) };
+					compiler.run(times);
+					if (!compiler.isSuccess()) {
+						std::cout << "\tsize " << size << " doesn't compile\n\n";
+						return;
+					}
+					tokenize.push_back(times.tokenize.count());
+					shuntingYard.push_back(times.shuntingYard.count());
+					codegen.push_back(times.codegen.count());
+					inlining.push_back(times.inlining.count());
+					total.push_back(times.total().count());
+				}
+
+				std::cout << std::setw(8) << size << std::setw(14) << scale(median(tokenize)) << std::setw(14) << scale(median(shuntingYard))
+					<< std::setw(14) << scale(median(codegen)) << std::setw(14) << scale(median(inlining)) << std::setw(14) << scale(median(total));
+				double exponent = 1.0;
+				if (previousSize > 0) {
+					exponent = std::log(static_cast<double>(median(total) / previousTotal)) / std::log(static_cast<double>(size) / previousSize);
+					std::cout << std::setw(10) << std::setprecision(2) << std::fixed << exponent << std::defaultfloat << ((exponent > superLinear) ? "  <- super-linear" : "");
+				}
+				std::cout << std::endl; // a row at a time, the big sizes take a while
+
+				previousSize = size;
+				previousTotal = median(total);
+				const long double next = previousTotal * std::pow(10.0L, std::max(1.0, exponent));
+				if ((size < 100'000) and (next * repeats > std::chrono::duration_cast<std::chrono::nanoseconds>(maxCompileTime).count())) {
+					std::cout << "\tstopped, " << (size * 10) << " would take about " << scale(next) << " per compile" << std::endl;
+					break;
+				}
+			}
+			std::cout << "\n";
+		}
+
+		void run() {
+			test("functions", functions);
+			test("globals", globals);
+			test("locals", locals);
+			test("literals", literals);
+		}
+	}
+}
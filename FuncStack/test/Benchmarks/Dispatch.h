@@ -0,0 +1,119 @@
+#pragma once
+
+#include <chrono>
+
+#include "Benchmark.h"
+#include "src/Compiler/Compiler.h"
+#include "src/Stackmachine/Stackmachine.h"
+#include "src/Stackmachine/UntaggedStackmachine.h"
+#include "src/Registermachine/Registermachine.h"
+
+namespace benchmark {
+	namespace dispatch {
+		constexpr int repeats = 10;
+
+		void test(std::string&& code, const std::string& name) {
+			compiler::Compiler compiler(std::move(code));
+			const base::Program program = compiler.run();
+
+			for (stackmachine::DispatchMode mode : { stackmachine::DispatchMode::Switch, stackmachine::DispatchMode::Threaded }) {
+				std::vector<long double> times;
+				times.reserve(repeats);
+				for (int i = 0; i < repeats; i++) {
+					stackmachine::StackMachine machine(program, mode);
+
+					const auto start = std::chrono::steady_clock::now();
+					machine.exec();
+					const auto end = std::chrono::steady_clock::now();
+					times.push_back((end - start).count());
+				}
+				printResults(name + (mode == stackmachine::DispatchMode::Switch ? " switch" : " threaded"), times);
+			}
+
+			std::vector<long double> untaggedTimes;
+			untaggedTimes.reserve(repeats);
+			for (int i = 0; i < repeats; i++) {
+				stackmachine::UntaggedStackMachine machine(program);
+
+				const auto start = std::chrono::steady_clock::now();
+				machine.exec();
+				const auto end = std::chrono::steady_clock::now();
+				untaggedTimes.push_back((end - start).count());
+			}
+			printResults(name + " untagged", untaggedTimes);
+
+			const registermachine::RegisterProgram registerProgram = registermachine::RegisterCompiler(program).run();
+			std::vector<long double> times;
+			times.reserve(repeats);
+			for (int i = 0; i < repeats; i++) {
+				registermachine::RegisterMachine machine(registerProgram);
+
+				const auto start = std::chrono::steady_clock::now();
+				machine.exec();
+				const auto end = std::chrono::steady_clock::now();
+				times.push_back((end - start).count());
+			}
+			printResults(name + " register", times);
+		}
+
+		void testLoop() {
+			std::string code = R"(
+int i = 0;
+int j = 0;
+
+func main() {
+	while (i < 1000000) {
+		i++;
+		j = j + i;
+	}
+}
+)";
+			test(std::move(code), __func__);
+		}
+
+		void testNestedLoop() {
+			std::string code = R"(
+int i = 0;
+int j = 0;
+
+func main() {
+	for (int k = 0; k < 1000; k++) {
+		int l = 0;
+		while (l < 1000) {
+			l++;
+			if (l == k) {
+				continue;
+			}
+			j++;
+		}
+	}
+}
+)";
+			test(std::move(code), __func__);
+		}
+
+		void testCalls() {
+			std::string code = R"(
+int i = 0;
+
+func int fib(int n) {
+	if (n < 2) {
+		return n;
+	}
+	return fib(n - 1) + fib(n - 2);
+}
+
+func main() {
+	i = fib(25);
+}
+)";
+			test(std::move(code), __func__);
+		}
+
+		void run() {
+			testLoop();
+			testNestedLoop();
+			testCalls();
+		}
+	}
+}
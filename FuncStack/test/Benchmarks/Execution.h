@@ -0,0 +1,195 @@
+#pragma once
+
+#include <chrono>
+
+#include "Benchmark.h"
+#include "src/Compiler/Compiler.h"
+#include "src/Stackmachine/Stackmachine.h"
+
+/* The reference suite for changes to the compiler or the interpreter, built as FuncStackBenchmarks.
+*  Every script is compiled and executed repeats times, both timed on their own. The first global has
+*  to end with the expected value, a broken change doesn't get to look fast. */
+namespace benchmark {
+	namespace execution {
+		constexpr int repeats = 15;
+
+		void test(const std::string& code, const std::string& name, const base::BasicType& expected) {
+			std::vector<long double> compileTimes;
+			compileTimes.reserve(repeats);
+			base::Program program;
+			for (int i = 0; i < repeats; i++) {
+				const auto start = std::chrono::steady_clock::now();
+				compiler::Compiler compiler{ std::string(code) };
+				program = compiler.run();
+				const auto end = std::chrono::steady_clock::now();
+				compileTimes.push_back((end - start).count());
+				if (!compiler.isSuccess()) {
+					std::cout << name << " doesn't compile\n\n";
+					return;
+				}
+			}
+			const base::SharedProgram image = base::freeze(std::move(program));
+
+			std::vector<long double> execTimes;
+			execTimes.reserve(repeats);
+			for (int i = 0; i < repeats; i++) {
+				stackmachine::StackMachine machine(image);
+
+				const auto start = std::chrono::steady_clock::now();
+				machine.exec();
+				const auto end = std::chrono::steady_clock::now();
+				execTimes.push_back((end - start).count());
+
+				if (!(machine.getGlobalVariable(0) == expected).getBool()) {
+					std::cout << name << " computed " << machine.getGlobalVariable(0).toString() << " instead of " << expected.toString() << "\n\n";
+					return;
+				}
+			}
+
+			printResults(name + " compile", compileTimes);
+			printResults(name + " exec", execTimes);
+		}
+
+		void testFib() {
+			std::string code = R"(
+int result = 0;
+
+func int fib(int n) {
+	if (n < 2) {
+		return n;
+	}
+	return fib(n - 1) + fib(n - 2);
+}
+
+func main() {
+	result = fib(27);
+}
+)";
+			test(code, "fib(27)", base::BasicType(base::sm_int(196418)));
+		}
+
+		void testNestedLoops() {
+			std::string code = R"(
+int count = 0;
+
+func main() {
+	for (int i = 0; i < 2000; i++) {
+		if (i / 7 * 7 == i) {
+			continue;
+		}
+		for (int j = 0; j < 2000; j++) {
+			if (j > i) {
+				break;
+			}
+			if (j / 3 * 3 == j) {
+				continue;
+			}
+			count++;
+		}
+	}
+}
+)";
+			base::sm_int count = 0;
+			for (base::sm_int i = 0; i < 2000; i++) {
+				if (i % 7 == 0) {
+					continue;
+				}
+				for (base::sm_int j = 0; j <= i; j++) {
+					count += (j % 3 != 0) ? 1 : 0;
+				}
+			}
+			test(code, "nested loops", base::BasicType(count));
+		}
+
+		void testArithmetic() {
+			std::string intCode = R"(
+int acc = 0;
+
+func main() {
+	for (int i = 0; i < 1000000; i++) {
+		acc = acc + i * 3 - i / 2;
+	}
+}
+)";
+			base::sm_int intAcc = 0;
+			for (base::sm_int i = 0; i < 1'000'000; i++) {
+				intAcc = intAcc + i * 3 - i / 2;
+			}
+			test(intCode, "int arithmetic", base::BasicType(intAcc));
+
+			std::string uintCode = R"(
+uint acc = 0u;
+
+func main() {
+	for (uint i = 0u; i < 1000000u; i++) {
+		acc = acc + i * 3u - i / 2u;
+	}
+}
+)";
+			base::sm_uint uintAcc = 0;
+			for (base::sm_uint i = 0; i < 1'000'000; i++) {
+				uintAcc = uintAcc + i * 3 - i / 2;
+			}
+			test(uintCode, "uint arithmetic", base::BasicType(uintAcc));
+
+			std::string floatCode = R"(
+float acc = 0.0;
+
+func main() {
+	float x = 0.0;
+	for (int i = 0; i < 1000000; i++) {
+		x = x + 0.5;
+		acc = acc + x * 1.5 - x / 4.0;
+	}
+}
+)";
+			base::sm_float floatAcc = 0.0;
+			base::sm_float x = 0.0;
+			for (int i = 0; i < 1'000'000; i++) {
+				x = x + 0.5;
+				floatAcc = floatAcc + x * 1.5 - x / 4.0;
+			}
+			test(floatCode, "float arithmetic", base::BasicType(floatAcc));
+		}
+
+		void testCalls() {
+			// depth() recurses and can't be inlined, square() and add() get copied into their callers
+			std::string code = R"(
+int acc = 0;
+
+func int square(int n) {
+	return n * n;
+}
+
+func int add(int a, int b) {
+	return a + b;
+}
+
+func int depth(int n, int sum) {
+	if (n == 0) {
+		return sum;
+	}
+	return depth(n - 1, add(sum, square(n)));
+}
+
+func main() {
+	for (int i = 0; i < 10000; i++) {
+		acc = add(acc, depth(50, i));
+	}
+}
+)";
+			base::sm_int acc = 0;
+			for (base::sm_int i = 0; i < 10'000; i++) {
+				acc += i + 50 * 51 * 101 / 6;
+			}
+			test(code, "calls", base::BasicType(acc));
+		}
+
+		void run() {
+			testFib();
+			testNestedLoops();
+			testArithmetic();
+			testCalls();
+		}
+	}
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <chrono>
+#include <thread>
+
+#include "Benchmark.h"
+#include "src/Compiler/Compiler.h"
+#include "src/Stackmachine/Executor.h"
+
+namespace benchmark {
+	namespace executor {
+		constexpr int repeats = 5;
+		constexpr int jobs = 1000;
+
+		// Same batch of fib(20) calls with more and more threads, the speedup is relative to one thread
+		void run() {
+			std::string code = R"(
+func int fib(int n) {
+	if (n < 2) {
+		return n;
+	}
+	return fib(n - 1) + fib(n - 2);
+}
+
+func main() {
+}
+)";
+			compiler::Compiler compiler(std::move(code));
+			const base::SharedProgram program = base::freeze(compiler.run());
+
+			const size_t cores = std::max(1u, std::thread::hardware_concurrency());
+			std::vector<size_t> threadCounts;
+			for (size_t threads = 1; threads < cores; threads *= 2) {
+				threadCounts.push_back(threads);
+			}
+			threadCounts.push_back(cores);
+
+			long double singleThread = 0;
+			for (size_t threads : threadCounts) {
+				std::vector<long double> times;
+				for (int i = 0; i < repeats; i++) {
+					stackmachine::Executor executor(threads);
+					std::vector<std::future<std::optional<base::BasicType>>> results;
+					results.reserve(jobs);
+
+					const auto start = std::chrono::steady_clock::now();
+					for (int job = 0; job < jobs; job++) {
+						results.push_back(executor.submit(program, "fib", { base::BasicType(20) }));
+					}
+					for (std::future<std::optional<base::BasicType>>& result : results) {
+						result.wait();
+					}
+					const auto end = std::chrono::steady_clock::now();
+					times.push_back((end - start).count());
+				}
+
+				const long double fastest = *std::min_element(times.begin(), times.end());
+				if (threads == 1) {
+					singleThread = fastest;
+				}
+				std::cout << "\t" << threads << " threads: " << (jobs / (fastest / 1'000'000'000)) << " jobs/s, speedup " << (singleThread / fastest) << "\n";
+				printResults(std::to_string(jobs) + " x fib(20), " + std::to_string(threads) + " threads", times);
+			}
+		}
+	}
+}
@@ -1,11 +1,9 @@
 #pragma once
 
 #include <chrono>
-#include <sstream>
-#include <numeric>
-#include <algorithm>
 #include <random>
 
+#include "Benchmark.h"
 #include "src/Compiler/Tokenizer.h"
 
 namespace benchmark {
@@ -13,36 +11,6 @@ namespace benchmark {
 		constexpr int benchSize = 100'000;
 		constexpr int repeats = 20;
 
-		std::string scale(long double ticks) {
-			std::ostringstream o;
-			if (ticks > 1'000'000'000) {
-				o << (ticks / 1'000'000'000) << "s";
-			} else if (ticks > 1'000'000) {
-				o << (ticks / 1'000'000) << "ms";
-			} else if (ticks > 1'000) {
-				o << (ticks / 1'000) << "us";
-			} else {
-				o << ticks << "ns";
-			}
-
-			return o.str();
-		}
-
-		long double avg(const std::vector<long double>& v) {
-			return std::accumulate(v.begin(), v.end(), 0.0) / v.size();
-		}
-
-		void printResults(const std::string& name, std::vector<long double>& times) {
-			const auto mid = times.begin() + (times.size() / 2);
-			std::nth_element(times.begin(), mid, times.end());
-
-			std::cout << "Benchmark results (" << name << "):\n";
-			std::cout << "\tlongest:  " << scale(*std::max_element(times.begin(), times.end())) << "\n";
-			std::cout << "\tshortest: " << scale(*std::min_element(times.begin(), times.end())) << "\n";
-			std::cout << "\tmedian:   " << scale(*mid) << "\n";
-			std::cout << "\taverage:  " << scale(std::accumulate(times.begin(), times.end(), 0.0) / times.size()) << "\n\n";
-		}
-
 		void test(std::string&& code, const std::string& name) {
 			std::vector<long double> times;
 			times.reserve(repeats);
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "catch.hpp"
+#include "ForcedJit.h"
 #include "../src/Stackmachine/Stackmachine.h"
 #include "../src/Compiler/Compiler.h"
 
@@ -19,6 +20,7 @@ namespace completeTest {
 			std::cout << "Compile time:\t" << (std::chrono::steady_clock::now() - compilerStart) << std::endl;
 
 			StackMachine machine(std::move(program));
+			forcedJit::apply(machine);
 			INFO(machine.toString());
 
 			std::cout << machine.toString() << std::endl;
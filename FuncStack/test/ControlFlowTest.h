@@ -1,7 +1,9 @@
 #pragma once
 
 #include "catch.hpp"
+#include "ForcedJit.h"
 #include "../src/Stackmachine/Stackmachine.h"
+#include "../src/Registermachine/Registermachine.h"
 #include "../src/Compiler/Compiler.h"
 
 using namespace base;
@@ -18,15 +20,25 @@ namespace controlFlowTest {
 				code += "}";
 
 				Compiler compiler(std::move(code));
-				base::Program program = compiler.run();
+				const base::Program program = compiler.run();
 				REQUIRE(compiler.isSuccess());
 
-				StackMachine machine(std::move(program));
-				machine.exec();
+				for (DispatchMode mode : { DispatchMode::Switch, DispatchMode::Threaded }) {
+					StackMachine machine(program, mode);
+					forcedJit::apply(machine);
+					machine.exec();
 
-				INFO(machine.toString());
-				REQUIRE(machine.getDataStack().size() == 1);
-				REQUIRE(machine.getGlobalVariable(0).getInt() == expected.getInt());
+					INFO(machine.toString());
+					REQUIRE(machine.getDataStack().size() == 1);
+					REQUIRE(machine.getGlobalVariable(0).getInt() == expected.getInt());
+				}
+
+				registermachine::RegisterMachine registerMachine(registermachine::RegisterCompiler(program).run());
+				registerMachine.exec();
+
+				INFO(registerMachine.toString());
+				REQUIRE(registerMachine.getDataStack().size() == 1);
+				REQUIRE(registerMachine.getGlobalVariable(0).getInt() == expected.getInt());
 			} catch (const std::exception& e) {
 				FAIL(e.what());
 			}
@@ -43,17 +55,29 @@ namespace controlFlowTest {
 				code += "}";
 
 				Compiler compiler(std::move(code));
-				base::Program program = compiler.run();
+				const base::Program program = compiler.run();
 				REQUIRE(compiler.isSuccess());
 
-				StackMachine machine(std::move(program));
-				machine.exec();
+				for (DispatchMode mode : { DispatchMode::Switch, DispatchMode::Threaded }) {
+					StackMachine machine(program, mode);
+					forcedJit::apply(machine);
+					machine.exec();
 
-				INFO(machine.toString());
-				REQUIRE(machine.getDataStack().size() == 2);
+					INFO(machine.toString());
+					REQUIRE(machine.getDataStack().size() == 2);
+
+					for (int i = 0; i < expected.size(); i++) {
+						REQUIRE((machine.getGlobalVariable(i) == expected[i]).getBool());
+					}
+				}
 
+				registermachine::RegisterMachine registerMachine(registermachine::RegisterCompiler(program).run());
+				registerMachine.exec();
+
+				INFO(registerMachine.toString());
+				REQUIRE(registerMachine.getDataStack().size() == 2);
 				for (int i = 0; i < expected.size(); i++) {
-					REQUIRE((machine.getGlobalVariable(i) == expected[i]).getBool());
+					REQUIRE((registerMachine.getGlobalVariable(i) == expected[i]).getBool());
 				}
 			} catch (const std::exception& e) {
 				FAIL(e.what());
@@ -84,6 +108,10 @@ namespace controlFlowTest {
 		test_dataStack("if ( 1 + 4 != 2 + 3 ) { i = 2; } else { i = 3; }", BasicType(3));
 		test_dataStack("if ( 1 + 4 != 22 + 33 ) { i = 2; } else { i = 3; }", BasicType(2));
 
+		// Inner brackets
+		test_dataStack("if ( (1 + 2) * 3 == 9 ) { i = 2; } else { i = 3; }", BasicType(2));
+		test_dataStack("while ( (i + 1) * 2 < 10 ) { i++; }", BasicType(4));
+
 		// else if
 		test_dataStack("if ( false ) { i = 1; } else if ( false ) { i = 2; } else if (false) {i = 3;} else { i = 4; }", BasicType(4));
 
@@ -200,5 +228,74 @@ for (int j = 0; j < 10; j++) {
 }
 )";
 		test_dataStack(std::move(code), BasicType(10));
+
+		// continue runs the iteration, both keep the loop variable for the POP at the end of the loop
+		code = R"(
+for (int j = 0; j < 10; j++) {
+	if (j == 2) {
+		continue;
+	}
+	if (j == 6) {
+		break;
+	}
+	i = i + j;
+}
+)";
+		test_dataStack(std::move(code), BasicType(13));
+	}
+
+	TEST_CASE("ControlFlow-Test-superinstructions") {
+		std::string code = R"(
+int i = 0;
+int j = 0;
+
+func main() {
+	int a = 0;
+	int b = 10;
+	while (a < b) {
+		a++;
+		int c = a * 2;
+		c = c + a;
+		if (c == 12) {
+			j = c;
+		}
+	}
+	i = a;
+}
+)";
+
+		try {
+			Compiler compiler(std::move(code));
+			const base::Program program = compiler.run();
+			REQUIRE(compiler.isSuccess());
+
+			for (base::OpCode superinstruction : { base::OpCode::LESS_LOCAL_LOCAL_INT, base::OpCode::INCR_LOCAL_INT, base::OpCode::MULT_LOCAL_LITERAL_INT, base::OpCode::ADD_INT_STORE_LOCAL, base::OpCode::EQ_LOCAL_LITERAL_INT }) {
+				INFO(opCodeName(superinstruction));
+				REQUIRE(std::any_of(program.bytecode.begin(), program.bytecode.end(), [&](const base::Operation& op) {
+					return op.getOpCode() == superinstruction;
+				}));
+			}
+
+			for (DispatchMode mode : { DispatchMode::Switch, DispatchMode::Threaded }) {
+				StackMachine machine(program, mode);
+				forcedJit::apply(machine);
+				REQUIRE(machine.toString().find("<incr_local_int>") != std::string::npos);
+				machine.exec();
+
+				INFO(machine.toString());
+				REQUIRE(machine.getDataStack().size() == 2);
+				REQUIRE(machine.getGlobalVariable(0).getInt() == 10);
+				REQUIRE(machine.getGlobalVariable(1).getInt() == 12);
+			}
+
+			registermachine::RegisterMachine registerMachine(registermachine::RegisterCompiler(program).run());
+			registerMachine.exec();
+
+			INFO(registerMachine.toString());
+			REQUIRE(registerMachine.getGlobalVariable(0).getInt() == 10);
+			REQUIRE(registerMachine.getGlobalVariable(1).getInt() == 12);
+		} catch (const std::exception& e) {
+			FAIL(e.what());
+		}
 	}
 }
\ No newline at end of file
@@ -0,0 +1,140 @@
+#pragma once
+
+#include "catch.hpp"
+#include "ForcedJit.h"
+#include "../src/Stackmachine/Stackmachine.h"
+#include "../src/Compiler/Compiler.h"
+
+using namespace base;
+using namespace compiler;
+
+namespace execBudgetTest {
+	// Runs the program in slices of budget operations, it has to end with the same globals as a single exec()
+	size_t testSlices(const std::string& code, size_t budget) {
+		INFO(code + " / " + std::to_string(budget));
+		size_t pauses = 0;
+		Compiler compiler(std::string(code), 0);
+		const base::SharedProgram program = base::freeze(compiler.run());
+		REQUIRE(compiler.isSuccess());
+
+		stackmachine::StackMachine reference(program);
+		forcedJit::apply(reference);
+		reference.exec();
+
+		for (stackmachine::DispatchMode mode : { stackmachine::DispatchMode::Switch, stackmachine::DispatchMode::Threaded }) {
+			stackmachine::StackMachine machine(program, mode);
+			forcedJit::apply(machine);
+			pauses = 0;
+			while (machine.exec(budget) == stackmachine::ExecState::Paused and pauses < 1'000'000) {
+				pauses++;
+			}
+
+			REQUIRE(machine.getDataStack().size() == reference.getDataStack().size());
+			for (size_t i = 0; i < reference.getDataStack().size(); i++) {
+				REQUIRE((machine.getGlobalVariable(i) == reference.getGlobalVariable(i)).getBool());
+			}
+			REQUIRE(machine.exec(budget) == stackmachine::ExecState::Finished); // stays finished
+		}
+		return pauses;
+	}
+
+	TEST_CASE("ExecBudget-Test") {
+		const std::string loops = R"(
+int i = 0;
+int k = 0;
+
+func main() {
+	while (i < 100) {
+		k = 0;
+		while (k < 10) {
+			k++;
+		}
+		i++;
+	}
+}
+)";
+		REQUIRE(testSlices(loops, 1'000'000) == 0);
+		REQUIRE(testSlices(loops, 50) > 10);
+		REQUIRE(testSlices(loops, 1) > 100);
+
+		const std::string recursion = R"(
+int i = 0;
+
+func int fib(int n) {
+	if (n < 2) {
+		return n;
+	}
+	return fib(n - 1) + fib(n - 2);
+}
+
+func int sum(int n, int acc) {
+	if (n == 0) {
+		return acc;
+	}
+	return sum(n - 1, acc + n);
+}
+
+func main() {
+	i = fib(15) + sum(500, 0);
+}
+)";
+		REQUIRE(testSlices(recursion, 100) > 10); // calls are charged even without any loop
+		testSlices(recursion, 1);
+	}
+
+	TEST_CASE("ExecBudget-Test-endless") {
+		Compiler compiler(std::string("bool b = true; int i = 0; func main() { while (b) { i++; } }"));
+		stackmachine::StackMachine machine(compiler.run());
+		forcedJit::apply(machine);
+		REQUIRE(compiler.isSuccess());
+
+		REQUIRE(machine.exec(1000) == stackmachine::ExecState::Paused);
+		const sm_int first = machine.getGlobalVariable(1).getUnchecked<sm_int>();
+		REQUIRE(first > 10);
+		REQUIRE(first <= 1000);
+
+		REQUIRE(machine.exec(1000) == stackmachine::ExecState::Paused);
+		const sm_int second = machine.getGlobalVariable(1).getUnchecked<sm_int>();
+		REQUIRE(second > first);
+		REQUIRE(second <= 2 * first + 1);
+	}
+
+	TEST_CASE("ExecBudget-Test-jit") {
+		// spin is compiled to native code, a budgeted run still pauses in its endless loop
+		Compiler compiler(std::string(R"(
+int r = 0;
+
+func int spin(int n) {
+	int i = 0;
+	while (i != n) {
+		i++;
+	}
+	return i;
+}
+
+func int warm(int n) {
+	return spin(n) + 1;
+}
+
+func main() {
+	r = spin(1) + spin(0 - 1);
+}
+)"), 0);
+		const base::SharedProgram program = base::freeze(compiler.run());
+		REQUIRE(compiler.isSuccess());
+
+		stackmachine::StackMachine machine(program);
+		machine.enableJit(1);
+		const std::vector<BasicType> arguments = { BasicType(sm_int(1)) };
+		REQUIRE((machine.call(program->function("warm", { TypeIndex::Int })->entry, arguments).value() == BasicType(sm_int(2))).getBool());
+		REQUIRE(machine.isJitCompiled(program->function("spin", { TypeIndex::Int })->entry) == SM_JIT);
+
+		// call() ended the program of the machine, a fiber runs it again
+		const std::shared_ptr<stackmachine::StackMachine::Fiber> fiber = machine.createFiber();
+		const auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < 10; i++) {
+			REQUIRE(machine.resume(fiber, 1000) == stackmachine::ExecState::Paused);
+		}
+		REQUIRE(std::chrono::steady_clock::now() - start < std::chrono::seconds(1));
+	}
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "catch.hpp"
+#include "ForcedJit.h"
+#include "../src/Stackmachine/Stackmachine.h"
+#include "../src/Stackmachine/Executor.h"
+#include "../src/Compiler/Compiler.h"
+
+using namespace base;
+using namespace compiler;
+
+namespace executorTest {
+	const std::string code = R"(
+int offset = 5;
+int calls = 0;
+
+func int fib(int n) {
+	if (n < 2) {
+		return n;
+	}
+	return fib(n - 1) + fib(n - 2);
+}
+
+func int shifted(int n) {
+	calls++;
+	return n + offset + calls;
+}
+
+func int divide(int a, int b) {
+	return a / b;
+}
+
+func int tick() {
+	offset++;
+	return offset;
+}
+
+func main() {
+	offset = 100;
+}
+)";
+
+	sm_int fib(sm_int n) {
+		return (n < 2) ? n : fib(n - 1) + fib(n - 2);
+	}
+
+	TEST_CASE("Executor-Test-call") {
+		for (size_t inlineThreshold : { size_t(0), compiler::Inliner::defaultThreshold }) {
+			Compiler compiler(std::string(code), inlineThreshold);
+			const base::SharedProgram program = base::freeze(compiler.run());
+			REQUIRE(compiler.isSuccess());
+
+			stackmachine::StackMachine machine(program);
+			forcedJit::apply(machine);
+			const size_t shifted = program->function("shifted", { TypeIndex::Int })->entry;
+			// main never runs, every call starts with the globals of the declarations
+			for (int i = 0; i < 3; i++) {
+				const std::vector<BasicType> arguments = { BasicType(10) };
+				REQUIRE(machine.call(shifted, arguments).value().getInt() == 16);
+			}
+			REQUIRE(machine.getGlobalVariable(1).getInt() == 1);
+
+			const size_t tick = program->function("tick", {})->entry;
+			REQUIRE(machine.call(tick, {}).value().getInt() == 6);
+
+			const std::vector<BasicType> wrongType = { BasicType(true) };
+			REQUIRE_THROWS_WITH(machine.call(shifted, wrongType), "Wrong argument type for shifted");
+			REQUIRE_THROWS_WITH(machine.call(shifted, {}), "Wrong number of arguments for shifted");
+			REQUIRE_THROWS_WITH(machine.call(program->bytecode.size(), {}), "No function at " + std::to_string(program->bytecode.size()));
+		}
+	}
+
+	TEST_CASE("Executor-Test") {
+		Compiler compiler(std::string(code), 0);
+		const base::SharedProgram program = base::freeze(compiler.run());
+		REQUIRE(compiler.isSuccess());
+
+		stackmachine::Executor executor(4, forcedJit::hotThreshold);
+		REQUIRE(executor.size() == 4);
+
+		std::vector<std::future<std::optional<BasicType>>> results;
+		for (int i = 0; i < 400; i++) {
+			results.push_back(executor.submit(program, "fib", { BasicType(i % 15) }));
+		}
+		for (int i = 0; i < 400; i++) {
+			REQUIRE(results[i].get().value().getInt() == fib(i % 15));
+		}
+
+		std::future<std::optional<BasicType>> failing = executor.submit(program, "divide", { BasicType(1), BasicType(0) });
+		std::future<std::optional<BasicType>> working = executor.submit(program, "divide", { BasicType(9), BasicType(3) });
+		REQUIRE_THROWS_WITH(failing.get(), "Division through zero");
+		REQUIRE(working.get().value().getInt() == 3); // the machine is fine after the error
+
+		REQUIRE_THROWS_WITH(executor.submit(program, "fib", { BasicType(true) }), "Unknown function: fib");
+	}
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <optional>
+
+#include "../src/Stackmachine/Stackmachine.h"
+
+namespace forcedJit {
+	// Only set by main for the second run of the suite, every function that can be compiled runs in native code from its first call on
+	inline std::optional<size_t> hotThreshold;
+
+	// The tests call it for the machines they want to run with the JIT in the second run
+	inline void apply(stackmachine::StackMachine& machine) {
+		if (hotThreshold.has_value()) {
+			machine.enableJit(hotThreshold.value());
+		}
+	}
+}
@@ -1,7 +1,10 @@
 #pragma once
 
 #include "catch.hpp"
+#include "ForcedJit.h"
 #include "../src/Stackmachine/Stackmachine.h"
+#include "../src/Stackmachine/UntaggedStackmachine.h"
+#include "../src/Registermachine/Registermachine.h"
 #include "../src/Compiler/Compiler.h"
 
 using namespace base;
@@ -32,20 +35,111 @@ func main() {
 
 		try {
 			Compiler compiler(std::move(code));
-			base::Program program = compiler.run();
+			const base::Program program = compiler.run();
 			REQUIRE(compiler.isSuccess());
 
-			StackMachine machine(std::move(program));
-			INFO(machine.toString());
-			machine.exec();
+			for (DispatchMode mode : { DispatchMode::Switch, DispatchMode::Threaded }) {
+				StackMachine machine(program, mode);
+				forcedJit::apply(machine);
+				INFO(machine.toString());
+				machine.exec();
 
-			INFO(machine.toString());
-			REQUIRE(machine.getDataStack().size() == 3);
-			REQUIRE((machine.getGlobalVariable(0) == base::BasicType(1)).getBool());
-			REQUIRE((machine.getGlobalVariable(1) == base::BasicType(3)).getBool());
-			REQUIRE((machine.getGlobalVariable(2) == base::BasicType(4)).getBool());
+				INFO(machine.toString());
+				REQUIRE(machine.getDataStack().size() == 3);
+				REQUIRE((machine.getGlobalVariable(0) == base::BasicType(1)).getBool());
+				REQUIRE((machine.getGlobalVariable(1) == base::BasicType(3)).getBool());
+				REQUIRE((machine.getGlobalVariable(2) == base::BasicType(4)).getBool());
+			}
+
+			registermachine::RegisterMachine registerMachine(registermachine::RegisterCompiler(program).run());
+			registerMachine.exec();
+
+			INFO(registerMachine.toString());
+			REQUIRE(registerMachine.getDataStack().size() == 3);
+			REQUIRE((registerMachine.getGlobalVariable(0) == base::BasicType(1)).getBool());
+			REQUIRE((registerMachine.getGlobalVariable(1) == base::BasicType(3)).getBool());
+			REQUIRE((registerMachine.getGlobalVariable(2) == base::BasicType(4)).getBool());
 		} catch (const std::exception& e) {
 			FAIL(e.what());
 		}
 	}
-}
\ No newline at end of file
+	TEST_CASE("Function-Test-stack-overflow") {
+		std::string code = R"(
+int i = 0;
+
+func int down(int n) {
+	return down(n + 1) + 1;
+}
+
+func main() {
+	i = down(0);
+}
+)";
+
+		Compiler compiler(std::move(code));
+		const base::Program program = compiler.run();
+		REQUIRE(compiler.isSuccess());
+
+		for (DispatchMode mode : { DispatchMode::Switch, DispatchMode::Threaded }) {
+			StackMachine machine(program, mode, 256);
+			forcedJit::apply(machine);
+			REQUIRE_THROWS_WITH(machine.exec(), "Stack overflow");
+		}
+
+		UntaggedStackMachine untaggedMachine(program, 256);
+		REQUIRE_THROWS_WITH(untaggedMachine.exec(), "Stack overflow");
+	}
+
+	TEST_CASE("Function-Test-tail-call") {
+		std::string code = R"(
+int i = 0;
+int j = 0;
+
+func int sum(int n, int acc) {
+	if (n == 0) {
+		return acc;
+	}
+	return sum(n - 1, acc + n);
+}
+
+func int swap(int a, int b, int steps) {
+	if (steps == 0) {
+		return a - b;
+	}
+	return swap(b, a, steps - 1);
+}
+
+func main() {
+	i = sum(10000, 0);
+	j = swap(1, 2, 7);
+}
+)";
+
+		Compiler compiler(std::move(code));
+		const base::Program program = compiler.run();
+		REQUIRE(compiler.isSuccess());
+		REQUIRE(std::count_if(program.bytecode.begin(), program.bytecode.end(), [](const base::Operation& op) { return op.getOpCode() == base::OpCode::TAIL_CALL; }) == 2);
+
+		// 10000 levels of recursion only fit into 256 slots if the frames get reused
+		for (DispatchMode mode : { DispatchMode::Switch, DispatchMode::Threaded }) {
+			StackMachine machine(program, mode, 256);
+			forcedJit::apply(machine);
+			machine.exec();
+
+			INFO(machine.toString());
+			REQUIRE((machine.getGlobalVariable(0) == base::BasicType(50005000)).getBool());
+			REQUIRE((machine.getGlobalVariable(1) == base::BasicType(1)).getBool());
+		}
+
+		UntaggedStackMachine untaggedMachine(program, 256);
+		untaggedMachine.exec();
+		REQUIRE((untaggedMachine.getGlobalVariable(0) == base::BasicType(50005000)).getBool());
+		REQUIRE((untaggedMachine.getGlobalVariable(1) == base::BasicType(1)).getBool());
+
+		registermachine::RegisterMachine registerMachine(registermachine::RegisterCompiler(program).run(), 256);
+		registerMachine.exec();
+		INFO(registerMachine.toString());
+		REQUIRE((registerMachine.getGlobalVariable(0) == base::BasicType(50005000)).getBool());
+		REQUIRE((registerMachine.getGlobalVariable(1) == base::BasicType(1)).getBool());
+	}
+}
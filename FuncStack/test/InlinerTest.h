@@ -0,0 +1,205 @@
+#pragma once
+
+#include "catch.hpp"
+#include "ForcedJit.h"
+#include "../src/Stackmachine/Stackmachine.h"
+#include "../src/Stackmachine/UntaggedStackmachine.h"
+#include "../src/Registermachine/Registermachine.h"
+#include "../src/Compiler/Compiler.h"
+
+using namespace base;
+using namespace compiler;
+
+namespace inlinerTest {
+	// Calls that can still be executed, the original bodies of inlined functions stay in the bytecode
+	size_t countCalls(const base::Program& program) {
+		const base::StackDepths depths(program.bytecode);
+		size_t calls = 0;
+		for (size_t i = 0; i < program.bytecode.size(); i++) {
+			if (base::isCall(program.bytecode[i].getOpCode()) and depths.depth(i).has_value()) {
+				calls++;
+			}
+		}
+		return calls;
+	}
+
+	template<typename Machine>
+	void requireSameGlobals(const Machine& machine, const stackmachine::StackMachine& reference) {
+		REQUIRE(machine.getDataStack().size() == reference.getDataStack().size());
+		for (size_t i = 0; i < reference.getDataStack().size(); i++) {
+			REQUIRE(machine.getGlobalVariable(i).typeId() == reference.getGlobalVariable(i).typeId());
+			REQUIRE((machine.getGlobalVariable(i) == reference.getGlobalVariable(i)).getBool());
+		}
+	}
+
+	// The program without inlining is the reference, every machine has to end with the same globals
+	void test(const std::string& code, size_t remainingCalls) {
+		SECTION(code) {
+			try {
+				Compiler referenceCompiler(std::string(code), 0);
+				const base::Program referenceProgram = referenceCompiler.run();
+				REQUIRE(referenceCompiler.isSuccess());
+				stackmachine::StackMachine reference(referenceProgram);
+				forcedJit::apply(reference);
+				reference.exec();
+				INFO(reference.toString());
+
+				Compiler compiler(std::string(code), 1000);
+				const base::Program program = compiler.run();
+				REQUIRE(compiler.isSuccess());
+				REQUIRE(countCalls(program) == remainingCalls);
+
+				for (stackmachine::DispatchMode mode : { stackmachine::DispatchMode::Switch, stackmachine::DispatchMode::Threaded }) {
+					stackmachine::StackMachine machine(program, mode);
+					forcedJit::apply(machine);
+					INFO(machine.toString());
+					machine.exec();
+					requireSameGlobals(machine, reference);
+				}
+
+				stackmachine::UntaggedStackMachine untaggedMachine(program);
+				untaggedMachine.exec();
+				requireSameGlobals(untaggedMachine, reference);
+
+				registermachine::RegisterMachine registerMachine(registermachine::RegisterCompiler(program).run());
+				INFO(registerMachine.toString());
+				registerMachine.exec();
+				requireSameGlobals(registerMachine, reference);
+			} catch (const std::exception& e) {
+				FAIL(e.what());
+			}
+		}
+	}
+
+	TEST_CASE("Inliner-Test") {
+		// main is inlined into the top level code as well, only the calls of the recursive fib stay
+		test(R"(
+int i = 0;
+int j = 0;
+
+func int add(int a, int b) {
+	return a + b;
+}
+
+func int fib(int n) {
+	if (n < 2) {
+		return n;
+	}
+	return fib(n - 1) + fib(n - 2);
+}
+
+func main() {
+	int t = add(2, 3);
+	i = add(1, t);
+	j = fib(12) + add(i, i);
+}
+)", 3);
+
+		test(R"(
+int i = 0;
+int j = 0;
+
+func int clamp(int v) {
+	if (v > 10) {
+		return 10;
+	}
+	int w = v * 2;
+	return w;
+}
+
+func count(int n) {
+	for (int k = 0; k < n; k++) {
+		j++;
+	}
+}
+
+func main() {
+	for (int k = 0; k < 8; k++) {
+		i = i + clamp(k);
+		count(k);
+	}
+}
+)", 0);
+
+		test(R"(
+int i = 0;
+
+func int twice(int a) {
+	return a + a;
+}
+
+func int quad(int a) {
+	return twice(twice(a));
+}
+
+func int plusOne(int a) {
+	return twice(a) + 1;
+}
+
+func main() {
+	int a = 3;
+	int b = quad(a);
+	i = plusOne(b);
+}
+)", 0);
+	}
+
+	TEST_CASE("Inliner-Test-forwarded-arguments") {
+		// arguments that are single loads are used directly, unless the body could see a different value
+		test(R"(
+int i = 0;
+int j = 0;
+
+func int bump(int a) {
+	i = i + 1;
+	return a + i;
+}
+
+func int decrement(int a, int b) {
+	if (a < 3) {
+		return b;
+	}
+	a = a - 1;
+	return a + b;
+}
+
+func main() {
+	j = bump(i);
+	j = j + decrement(5, j);
+	j = j + decrement(1, 2);
+	int k = 4;
+	j = j + decrement(k, i);
+}
+)", 0);
+	}
+
+	TEST_CASE("Inliner-Test-threshold") {
+		const std::string code = R"(
+int i = 0;
+
+func int add(int a, int b) {
+	return a + b;
+}
+
+func main() {
+	i = add(1, 2);
+}
+)";
+
+		Compiler disabled(std::string(code), 0);
+		const base::Program notInlined = disabled.run();
+		REQUIRE(countCalls(notInlined) == 2);
+
+		Compiler onlyAdd(std::string(code), 4); // the body of add has 4 operations, main 5
+		REQUIRE(countCalls(onlyAdd.run()) == 1);
+
+		Compiler enabled(std::string(code), Inliner::defaultThreshold);
+		const base::Program inlined = enabled.run();
+		REQUIRE(countCalls(inlined) == 0);
+
+		stackmachine::StackMachine machine(inlined);
+		forcedJit::apply(machine);
+		machine.exec();
+		REQUIRE((machine.getGlobalVariable(0) == base::BasicType(3)).getBool());
+	}
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "catch.hpp"
+#include "../src/Stackmachine/Stackmachine.h"
+#include "../src/Compiler/Compiler.h"
+
+using namespace base;
+using namespace compiler;
+
+namespace instrumentationTest {
+#ifdef SM_INSTRUMENTATION
+	size_t indexOf(const base::Program& program, base::OpCode opCode) {
+		const auto pos = std::find_if(program.bytecode.begin(), program.bytecode.end(), [&](const base::Operation& op) { return op.getOpCode() == opCode; });
+		REQUIRE(pos != program.bytecode.end());
+		return pos - program.bytecode.begin();
+	}
+
+	TEST_CASE("Instrumentation-Test") {
+		Compiler compiler(std::string(R"(
+int i = 0;
+func main() {
+	while (i < 10) {
+		i = i + 1;
+	}
+}
+)"), 0);
+		const base::Program program = compiler.run();
+		REQUIRE(compiler.isSuccess());
+
+		for (stackmachine::DispatchMode mode : { stackmachine::DispatchMode::Switch, stackmachine::DispatchMode::Threaded }) {
+			stackmachine::StackMachine machine(program, mode);
+			machine.exec();
+			const stackmachine::Instrumentation& counts = machine.getInstrumentation();
+			INFO(counts.toString());
+
+			REQUIRE(counts.executions(OpCode::LESS_INT) == 11);
+			REQUIRE(counts.executions(OpCode::ADD_INT) == 10);
+			REQUIRE(counts.executions(OpCode::END_PROGRAM) == 1);
+			REQUIRE(counts.executions(OpCode::LESS_INT, OpCode::JUMP_IF_NOT) == 11);
+			REQUIRE(counts.executions(OpCode::ADD_INT, OpCode::STORE_GLOBAL) == 10);
+			REQUIRE(counts.executions(OpCode::ADD_INT, OpCode::LESS_INT) == 0);
+			REQUIRE(counts.hits(indexOf(program, OpCode::ADD_INT)) == 10);
+			REQUIRE(counts.hits(program.bytecode.size() - 1) == 1);
+
+			uint64_t operations = 0;
+			uint64_t hits = 0;
+			uint64_t pairs = 0;
+			for (size_t op = 0; op < stackmachine::Instrumentation::opCodes; op++) {
+				operations += counts.executions(static_cast<OpCode>(op));
+				for (size_t next = 0; next < stackmachine::Instrumentation::opCodes; next++) {
+					pairs += counts.executions(static_cast<OpCode>(op), static_cast<OpCode>(next));
+				}
+			}
+			for (size_t i = 0; i < program.bytecode.size(); i++) {
+				hits += counts.hits(i);
+			}
+			REQUIRE(operations == hits);
+			REQUIRE(pairs == operations - 1);
+
+			const std::string json = counts.toJson();
+			REQUIRE(json.find("{ \"op\": \"<less_int>\", \"count\": 11 }") != std::string::npos);
+			REQUIRE(json.find("{ \"first\": \"<less_int>\", \"second\": \"<jump_if_not>\", \"count\": 11 }") != std::string::npos);
+			const std::string csv = counts.toCsv();
+			REQUIRE(csv.find("kind,first,second,index,count\n") == 0);
+			REQUIRE(csv.find("\npair,\"<add_int>\",\"<store_global>\",,10\n") != std::string::npos);
+			REQUIRE(csv.find("\nindex,\"<add_int>\",," + std::to_string(indexOf(program, OpCode::ADD_INT)) + ",10\n") != std::string::npos);
+			REQUIRE(machine.toString().find("Instrumentation:") != std::string::npos);
+
+			machine.getInstrumentation().reset();
+			REQUIRE(counts.executions(OpCode::ADD_INT) == 0);
+			REQUIRE(counts.toCsv() == "kind,first,second,index,count\n");
+		}
+	}
+#endif
+}
@@ -0,0 +1,188 @@
+#pragma once
+
+#include "catch.hpp"
+#include "../src/Stackmachine/Stackmachine.h"
+#include "../src/Compiler/Compiler.h"
+
+using namespace base;
+using namespace compiler;
+
+namespace jitTest {
+	size_t entryOf(const base::Program& program, const std::string& name) {
+		for (const base::FunctionSignature& function : program.functions) {
+			if (function.name == name) {
+				return function.entry;
+			}
+		}
+		FAIL("Unknown function " + name);
+		return 0;
+	}
+
+	/* The interpreted program is the reference, with the JIT every machine has to end with the same globals.
+	*  compiled and interpreted name the functions that have to end up in native code or stay in the interpreter. */
+	void test(const std::string& code, const std::vector<std::string>& compiled, const std::vector<std::string>& interpreted = {}) {
+		SECTION(code) {
+			try {
+				Compiler compiler(std::string(code), 0);
+				const base::Program program = compiler.run();
+				REQUIRE(compiler.isSuccess());
+
+				stackmachine::StackMachine reference(program);
+				reference.exec();
+				INFO(reference.toString());
+
+				for (stackmachine::DispatchMode mode : { stackmachine::DispatchMode::Switch, stackmachine::DispatchMode::Threaded }) {
+					stackmachine::StackMachine machine(program, mode);
+					machine.enableJit(0);
+					machine.exec();
+
+					REQUIRE(machine.getDataStack().size() == reference.getDataStack().size());
+					for (size_t i = 0; i < reference.getDataStack().size(); i++) {
+						REQUIRE(machine.getGlobalVariable(i).typeId() == reference.getGlobalVariable(i).typeId());
+						REQUIRE((machine.getGlobalVariable(i) == reference.getGlobalVariable(i)).getBool());
+					}
+
+					for (const std::string& name : compiled) {
+						REQUIRE(machine.isJitCompiled(entryOf(program, name)) == SM_JIT);
+					}
+					for (const std::string& name : interpreted) {
+						REQUIRE_FALSE(machine.isJitCompiled(entryOf(program, name)));
+					}
+				}
+			} catch (const std::exception& e) {
+				FAIL(e.what());
+			}
+		}
+	}
+
+	TEST_CASE("Jit-Test") {
+		test(R"(
+int i = 0;
+bool b = false;
+
+func int fib(int n) {
+	if (n < 2) {
+		return n;
+	}
+	return fib(n - 1) + fib(n - 2);
+}
+
+func int sum(int n, int acc) {
+	if (n == 0) {
+		return acc;
+	}
+	return sum(n - 1, acc + n);
+}
+
+func bool isEven(int n) {
+	int half = n / 2;
+	return half * 2 == n;
+}
+
+func int loop(int n) {
+	int k = 0;
+	int product = 1;
+	while (k < n) {
+		k++;
+		if (isEven(k)) {
+			product = product * 3 - k;
+		}
+	}
+	return product;
+}
+
+func main() {
+	i = fib(15) + sum(100, 0) + loop(20);
+	b = isEven(i);
+}
+)", { "fib", "sum", "isEven", "loop" }, { "main" });
+	}
+
+	TEST_CASE("Jit-Test-fallback") {
+		// globals and floats stay in the interpreter, callers of such functions as well
+		test(R"(
+int i = 0;
+float f = 0.0;
+
+func int bump(int a) {
+	i = i + a;
+	return i;
+}
+
+func float half(float a) {
+	return a / 2.0;
+}
+
+func int twice(int a) {
+	return bump(a) * 2;
+}
+
+func int triple(int a) {
+	return a * 3;
+}
+
+func main() {
+	i = twice(3) + triple(2);
+	f = half(3.0);
+}
+)", { "triple" }, { "bump", "half", "twice" });
+
+		// errors are raised by the interpreter, which runs the whole call again
+		const std::string code = R"(
+int i = 0;
+
+func int divide(int a, int b) {
+	return a / b;
+}
+
+func main() {
+	i = divide(6, 3);
+	i = divide(i, 0);
+}
+)";
+		Compiler compiler((std::string(code)));
+		const base::Program program = compiler.run();
+		REQUIRE(compiler.isSuccess());
+
+		stackmachine::StackMachine machine(program);
+		machine.enableJit(0);
+		REQUIRE_THROWS_WITH(machine.exec(), "Division through zero");
+		REQUIRE((machine.getGlobalVariable(0) == base::BasicType(2)).getBool());
+
+		Compiler overflowCompiler(std::string(R"(
+int i = 0;
+
+func int down(int n) {
+	return down(n + 1) + 1;
+}
+
+func main() {
+	i = down(0);
+}
+)"));
+		stackmachine::StackMachine overflowMachine(overflowCompiler.run(), stackmachine::DispatchMode::Threaded, 256);
+		overflowMachine.enableJit(0);
+		REQUIRE_THROWS_WITH(overflowMachine.exec(), "Stack overflow");
+	}
+
+	TEST_CASE("Jit-Test-failing-recursion") {
+		// once native code failed the interpreter runs the rest of the recursion, not native code at every level again
+		Compiler compiler(std::string(R"(
+int i = 0;
+
+func int down(int n) {
+	return down(n + 1) + 1;
+}
+
+func main() {
+	i = down(0);
+}
+)"));
+		stackmachine::StackMachine machine(compiler.run());
+		machine.enableJit(1);
+
+		const auto start = std::chrono::steady_clock::now();
+		REQUIRE_THROWS_WITH(machine.exec(), "Stack overflow");
+		REQUIRE(std::chrono::steady_clock::now() - start < std::chrono::seconds(2));
+	}
+}
@@ -1,7 +1,9 @@
 #pragma once
 
 #include "catch.hpp"
+#include "ForcedJit.h"
 #include "../src/Stackmachine/Stackmachine.h"
+#include "../src/Registermachine/Registermachine.h"
 #include "../src/Compiler/Compiler.h"
 
 using namespace stackmachine;
@@ -20,13 +22,57 @@ namespace operatorTest {
 				base::Program program = compiler.run();
 				REQUIRE(compiler.isSuccess());
 
-				StackMachine machine(std::move(program));
+				StackMachine machine(program);
+				forcedJit::apply(machine);
 				INFO(machine.toString());
 				machine.exec();
 
 				INFO(machine.toString());
 				REQUIRE(machine.getDataStack().size() == 1);
 				REQUIRE((machine.getGlobalVariable(0) == expected).getBool());
+
+				registermachine::RegisterMachine registerMachine(registermachine::RegisterCompiler(program).run());
+				registerMachine.exec();
+
+				INFO(registerMachine.toString());
+				REQUIRE(registerMachine.getDataStack().size() == 1);
+				REQUIRE((registerMachine.getGlobalVariable(0) == expected).getBool());
+			} catch (const std::exception& e) {
+				FAIL(e.what());
+			}
+		}
+	}
+
+	void test_typed(std::string&& declaration, std::string&& expression, base::BasicType expected, base::OpCode typedOpCode) {
+		SECTION(declaration + " " + expression) {
+			try {
+				std::string code = declaration + "\n";
+				code += "func main() {\n";
+				code += expression + "\n";
+				code += "}";
+
+				Compiler compiler(std::move(code));
+				base::Program program = compiler.run();
+				REQUIRE(compiler.isSuccess());
+				REQUIRE(std::any_of(program.bytecode.begin(), program.bytecode.end(), [&](const base::Operation& op) {
+					return op.getOpCode() == typedOpCode;
+				}));
+
+				StackMachine machine(program);
+				forcedJit::apply(machine);
+				INFO(machine.toString());
+				machine.exec();
+
+				INFO(machine.toString());
+				REQUIRE(machine.getDataStack().size() == 1);
+				REQUIRE((machine.getGlobalVariable(0) == expected).getBool());
+
+				registermachine::RegisterMachine registerMachine(registermachine::RegisterCompiler(program).run());
+				registerMachine.exec();
+
+				INFO(registerMachine.toString());
+				REQUIRE(registerMachine.getDataStack().size() == 1);
+				REQUIRE((registerMachine.getGlobalVariable(0) == expected).getBool());
 			} catch (const std::exception& e) {
 				FAIL(e.what());
 			}
@@ -41,4 +87,26 @@ namespace operatorTest {
 		test("i = 6++;", base::BasicType(7));
 		test("i = 6--;", base::BasicType(5));
 	}
+
+	TEST_CASE("Operator-Test-typed") {
+		test_typed("int i = 0;", "i = 6 + 2;", base::BasicType(8), base::OpCode::ADD_INT);
+		test_typed("int i = 0;", "i = 6--;", base::BasicType(5), base::OpCode::DECR_INT);
+		test_typed("uint i = 0u;", "i = 6u * 2u;", base::BasicType(12u), base::OpCode::MULT_UINT);
+		test_typed("float i = 0.0;", "i = 6.5 - 2.0;", base::BasicType(4.5), base::OpCode::SUB_FLOAT);
+		test_typed("float i = 0.0;", "i = 7.0 / 2.0;", base::BasicType(3.5), base::OpCode::DIV_FLOAT);
+		test_typed("bool i = false;", "i = 2u < 3u;", base::BasicType(true), base::OpCode::LESS_UINT);
+		test_typed("bool i = true;", "i = 2.5 > 3.5;", base::BasicType(false), base::OpCode::BIGGER_FLOAT);
+		test_typed("bool i = false;", "i = true == true;", base::BasicType(true), base::OpCode::EQ_BOOL);
+
+		SECTION("Division through zero") {
+			Compiler compiler(std::string("int i = 0;\nfunc main() {\ni = 6 / 0;\n}"));
+			const base::Program program = compiler.run();
+			StackMachine machine(program);
+			forcedJit::apply(machine);
+			REQUIRE_THROWS_AS(machine.exec(), ex::Exception);
+
+			registermachine::RegisterMachine registerMachine(registermachine::RegisterCompiler(program).run());
+			REQUIRE_THROWS_AS(registerMachine.exec(), ex::Exception);
+		}
+	}
 }
\ No newline at end of file
@@ -0,0 +1,141 @@
+#pragma once
+
+#include "catch.hpp"
+#include "ForcedJit.h"
+#include "../src/Stackmachine/Stackmachine.h"
+#include "../src/Stackmachine/Executor.h"
+#include "../src/Compiler/Compiler.h"
+
+using namespace base;
+using namespace compiler;
+
+namespace parallelForTest {
+	const std::string code = R"(
+int scale = 3;
+int total = 0;
+int count = 0;
+float half = 0.0;
+int calls = 0;
+
+func int square(int n) {
+	return n * n;
+}
+
+func int sum(int begin, int end) {
+	pfor (int i = begin; i < end; i++) reduce (total) {
+		total = total + i;
+	}
+	return total;
+}
+
+func main() {
+	int n = 1000;
+	pfor (int i = 0; i < n; i++) reduce (total, count, half) {
+		int value = square(i) * scale;
+		if (value < 5000) {
+			continue;
+		}
+		for (int j = 0; j < 3; j++) {
+			if (j == 1) {
+				break;
+			}
+			total = total + value + j;
+		}
+		count++;
+		half = half + 0.5;
+	}
+	calls = sum(n, n + 1) + sum(5, 5);
+}
+)";
+
+	void checkResult(const stackmachine::StackMachine& machine) {
+		sm_int total = 0;
+		sm_int count = 0;
+		for (sm_int i = 0; i < 1000; i++) {
+			if (3 * i * i >= 5000) {
+				total += 3 * i * i;
+				count++;
+			}
+		}
+		REQUIRE(machine.getGlobalVariable(1).getInt() == total + 1000);
+		REQUIRE(machine.getGlobalVariable(2).getInt() == count);
+		REQUIRE(machine.getGlobalVariable(3).getFloat() == Approx(count * 0.5));
+		REQUIRE(machine.getGlobalVariable(4).getInt() == 2 * (total + 1000));
+	}
+
+	TEST_CASE("ParallelFor-Test") {
+		for (size_t inlineThreshold : { size_t(0), compiler::Inliner::defaultThreshold }) {
+			Compiler compiler(std::string(code), inlineThreshold);
+			const base::SharedProgram program = base::freeze(compiler.run());
+			REQUIRE(compiler.isSuccess());
+			// sum() and its pfor get copied into both calls, the original body stays
+			REQUIRE(std::count_if(program->bytecode.begin(), program->bytecode.end(), [](const base::Operation& op) { return op.getOpCode() == base::OpCode::PFOR; }) == ((inlineThreshold == 0) ? 2 : 4));
+
+			// without a runner the chunk function runs over the whole range
+			stackmachine::StackMachine sequential(program);
+			forcedJit::apply(sequential);
+			sequential.exec();
+			checkResult(sequential);
+
+			stackmachine::Executor executor(4, forcedJit::hotThreshold);
+			for (stackmachine::DispatchMode mode : { stackmachine::DispatchMode::Threaded, stackmachine::DispatchMode::Switch }) {
+				stackmachine::StackMachine parallel(program, mode);
+				forcedJit::apply(parallel);
+				parallel.enableParallelFor(executor);
+				parallel.exec();
+				checkResult(parallel);
+			}
+		}
+	}
+
+	TEST_CASE("ParallelFor-Test-error") {
+		Compiler compiler(std::string(R"(
+int total = 0;
+func main() {
+	pfor (int i = 0; i < 100; i++) reduce (total) {
+		total = total + 100 / (50 - i);
+	}
+}
+)"), 0);
+		const base::SharedProgram program = base::freeze(compiler.run());
+		REQUIRE(compiler.isSuccess());
+
+		stackmachine::Executor executor(2, forcedJit::hotThreshold);
+		stackmachine::StackMachine machine(program);
+		forcedJit::apply(machine);
+		machine.enableParallelFor(executor);
+		REQUIRE_THROWS_WITH(machine.exec(), "Division through zero");
+	}
+
+	TEST_CASE("ParallelFor-Test-compile") {
+		const std::vector<std::string> failing = {
+			"int g = 0; func main() { pfor (int i = 0; i < 9; i++) { g = i; } }", // not reduced
+			"int g = 0; func main() { pfor (int i = 0; i < 9; i++) reduce (g) { g = i + g; } }",
+			"int g = 0; func main() { pfor (int i = 0; i < 9; i++) reduce (g) { g = g + g; } }",
+			"int g = 0; int h = 0; func main() { pfor (int i = 0; i < 9; i++) reduce (g) { h = g; } }",
+			"int g = 0; func f() { g = 1; } func main() { pfor (int i = 0; i < 9; i++) { f(); } }",
+			"int g = 0; func int f() { return g; } func main() { pfor (int i = 0; i < 9; i++) reduce (g) { g = g + f(); } }",
+			"func main() { int n = 9; pfor (int i = 0; i < 9; i++) { n = i; } }", // locals of main are out of reach
+			"func main() { pfor (int i = 0; i < 9; i++) { break; } }",
+			"func main() { for (int j = 0; j < 9; j++) { pfor (int i = 0; i < 9; i++) { continue 2; } } }",
+			"func int f() { pfor (int i = 0; i < 9; i++) { return 1; } return 0; } func main() { f(); }",
+			"func main() { pfor (int i = 0; i < 9; i++) { pfor (int j = 0; j < 9; j++) { } } }",
+			"func main() { pfor (int i = 0; i < 9; i++) { yield; } }",
+			"bool g = false; func main() { pfor (int i = 0; i < 9; i++) reduce (g) { } }",
+			"func main() { int g = 0; pfor (int i = 0; i < 9; i++) reduce (g) { } }",
+			"int g = 0; func main() { pfor (int i = 0; i < 9; i = i + 1) { } }",
+			"int g = 0; func main() { pfor (int i = 0; i < true; i++) { } }",
+			"func f() { pfor (int i = 0; i < 9; i++) { f(); } } func main() { f(); }",
+		};
+		for (const std::string& code : failing) {
+			INFO(code);
+			Compiler compiler(std::string(code), 0);
+			compiler.run();
+			REQUIRE(!compiler.isSuccess());
+		}
+
+		Compiler compiler(std::string("int g = 0; func main() { int n = 4; pfor (int i = 0; i < n; i++) reduce (g) { for (int j = 0; j < 9; j++) { if (j == i) { continue 1; } g++; } } }"), 0);
+		compiler.run();
+		REQUIRE(compiler.isSuccess());
+	}
+}
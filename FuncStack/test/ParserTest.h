@@ -1,7 +1,9 @@
 #pragma once
 
 #include "catch.hpp"
+#include "ForcedJit.h"
 #include "../src/Stackmachine/Stackmachine.h"
+#include "../src/Registermachine/Registermachine.h"
 #include "../src/Compiler/Compiler.h"
 
 using namespace stackmachine;
@@ -20,13 +22,21 @@ namespace parserTest {
 				base::Program program = compiler.run();
 				REQUIRE(compiler.isSuccess());
 
-				StackMachine machine(std::move(program));
+				StackMachine machine(program);
+				forcedJit::apply(machine);
 				INFO(machine.toString());
 				machine.exec();
 
 				INFO(machine.toString());
 				REQUIRE(machine.getDataStack().size() == 1);
 				REQUIRE((machine.getGlobalVariable(0) == expected).getBool());
+
+				registermachine::RegisterMachine registerMachine(registermachine::RegisterCompiler(program).run());
+				registerMachine.exec();
+
+				INFO(registerMachine.toString());
+				REQUIRE(registerMachine.getDataStack().size() == 1);
+				REQUIRE((registerMachine.getGlobalVariable(0) == expected).getBool());
 			} catch (const std::exception& e) {
 				FAIL(e.what());
 			}
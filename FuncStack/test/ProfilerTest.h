@@ -0,0 +1,73 @@
+#pragma once
+
+#include "catch.hpp"
+#include "../src/Stackmachine/Stackmachine.h"
+#include "../src/Stackmachine/Profiler.h"
+#include "../src/Compiler/Compiler.h"
+
+using namespace base;
+using namespace compiler;
+
+namespace profilerTest {
+#if SM_PROFILER
+	TEST_CASE("Profiler-Test") {
+		Compiler compiler(std::string(R"(
+int i = 0;
+int j = 0;
+
+func int fib(int n) {
+	if (n < 2) {
+		return n;
+	}
+	return fib(n - 1) + fib(n - 2);
+}
+
+func int fib(float n) {
+	return 0;
+}
+
+func main() {
+	while (i < 50) {
+		j = fib(20);
+		i++;
+	}
+}
+)"), 0);
+		const base::SharedProgram program = base::freeze(compiler.run());
+		REQUIRE(compiler.isSuccess());
+
+		stackmachine::StackMachine machine(program, stackmachine::DispatchMode::Switch);
+		stackmachine::Profiler profiler(machine, std::chrono::microseconds(500));
+		REQUIRE_THROWS_WITH(stackmachine::Profiler(machine), "Only one Profiler can run at a time");
+		machine.exec();
+		profiler.stop();
+		REQUIRE(machine.getGlobalVariable(1).getInt() == 6765);
+
+		INFO(profiler.toFolded());
+		REQUIRE(profiler.samples() > 0);
+		uint64_t folded = 0;
+		std::istringstream lines(profiler.toFolded());
+		for (std::string line; std::getline(lines, line);) {
+			REQUIRE(line.rfind("main", 0) == 0);
+			const size_t space = line.rfind(' ');
+			REQUIRE(line.substr(0, space).find_first_not_of("mainfb();Int") == std::string::npos);
+			folded += std::stoull(line.substr(space + 1));
+		}
+		REQUIRE(folded == profiler.samples());
+		REQUIRE(profiler.toFolded().find("main;fib(int);fib(int)") != std::string::npos);
+
+		uint64_t indexed = 0;
+		for (size_t i = 0; i < program->bytecode.size(); i++) {
+			indexed += profiler.samples(i);
+		}
+		REQUIRE(indexed == profiler.samples());
+
+		// stopped, the machine runs on without samples and the next Profiler can start
+		const uint64_t samples = profiler.samples();
+		stackmachine::StackMachine next(program);
+		next.exec();
+		REQUIRE(profiler.samples() == samples);
+		stackmachine::Profiler(next, std::chrono::microseconds(500));
+	}
+#endif
+}
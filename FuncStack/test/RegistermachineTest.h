@@ -0,0 +1,171 @@
+#pragma once
+
+#include "catch.hpp"
+#include "ForcedJit.h"
+#include "../src/Stackmachine/Stackmachine.h"
+#include "../src/Registermachine/Registermachine.h"
+#include "../src/Compiler/Compiler.h"
+
+using namespace base;
+using namespace compiler;
+
+namespace registermachineTest {
+	// The stackmachine is the reference, both machines have to end with the same globals
+	void test(std::string&& code) {
+		SECTION(code) {
+			try {
+				Compiler compiler(std::move(code));
+				const base::Program program = compiler.run();
+				REQUIRE(compiler.isSuccess());
+
+				stackmachine::StackMachine reference(program);
+				forcedJit::apply(reference);
+				reference.exec();
+
+				registermachine::RegisterMachine machine(registermachine::RegisterCompiler(program).run());
+				INFO(reference.toString());
+				INFO(machine.toString());
+				machine.exec();
+
+				REQUIRE(machine.getDataStack().size() == reference.getDataStack().size());
+				for (size_t i = 0; i < reference.getDataStack().size(); i++) {
+					REQUIRE(machine.getGlobalVariable(i).typeId() == reference.getGlobalVariable(i).typeId());
+					REQUIRE((machine.getGlobalVariable(i) == reference.getGlobalVariable(i)).getBool());
+				}
+			} catch (const std::exception& e) {
+				FAIL(e.what());
+			}
+		}
+	}
+
+	TEST_CASE("Registermachine-Test") {
+		test(R"(
+int i = 0;
+float f = 0.0;
+func main() {
+	i = 3 + 4 * 5 - 6 / 2;
+	f = 1.5 * 2.0;
+	i++;
+	i--;
+	i--;
+}
+)");
+
+		test(R"(
+int i = 0;
+int j = 0;
+func main() {
+	int a = 3;
+	int b = a;
+	a = b + a;
+	b = a - b;
+	i = a;
+	j = b;
+}
+)");
+
+		test(R"(
+int i = 0;
+int j = 0;
+func main() {
+	for (int k = 0; k < 10; k++) {
+		if (k == 3) {
+			i = i + k;
+		} else {
+			j = j + 1;
+		}
+	}
+	while (i > 0) {
+		i = i - 1;
+		j = j * 2;
+	}
+}
+)");
+
+		test(R"(
+int i = 0;
+int j = 0;
+int k = 0;
+
+func sub2() {
+	k = i + 3;
+}
+
+func sub1() {
+	j = i + 2;
+	sub2();
+}
+
+func main() {
+	i = i + 1;
+	sub1();
+}
+)");
+
+		test(R"(
+int i = 0;
+int j = 0;
+
+func int add(int a, int b) {
+	return a + b;
+}
+
+func int fib(int n) {
+	if (n < 2) {
+		return n;
+	}
+	return fib(n - 1) + fib(n - 2);
+}
+
+func main() {
+	int t = add(2, 3);
+	i = add(1, t);
+	j = fib(12) + add(i, i);
+}
+)");
+	}
+
+	TEST_CASE("Registermachine-Test-fewer-instructions") {
+		std::string code = R"(
+int i = 0;
+int j = 0;
+func main() {
+	while (i < 100) {
+		i++;
+		j = j + i;
+	}
+}
+)";
+		Compiler compiler(std::move(code));
+		const base::Program program = compiler.run();
+		REQUIRE(compiler.isSuccess());
+
+		const registermachine::RegisterProgram registerProgram = registermachine::RegisterCompiler(program).run();
+		REQUIRE(registerProgram.code.size() < program.bytecode.size());
+	}
+
+	TEST_CASE("Registermachine-Test-stack-overflow") {
+		std::string code = R"(
+int i = 0;
+func int down(int n) {
+	return down(n + 1) + 1;
+}
+func main() {
+	i = down(0);
+}
+)";
+		Compiler compiler(std::move(code));
+		registermachine::RegisterMachine machine(registermachine::RegisterCompiler(compiler.run()).run(), 256);
+		REQUIRE_THROWS_WITH(machine.exec(), "Stack overflow");
+	}
+
+	TEST_CASE("Registermachine-Test-fibers") {
+		// fibers and parallel loops only run on the StackMachine
+		for (const char* code : { "func f() { yield; } func main() { f(); }", "func f(int n) { } func main() { spawn f(1); }", "int t = 0; func main() { pfor (int i = 0; i < 10; i++) reduce (t) { t = t + i; } }" }) {
+			Compiler compiler{ std::string(code) };
+			const base::Program program = compiler.run();
+			REQUIRE(compiler.isSuccess());
+			REQUIRE_THROWS_AS(registermachine::RegisterCompiler(program).run(), ex::Exception);
+		}
+	}
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "catch.hpp"
+#include "../src/Stackmachine/Stackmachine.h"
+#include "../src/Compiler/Compiler.h"
+
+using namespace base;
+using namespace compiler;
+
+namespace runStatsTest {
+#ifdef SM_STATS
+	const std::string code = R"(
+int result = 0;
+func int fib(int n) {
+	if (n < 2) {
+		return n;
+	}
+	return fib(n - 1) + fib(n - 2);
+}
+func main() {
+	result = fib(10);
+}
+)";
+
+	TEST_CASE("RunStats-Test") {
+		Compiler compiler(std::string(code), 0);
+		const base::SharedProgram program = base::freeze(compiler.run());
+		REQUIRE(compiler.isSuccess());
+
+		std::optional<stackmachine::RunStats> previous;
+		for (stackmachine::DispatchMode mode : { stackmachine::DispatchMode::Switch, stackmachine::DispatchMode::Threaded }) {
+			stackmachine::StackMachine machine(program, mode);
+			machine.exec();
+			const stackmachine::RunStats& stats = machine.getStats();
+			INFO(stats.toJson());
+
+			REQUIRE(stats.calls == 177 + 1); // the calls of fib and the one of main
+			REQUIRE(stats.maxCallDepth == 1 + 10);
+			REQUIRE(stats.maxStackDepth > 10);
+			REQUIRE(stats.literalLoads > 177);
+			REQUIRE(stats.instructions > stats.calls + stats.literalLoads);
+			REQUIRE(stats.stackReallocations == 0); // the stack of the machine is allocated once
+			if (previous.has_value()) {
+				REQUIRE(stats.instructions == previous->instructions);
+				REQUIRE(stats.literalLoads == previous->literalLoads);
+				REQUIRE(stats.maxStackDepth == previous->maxStackDepth);
+			}
+			previous = stats;
+
+			// every run counts on its own
+			const stackmachine::RunStats first = stats;
+			const std::vector<BasicType> arguments = { BasicType(sm_int(5)) };
+			machine.call(program->function("fib", { TypeIndex::Int })->entry, arguments);
+			REQUIRE(stats.calls == 15 - 1); // the first fib is entered by call()
+			REQUIRE(stats.maxCallDepth == 5);
+			REQUIRE(stats.instructions < first.instructions);
+
+			const std::string json = stats.toJson();
+			REQUIRE(json.find("\t\"calls\": 14,\n") != std::string::npos);
+			REQUIRE(json.find("\t\"maxCallDepth\": 5,\n") != std::string::npos);
+			REQUIRE(machine.toString().find("Stats:") != std::string::npos);
+		}
+	}
+
+	TEST_CASE("RunStats-Test-budget") {
+		Compiler compiler(std::string(code), 0);
+		const base::SharedProgram program = base::freeze(compiler.run());
+		REQUIRE(compiler.isSuccess());
+
+		stackmachine::StackMachine whole(program);
+		whole.exec();
+
+		// a paused run goes on counting, the operation that paused counts once
+		stackmachine::StackMachine paused(program);
+		while (paused.exec(50) == stackmachine::ExecState::Paused) {
+		}
+		REQUIRE(paused.getStats().instructions == whole.getStats().instructions);
+		REQUIRE(paused.getStats().calls == whole.getStats().calls);
+
+		// a fiber starts with a small stack that grows
+		stackmachine::StackMachine machine(program);
+		const std::shared_ptr<stackmachine::StackMachine::Fiber> fiber = machine.createFiber();
+		REQUIRE(machine.resume(fiber, std::numeric_limits<size_t>::max()) == stackmachine::ExecState::Finished);
+		REQUIRE(machine.getStats().stackReallocations > 0);
+		REQUIRE(machine.getStats().calls == whole.getStats().calls);
+	}
+#endif
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include "catch.hpp"
+#include "ForcedJit.h"
+#include "../src/Stackmachine/Stackmachine.h"
+#include "../src/Stackmachine/Scheduler.h"
+#include "../src/Compiler/Compiler.h"
+
+using namespace base;
+using namespace compiler;
+
+namespace schedulerTest {
+	base::SharedProgram compile(std::string code) {
+		Compiler compiler(std::move(code), 0);
+		base::SharedProgram program = base::freeze(compiler.run());
+		REQUIRE(compiler.isSuccess());
+		return program;
+	}
+
+	TEST_CASE("Scheduler-Test-interleave") {
+		const base::SharedProgram program = compile(R"(
+int a = 0;
+
+func work(int id, int n) {
+	for (int k = 0; k < n; k++) {
+		a = a * 10 + id;
+		yield;
+	}
+}
+
+func main() {
+	spawn work(1, 3);
+	spawn work(2, 3);
+}
+)");
+
+		for (stackmachine::DispatchMode mode : { stackmachine::DispatchMode::Switch, stackmachine::DispatchMode::Threaded }) {
+			stackmachine::Scheduler scheduler(program, stackmachine::Scheduler::defaultSlice, mode);
+			const std::shared_ptr<const stackmachine::StackMachine::Fiber> script = scheduler.spawn();
+			scheduler.run();
+
+			REQUIRE(scheduler.size() == 0);
+			REQUIRE(script->isFinished());
+			REQUIRE(script->getError() == nullptr);
+			REQUIRE(script->getGlobalVariable(0).getInt() == 121212); // the spawned functions took turns
+		}
+
+		// without a Scheduler yield does nothing and spawn fails
+		stackmachine::StackMachine machine(program);
+		forcedJit::apply(machine);
+		REQUIRE_THROWS_WITH(machine.exec(), "spawn needs a Scheduler");
+	}
+
+	TEST_CASE("Scheduler-Test-scripts") {
+		const base::SharedProgram program = compile(R"(
+int i = 0;
+int j = 0;
+
+func int depth(int n) {
+	if (n == 0) {
+		return 0;
+	}
+	return 1 + depth(n - 1);
+}
+
+func main() {
+	for (int k = 0; k < 200; k++) {
+		i = i + k;
+	}
+	j = depth(2000);
+}
+)");
+		stackmachine::StackMachine reference(program);
+		forcedJit::apply(reference);
+		reference.exec();
+
+		// small slices switch between the scripts all the time, the recursion lets their stacks grow
+		stackmachine::Scheduler scheduler(program, 50);
+		std::vector<std::shared_ptr<const stackmachine::StackMachine::Fiber>> scripts;
+		for (int i = 0; i < 2000; i++) {
+			scripts.push_back(scheduler.spawn());
+		}
+		REQUIRE(scheduler.size() == 2000);
+		scheduler.run();
+
+		for (const std::shared_ptr<const stackmachine::StackMachine::Fiber>& script : scripts) {
+			REQUIRE(script->isFinished());
+			REQUIRE(script->getDataStack().size() == reference.getDataStack().size());
+			for (size_t i = 0; i < reference.getDataStack().size(); i++) {
+				REQUIRE((script->getGlobalVariable(i) == reference.getGlobalVariable(i)).getBool());
+			}
+		}
+
+		// an overflow ends its fiber only
+		stackmachine::Scheduler small(program, 50, stackmachine::DispatchMode::Threaded, 100);
+		const std::shared_ptr<const stackmachine::StackMachine::Fiber> failing = small.spawn();
+		small.run();
+		REQUIRE(failing->isFinished());
+		REQUIRE_THROWS_WITH(std::rethrow_exception(failing->getError()), "Stack overflow");
+	}
+
+	TEST_CASE("Scheduler-Test-inlined-yield") {
+		// h reads its argument after the yield, w changes g in between
+		for (size_t inlineThreshold : { size_t(0), compiler::Inliner::defaultThreshold }) {
+			Compiler compiler(std::string("int g = 0; int r = 0; func int h(int x) { yield; return x; } func w() { g = 5; } func main() { spawn w(); r = h(g); }"), inlineThreshold);
+			const base::SharedProgram program = base::freeze(compiler.run());
+			REQUIRE(compiler.isSuccess());
+
+			stackmachine::Scheduler scheduler(program);
+			const std::shared_ptr<const stackmachine::StackMachine::Fiber> script = scheduler.spawn();
+			scheduler.run();
+			REQUIRE(script->getError() == nullptr);
+			REQUIRE(script->getGlobalVariable(1).getInt() == 0);
+		}
+	}
+
+	TEST_CASE("Scheduler-Test-compile") {
+		Compiler compiler(std::string("func f(int n) { yield; } func main() { spawn f(1); yield; }"), 0);
+		const base::Program program = compiler.run();
+		REQUIRE(compiler.isSuccess());
+		REQUIRE(std::count_if(program.bytecode.begin(), program.bytecode.end(), [](const base::Operation& op) { return op.getOpCode() == base::OpCode::SPAWN; }) == 1);
+		REQUIRE(std::count_if(program.bytecode.begin(), program.bytecode.end(), [](const base::Operation& op) { return op.getOpCode() == base::OpCode::YIELD; }) == 2);
+
+		for (const char* code : { "func main() { spawn 1 + 2; }", "int i = 0; func f() { } func main() { spawn i = 1; }", "func main() { yield 1; }", "func f(int a) { } func main() { spawn f(1) + 2; }" }) {
+			Compiler failing(std::string(code), 0);
+			failing.run();
+			REQUIRE(!failing.isSuccess());
+		}
+	}
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <thread>
+
+#include "catch.hpp"
+#include "ForcedJit.h"
+#include "../src/Stackmachine/Stackmachine.h"
+#include "../src/Stackmachine/UntaggedStackmachine.h"
+#include "../src/Compiler/Compiler.h"
+
+using namespace base;
+using namespace compiler;
+
+namespace sharedProgramTest {
+	TEST_CASE("SharedProgram-Test") {
+		std::string code = R"(
+int i = 0;
+int j = 0;
+
+func int fib(int n) {
+	if (n < 2) {
+		return n;
+	}
+	return fib(n - 1) + fib(n - 2);
+}
+
+func main() {
+	for (int k = 0; k < 1000; k++) {
+		i = i + k;
+	}
+	j = fib(18);
+}
+)";
+		Compiler compiler(std::move(code));
+		const base::SharedProgram program = base::freeze(compiler.run());
+		REQUIRE(compiler.isSuccess());
+
+		stackmachine::StackMachine reference(program);
+		forcedJit::apply(reference);
+		REQUIRE(reference.getProgram().get() == program.get()); // nothing copied
+		reference.exec();
+		REQUIRE((reference.getGlobalVariable(0) == base::BasicType(499500)).getBool());
+		REQUIRE((reference.getGlobalVariable(1) == base::BasicType(2584)).getBool());
+
+		// every thread runs its own machines on the same image, results are collected after the join
+		const long owners = program.use_count();
+		constexpr size_t threads = 8;
+		std::vector<std::vector<base::BasicType>> results(threads);
+		std::vector<std::thread> workers;
+		for (size_t t = 0; t < threads; t++) {
+			workers.emplace_back([&, t]() {
+				for (int run = 0; run < 4; run++) {
+					stackmachine::StackMachine machine(program, (t % 2 == 0) ? stackmachine::DispatchMode::Threaded : stackmachine::DispatchMode::Switch);
+					forcedJit::apply(machine);
+					if (t % 4 == 1) {
+						machine.enableJit(0);
+					}
+					machine.exec();
+					results[t].assign(machine.getDataStack().begin(), machine.getDataStack().end());
+
+					stackmachine::UntaggedStackMachine untaggedMachine(program);
+					untaggedMachine.exec();
+					results[t].push_back(untaggedMachine.getGlobalVariable(0));
+					results[t].push_back(untaggedMachine.getGlobalVariable(1));
+				}
+			});
+		}
+		for (std::thread& worker : workers) {
+			worker.join();
+		}
+
+		REQUIRE(program.use_count() == owners); // the machines of the threads released the image again
+		for (const std::vector<base::BasicType>& result : results) {
+			REQUIRE(result.size() == 4);
+			for (size_t i = 0; i < result.size(); i++) {
+				REQUIRE((result[i] == reference.getGlobalVariable(i % 2)).getBool());
+			}
+		}
+	}
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "catch.hpp"
+#include "../src/Stackmachine/Stackmachine.h"
+#include "../src/Compiler/Compiler.h"
+
+using namespace base;
+using namespace compiler;
+
+namespace sourceLineTest {
+	const std::string code = R"(int total = 0;
+
+func int square(int n) {
+	return n * n;
+}
+
+func main() {
+	for (int i = 0; i < 10; i++) {
+		total = total + square(i);
+	}
+	while (total > 100) { total = total - 7; }
+}
+)";
+
+	std::pair<uint32_t, uint32_t> lineOf(const base::Program& program, size_t index) {
+		const base::SourceLine* line = program.sourceLine(index);
+		REQUIRE(line != nullptr);
+		return { line->line, line->column };
+	}
+
+	size_t indexOf(const base::Program& program, base::OpCode opCode, size_t from = 0) {
+		const auto pos = std::find_if(program.bytecode.begin() + from, program.bytecode.end(), [&](const base::Operation& op) { return op.getOpCode() == opCode; });
+		REQUIRE(pos != program.bytecode.end());
+		return pos - program.bytecode.begin();
+	}
+
+	TEST_CASE("SourceLine-Test") {
+		for (size_t inlineThreshold : { size_t(0), compiler::Inliner::defaultThreshold }) {
+			INFO(inlineThreshold);
+			Compiler compiler(std::string(code), inlineThreshold);
+			const base::Program program = compiler.run();
+			REQUIRE(compiler.isSuccess());
+
+			const std::vector<base::SourceLine>& lines = program.lines;
+			REQUIRE(!lines.empty());
+			REQUIRE(lines.front().firstOperation == 0);
+			for (size_t i = 1; i < lines.size(); i++) {
+				REQUIRE(lines[i - 1].firstOperation < lines[i].firstOperation);
+				REQUIRE(lines[i].firstOperation < program.bytecode.size());
+			}
+
+			REQUIRE(lineOf(program, 0) == std::pair<uint32_t, uint32_t>(1, 1)); // the global
+			REQUIRE(lineOf(program, program.function("main", {})->entry) == std::pair<uint32_t, uint32_t>(8, 2)); // the for loop
+			REQUIRE(lineOf(program, program.mainCall) == std::pair<uint32_t, uint32_t>(0, 0)); // generated
+			REQUIRE(lineOf(program, indexOf(program, base::OpCode::SUB_INT)) == std::pair<uint32_t, uint32_t>(11, 24));
+
+			// the jump back of a loop belongs to the loop, not to the last statement of its body
+			const size_t storeTotal = indexOf(program, base::OpCode::STORE_GLOBAL, 3);
+			REQUIRE(lineOf(program, storeTotal) == std::pair<uint32_t, uint32_t>(9, 3));
+			REQUIRE(lineOf(program, indexOf(program, base::OpCode::JUMP, storeTotal)) == std::pair<uint32_t, uint32_t>(8, 2));
+
+			// an inlined body belongs to the statement of the call
+			const size_t body = (inlineThreshold == 0) ? program.function("square", { TypeIndex::Int })->entry : program.function("main", {})->entry;
+			const size_t multiply = indexOf(program, base::OpCode::MULT_INT, body);
+			REQUIRE(lineOf(program, multiply).first == ((inlineThreshold == 0) ? 4 : 9));
+		}
+	}
+
+	TEST_CASE("SourceLine-Test-noSource") {
+		base::Program program;
+		program.bytecode.push_back(base::Operation(base::OpCode::END_PROGRAM));
+		REQUIRE(program.sourceLine(0) == nullptr);
+
+		Source source(std::string("int a = 0;\n\n  func main() {}"));
+		REQUIRE(source.lineAndColumn(0) == std::pair<size_t, size_t>(1, 1));
+		REQUIRE(source.lineAndColumn(10) == std::pair<size_t, size_t>(1, 11));
+		REQUIRE(source.lineAndColumn(11) == std::pair<size_t, size_t>(2, 1));
+		REQUIRE(source.lineAndColumn(14) == std::pair<size_t, size_t>(3, 3));
+	}
+
+#ifdef SM_INSTRUMENTATION
+	TEST_CASE("SourceLine-Test-report") {
+		Compiler compiler(std::string(code), 0);
+		stackmachine::StackMachine machine(base::freeze(compiler.run()));
+		REQUIRE(compiler.isSuccess());
+		machine.exec();
+
+		const std::vector<uint64_t> hits = machine.getInstrumentation().lineHits(*machine.getProgram());
+		REQUIRE(hits.size() == 12);
+		REQUIRE(hits[4] == 10 * 4); // load, load, mult, return per call
+		REQUIRE(hits[11] > hits[9]);
+		REQUIRE(hits[0] == 2); // the call of main and the end of the program
+
+		const std::string report = machine.getInstrumentation().lineReport(*machine.getProgram(), code);
+		REQUIRE(report.find("          40 |    4 | \treturn n * n;\n") != std::string::npos);
+		REQUIRE(report.find("             |    2 | \n") != std::string::npos);
+		REQUIRE(report.find("           2 | generated code\n") != std::string::npos);
+	}
+#endif
+}
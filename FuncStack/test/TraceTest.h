@@ -0,0 +1,101 @@
+#pragma once
+
+#include <thread>
+
+#include "catch.hpp"
+#include "../src/Stackmachine/Stackmachine.h"
+#include "../src/Compiler/Compiler.h"
+
+using namespace base;
+using namespace compiler;
+
+namespace traceTest {
+#ifdef SM_TRACE
+	TEST_CASE("Trace-Test") {
+		Compiler compiler(std::string(R"(
+int i = 0;
+func int add(int a, int b) {
+	return a + b;
+}
+func main() {
+	while (i < 10) {
+		i = add(i, 1);
+	}
+}
+)"), 0);
+		const base::Program program = compiler.run();
+		REQUIRE(compiler.isSuccess());
+
+		for (stackmachine::DispatchMode mode : { stackmachine::DispatchMode::Switch, stackmachine::DispatchMode::Threaded }) {
+			stackmachine::StackMachine machine(program, mode);
+			machine.exec();
+			const std::vector<stackmachine::TraceEntry> entries = machine.getTrace().entries();
+			REQUIRE(entries.size() == machine.getTrace().recorded());
+			REQUIRE(entries.front().index == 0);
+			REQUIRE(entries.back().opCode == OpCode::END_PROGRAM);
+			REQUIRE(entries.back().callDepth == 0);
+
+			size_t additions = 0;
+			for (const stackmachine::TraceEntry& entry : entries) {
+				REQUIRE(program.bytecode[entry.index].getOpCode() == entry.opCode);
+				if (entry.opCode == OpCode::ADD_INT) {
+					additions++;
+					REQUIRE(entry.callDepth == 2); // main and add
+					REQUIRE(entry.stackDepth == 1 + 2 + 2); // the global, the parameters and the values to add
+				}
+			}
+			REQUIRE(additions == 10);
+
+			const std::string dump = machine.dumpTrace();
+			REQUIRE(dump.find(" index | stack | calls | operation\n") == 0);
+			REQUIRE(dump.find("|     5 |     2 | <add_int>") != std::string::npos);
+			REQUIRE(machine.toString().find("Trace:") != std::string::npos);
+		}
+	}
+
+	TEST_CASE("Trace-Test-ring") {
+		Compiler compiler(std::string(R"(
+int i = 0;
+func main() {
+	while (i < 10000) {
+		i = i + 1;
+		i = i + 0 / (9999 - i);
+	}
+}
+)"), 0);
+		const base::Program program = compiler.run();
+		REQUIRE(compiler.isSuccess());
+
+		stackmachine::StackMachine machine(program);
+		std::ostringstream errorTrace;
+		machine.dumpTraceOnError(&errorTrace);
+
+		// a reader takes copies while the machine overwrites the buffer
+		std::atomic<bool> done = false;
+		bool consistent = true;
+		std::thread reader([&]() {
+			while (!done) {
+				for (const stackmachine::TraceEntry& entry : machine.getTrace().entries()) {
+					consistent = consistent and (entry.index < program.bytecode.size()) and (program.bytecode[entry.index].getOpCode() == entry.opCode);
+				}
+			}
+		});
+		REQUIRE_THROWS_WITH(machine.exec(), "Division through zero");
+		done = true;
+		reader.join();
+		REQUIRE(consistent);
+
+		// the oldest are gone, the last one is the division that threw
+		const std::vector<stackmachine::TraceEntry> entries = machine.getTrace().entries();
+		REQUIRE(machine.getTrace().recorded() > stackmachine::Trace::capacity);
+		REQUIRE(entries.size() == stackmachine::Trace::capacity - 1);
+		REQUIRE(entries.back().opCode == OpCode::DIV_INT);
+
+		const std::string dump = errorTrace.str();
+		REQUIRE(dump.find("Trace:\n") == 0);
+		REQUIRE(dump.substr(dump.rfind('\n', dump.size() - 2)).find("<div_int>") != std::string::npos);
+
+		machine.dumpTraceOnError(nullptr);
+	}
+#endif
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "catch.hpp"
+#include "../src/Stackmachine/Stackmachine.h"
+#include "../src/Stackmachine/UntaggedStackmachine.h"
+#include "../src/Compiler/Compiler.h"
+
+using namespace base;
+using namespace compiler;
+
+namespace untaggedStackmachineTest {
+	// The tagged stackmachine is the reference, both machines have to end with the same globals
+	void test(std::string&& code) {
+		SECTION(code) {
+			try {
+				Compiler compiler(std::move(code));
+				const base::Program program = compiler.run();
+				REQUIRE(compiler.isSuccess());
+
+				stackmachine::StackMachine reference(program);
+				reference.exec();
+
+				stackmachine::UntaggedStackMachine machine(program);
+				INFO(reference.toString());
+				machine.exec();
+				INFO(machine.toString());
+
+				REQUIRE(machine.getDataStack().size() == reference.getDataStack().size());
+				for (size_t i = 0; i < reference.getDataStack().size(); i++) {
+					REQUIRE(machine.getGlobalVariable(i).typeId() == reference.getGlobalVariable(i).typeId());
+					REQUIRE((machine.getGlobalVariable(i) == reference.getGlobalVariable(i)).getBool());
+				}
+			} catch (const std::exception& e) {
+				FAIL(e.what());
+			}
+		}
+	}
+
+	TEST_CASE("UntaggedStackmachine-Test") {
+		test(R"(
+int i = 0;
+uint u = 0u;
+float f = 0.0;
+bool b = false;
+func main() {
+	i = 3 + 4 * 5 - 6 / 2;
+	u = 7u * 3u;
+	f = 1.5 * 2.0;
+	b = f > 2.5;
+	i--;
+}
+)");
+
+		test(R"(
+int i = 0;
+int j = 0;
+func main() {
+	for (int k = 0; k < 10; k++) {
+		if (k == 3) {
+			i = i + k;
+		} else {
+			j = j + 1;
+		}
+	}
+	while (i > 0) {
+		i = i - 1;
+		j = j * 2;
+	}
+}
+)");
+
+		test(R"(
+int i = 0;
+int j = 0;
+
+func int add(int a, int b) {
+	return a + b;
+}
+
+func int fib(int n) {
+	if (n < 2) {
+		return n;
+	}
+	return fib(n - 1) + fib(n - 2);
+}
+
+func main() {
+	int t = add(2, 3);
+	i = add(1, t);
+	j = fib(12) + add(i, i);
+}
+)");
+	}
+
+	TEST_CASE("UntaggedStackmachine-Test-generic-operations") {
+		std::string code = R"(
+float f = 0.0;
+func main() {
+	f = 1 + 2.5;
+}
+)";
+		Compiler compiler(std::move(code));
+		const base::Program program = compiler.run();
+		REQUIRE(compiler.isSuccess());
+		REQUIRE_THROWS_AS(stackmachine::UntaggedStackMachine(program), ex::Exception);
+	}
+
+	TEST_CASE("UntaggedStackmachine-Test-fibers") {
+		for (const char* code : { "func f() { yield; } func main() { f(); }", "func f(int n) { } func main() { spawn f(1); }", "int t = 0; func main() { pfor (int i = 0; i < 10; i++) reduce (t) { t = t + i; } }" }) {
+			Compiler compiler{ std::string(code) };
+			const base::Program program = compiler.run();
+			REQUIRE(compiler.isSuccess());
+			REQUIRE_THROWS_AS(stackmachine::UntaggedStackMachine(program), ex::Exception);
+		}
+	}
+}
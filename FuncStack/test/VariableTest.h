@@ -1,6 +1,7 @@
 #pragma once
 
 #include "catch.hpp"
+#include "ForcedJit.h"
 #include "../src/Stackmachine/Stackmachine.h"
 #include "../src/Compiler/Compiler.h"
 
@@ -19,6 +20,7 @@ namespace variableTest {
 				REQUIRE(compiler.isSuccess());
 
 				StackMachine machine(std::move(program));
+				forcedJit::apply(machine);
 				INFO(machine.toString());
 
 				machine.exec();
@@ -33,6 +35,7 @@ namespace variableTest {
 				REQUIRE(compiler.isSuccess());
 
 				StackMachine machine(std::move(program));
+				forcedJit::apply(machine);
 				INFO(machine.toString());
 
 				machine.exec();
@@ -47,6 +50,7 @@ namespace variableTest {
 				REQUIRE(compiler.isSuccess());
 
 				StackMachine machine(std::move(program));
+				forcedJit::apply(machine);
 				INFO(machine.toString());
 
 				machine.exec();
@@ -61,6 +65,7 @@ namespace variableTest {
 				REQUIRE(compiler.isSuccess());
 
 				StackMachine machine(std::move(program));
+				forcedJit::apply(machine);
 				INFO(machine.toString());
 
 				machine.exec();
@@ -82,6 +87,7 @@ namespace variableTest {
 				REQUIRE(compiler.isSuccess());
 
 				StackMachine machine(std::move(program));
+				forcedJit::apply(machine);
 				INFO(machine.toString());
 
 				machine.exec();
@@ -108,6 +114,7 @@ namespace variableTest {
 			REQUIRE(compiler.isSuccess());
 
 			StackMachine machine(std::move(program));
+			forcedJit::apply(machine);
 			INFO(machine.toString());
 
 			machine.exec();